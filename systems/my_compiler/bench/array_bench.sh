@@ -0,0 +1,60 @@
+#!/bin/sh
+# array sum throughput under the array codegen
+# sums an N element array R times, once with the index proved in range by
+# the loop (no checks, so the C compiler may vectorize) and once with every
+# access checked (the loop starts from a variable read at run time, so
+# the C compiler cannot prove the range either), and reports the time
+# and elements per nanosecond of each at -O2 and -O3
+#
+# usage: ./bench/array_bench.sh [elements] [repeats]   (run from systems/my_compiler after make)
+
+N=${1:-100000}
+R=${2:-2000}
+COMPILE=./compile
+DIR=${TMPDIR:-/tmp}/array_bench.$$
+mkdir -p "$DIR"
+
+# $1 is the statement that starts the loop index at 0
+program() {
+    cat <<BASIC
+dim a[$N];
+let i = 0;
+while i < $N repeat
+    let a[i] = i - i / 7 * 7;
+    let i = i + 1;
+endwhile
+input z;
+let total = 0;
+let r = 0;
+while r < $R repeat
+    let s = 0;
+    $1
+    while i < $N repeat
+        let s = s + a[i];
+        let i = i + 1;
+    endwhile
+    let total = total + s / $R;
+    let r = r + 1;
+endwhile
+print total;
+BASIC
+}
+
+program "let i = 0;" > "$DIR/proved.basic"
+program "let i = z;" > "$DIR/checked.basic"
+for v in proved checked; do
+    $COMPILE "$DIR/$v.basic" >/dev/null || exit 1
+done
+
+now() { date +%s%N; }
+for opt in -O2 -O3; do
+    for v in proved checked; do
+        cc $opt -o "$DIR/$v" "$DIR/$v.c" || exit 1
+        t0=$(now)
+        echo 0 | "$DIR/$v" >/dev/null
+        t1=$(now)
+        awk -v ns=$((t1 - t0)) -v n=$N -v r=$R -v v=$v -v o=$opt \
+            'BEGIN { printf "%s %-8s %8.1f ms  %6.2f elements/ns\n", o, v, ns / 1e6, n * r / ns }'
+    done
+done
+rm -rf "$DIR"
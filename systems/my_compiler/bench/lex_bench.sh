@@ -0,0 +1,34 @@
+#!/bin/sh
+# lexing throughput across thread counts
+# generates a large .basic corpus (strings spanning lines, comments with quotes)
+# and reports the lex phase from --time-report for 1, 2, 4, ... cores
+#
+# usage: ./bench/lex_bench.sh [size in MB]   (run from systems/my_compiler after make)
+
+MB=${1:-200}
+CORPUS=./bench/corpus.basic
+COMPILE=./compile
+
+if [ ! -f "$CORPUS" ] || [ "$(($(wc -c < "$CORPUS") / 1048576))" -ne "$MB" ]; then
+    echo "generating ${MB} MB corpus..."
+    awk -v limit=$((MB * 1048576)) 'BEGIN {
+        srand(42);
+        while (size < limit) {
+            r = rand();
+            if (r < 0.05) line = "# comment with \"quote\" and # hash\n";
+            else if (r < 0.10) line = "print \"multi\nline # not a comment\n string\";\n";
+            else line = sprintf("let v%d = v%d + %d * w%d;\n", int(rand() * 5000), int(rand() * 5000), int(rand() * 100), int(rand() * 50));
+            printf "%s", line;
+            size += length(line);
+        }
+    }' > "$CORPUS"
+fi
+
+CORES=${CORES:-$(nproc)}
+n=1
+while [ "$n" -le "$CORES" ]; do
+    printf "threads=%-3d " "$n"
+    $COMPILE --time-report --lex-threads=$n "$CORPUS" 2>&1 >/dev/null | awk '$1 == "lex" && NF == 6 { print "lex " $2 " ms wall, " $3 " ms cpu" }'
+    n=$((n * 2))
+done
+rm -f ./bench/corpus.c
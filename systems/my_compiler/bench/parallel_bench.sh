@@ -0,0 +1,43 @@
+#!/bin/sh
+# parallel for scaling across thread counts
+# a sum reduction over N iterations of W steps of integer work each, built
+# once and run with BASIC_THREADS = 1, 2, 4, ... cores, reporting the time
+# and the speedup over one thread
+#
+# usage: ./bench/parallel_bench.sh [iterations] [work per iteration]   (run from systems/my_compiler after make)
+
+N=${1:-2000000}
+W=${2:-100}
+COMPILE=./compile
+DIR=${TMPDIR:-/tmp}/parallel_bench.$$
+mkdir -p "$DIR"
+
+cat > "$DIR/sum.basic" <<BASIC
+let total = 0;
+for i = 0 to $N - 1 parallel sum(total)
+    let x = i;
+    for k = 1 to $W
+        let x = x * 37 + k;
+        let x = x - x / 1009 * 1009;
+    endfor
+    let total = total + x;
+endfor
+print total;
+BASIC
+$COMPILE "$DIR/sum.basic" >/dev/null || exit 1
+cc -O2 -pthread -o "$DIR/sum" "$DIR/sum.c" || exit 1
+
+now() { date +%s%N; }
+CORES=${CORES:-$(nproc)}
+base=0
+n=1
+while [ "$n" -le "$CORES" ]; do
+    t0=$(now)
+    BASIC_THREADS=$n "$DIR/sum" >/dev/null
+    t1=$(now)
+    ns=$((t1 - t0))
+    [ "$base" -eq 0 ] && base=$ns
+    awk -v ns=$ns -v base=$base -v n=$n 'BEGIN { printf "threads=%-3d %8.1f ms  speedup %.2fx\n", n, ns / 1e6, base / ns }'
+    n=$((n * 2))
+done
+rm -rf "$DIR"
@@ -0,0 +1,1746 @@
+#include "codegen.hpp"
+#include "timing.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <iostream>
+#include <fstream>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+
+// placeholders in generated code, control characters never reach the output
+// because escape() spells out any a string literal contains
+static const char CALL_OPEN = '\x01';
+static const char CALL_CLOSE = '\x02';
+static const char ARG_OPEN = '\x03';
+static const char ARG_CLOSE = '\x04';
+
+// the worker pool behind parallel for loops, written once into any program
+// that has one. iterations are handed out in chunks through one atomic
+// counter, about 8 chunks per thread, so uneven iterations even out. the
+// calling thread works too, as slot 0. BASIC_THREADS overrides the number
+// of threads, which defaults to the online cores.
+static const char *PARALLEL_RUNTIME =
+    "#include <limits.h>\n"
+    "#include <pthread.h>\n"
+    "#include <unistd.h>\n"
+    "#define BASIC_MAX_THREADS 64\n"
+    "typedef void (*basic_body)(void *ctx, int first, int last, int slot);\n"
+    "static struct {\n"
+    "  pthread_mutex_t lock;\n"
+    "  pthread_cond_t wake, done;\n"
+    "  int threads, busy;\n"
+    "  long generation;\n"
+    "  basic_body body;\n"
+    "  void *ctx;\n"
+    "  long last, chunk, next;\n"
+    "} basic_pool = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, PTHREAD_COND_INITIALIZER};\n"
+    "static void basic_pool_run(int slot) {\n"
+    "  for (;;) {\n"
+    "    long at = __atomic_fetch_add(&basic_pool.next, basic_pool.chunk, __ATOMIC_RELAXED);\n"
+    "    if (at > basic_pool.last) return;\n"
+    "    long end = at + basic_pool.chunk - 1;\n"
+    "    basic_pool.body(basic_pool.ctx, (int)at, (int)(end < basic_pool.last ? end : basic_pool.last), slot);\n"
+    "  }\n"
+    "}\n"
+    "static void *basic_worker(void *arg) {\n"
+    "  int slot = (int)(long)arg;\n"
+    "  long seen = 0;\n"
+    "  pthread_mutex_lock(&basic_pool.lock);\n"
+    "  for (;;) {\n"
+    "    while (basic_pool.generation == seen) pthread_cond_wait(&basic_pool.wake, &basic_pool.lock);\n"
+    "    seen = basic_pool.generation;\n"
+    "    pthread_mutex_unlock(&basic_pool.lock);\n"
+    "    basic_pool_run(slot);\n"
+    "    pthread_mutex_lock(&basic_pool.lock);\n"
+    "    if (--basic_pool.busy == 0) pthread_cond_signal(&basic_pool.done);\n"
+    "  }\n"
+    "  return NULL;\n"
+    "}\n"
+    "static void basic_parallel(int first, int last, basic_body body, void *ctx) {\n"
+    "  if (basic_pool.threads == 0) {\n"
+    "    const char *env = getenv(\"BASIC_THREADS\");\n"
+    "    long n = env ? atol(env) : sysconf(_SC_NPROCESSORS_ONLN);\n"
+    "    basic_pool.threads = n < 1 ? 1 : n > BASIC_MAX_THREADS ? BASIC_MAX_THREADS : (int)n;\n"
+    "    for (long k = 1; k < basic_pool.threads; k++) {\n"
+    "      pthread_t t;\n"
+    "      if (pthread_create(&t, NULL, basic_worker, (void *)k) != 0) {\n"
+    "        basic_pool.threads = (int)k;\n"
+    "        break;\n"
+    "      }\n"
+    "      pthread_detach(t);\n"
+    "    }\n"
+    "  }\n"
+    "  if (first > last) return;\n"
+    "  long chunk = ((long)last - first + 1) / (8L * basic_pool.threads);\n"
+    "  pthread_mutex_lock(&basic_pool.lock);\n"
+    "  basic_pool.body = body;\n"
+    "  basic_pool.ctx = ctx;\n"
+    "  basic_pool.last = last;\n"
+    "  basic_pool.chunk = chunk < 1 ? 1 : chunk;\n"
+    "  basic_pool.next = first;\n"
+    "  basic_pool.busy = basic_pool.threads - 1;\n"
+    "  basic_pool.generation++;\n"
+    "  pthread_cond_broadcast(&basic_pool.wake);\n"
+    "  pthread_mutex_unlock(&basic_pool.lock);\n"
+    "  basic_pool_run(0);\n"
+    "  pthread_mutex_lock(&basic_pool.lock);\n"
+    "  while (basic_pool.busy > 0) pthread_cond_wait(&basic_pool.done, &basic_pool.lock);\n"
+    "  pthread_mutex_unlock(&basic_pool.lock);\n"
+    "}\n";
+
+// the sampling profiler, written once into a program built to sample. a
+// SIGPROF handler takes the instruction the thread was at, which the #line
+// of every statement ties to a source line through the debug info, and the
+// shadow stack of the loops and subs around it, which the code keeps up to
+// date on entering and leaving them. samples go into a fixed table keyed by
+// a hash of both, so the handler neither allocates nor locks, and straight
+// code pays nothing at all between samples. the shadow stack is volatile so
+// the compiler keeps its stores in place for a signal to see.
+static const char *SAMPLE_RUNTIME =
+    "#include <link.h>\n"
+    "#include <signal.h>\n"
+    "#include <string.h>\n"
+    "#include <sys/time.h>\n"
+    "#include <ucontext.h>\n"
+    "#include <unistd.h>\n"
+    "#define BASIC_SAMPLE_DEPTH 64\n"
+    "#define BASIC_SAMPLE_SLOTS 8192\n"
+    "#if defined(__x86_64__)\n"
+    "#define BASIC_PC(uc) ((unsigned long)(uc)->uc_mcontext.gregs[REG_RIP])\n"
+    "#elif defined(__aarch64__)\n"
+    "#define BASIC_PC(uc) ((unsigned long)(uc)->uc_mcontext.pc)\n"
+    "#else\n"
+    "#define BASIC_PC(uc) 0ul\n"
+    "#endif\n"
+    "static _Thread_local volatile struct {\n"
+    "  int depth;\n"
+    "  int frames[BASIC_SAMPLE_DEPTH];\n"
+    "} basic_where;\n"
+    "static struct {\n"
+    "  unsigned long long key, count;\n"
+    "  unsigned long pc;\n"
+    "  int depth;\n"
+    "  int frames[BASIC_SAMPLE_DEPTH];\n"
+    "} basic_samples[BASIC_SAMPLE_SLOTS];\n"
+    "static unsigned long long basic_samples_lost;\n"
+    "static inline void basic_sample_push(int depth, int site) {\n"
+    "  if (depth < BASIC_SAMPLE_DEPTH) basic_where.frames[depth] = site;\n"
+    "  basic_where.depth = depth + 1;\n"
+    "}\n"
+    "static inline int basic_sample_enter(int site) {\n"
+    "  int depth = basic_where.depth;\n"
+    "  basic_sample_push(depth, site);\n"
+    "  return depth + 1;\n"
+    "}\n"
+    "static void basic_sample_tick(int sig, siginfo_t *info, void *context) {\n"
+    "  (void)sig;\n"
+    "  (void)info;\n"
+    "  unsigned long pc = BASIC_PC((ucontext_t *)context);\n"
+    "  int depth = basic_where.depth;\n"
+    "  if (depth > BASIC_SAMPLE_DEPTH) depth = BASIC_SAMPLE_DEPTH;\n"
+    "  unsigned long long key = (14695981039346656037ull ^ pc) * 1099511628211ull;\n"
+    "  for (int k = 0; k < depth; k++) key = (key ^ (unsigned)basic_where.frames[k]) * 1099511628211ull;\n"
+    "  key = (key ^ (unsigned)depth) * 1099511628211ull;\n"
+    "  if (key == 0) key = 1;\n"
+    "  for (unsigned probe = 0; probe < BASIC_SAMPLE_SLOTS; probe++) {\n"
+    "    unsigned slot = (unsigned)(key + probe) % BASIC_SAMPLE_SLOTS;\n"
+    "    unsigned long long seen = __atomic_load_n(&basic_samples[slot].key, __ATOMIC_RELAXED);\n"
+    "    if (seen == 0 && __atomic_compare_exchange_n(&basic_samples[slot].key, &seen, key, 0,\n"
+    "                                                 __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {\n"
+    "      basic_samples[slot].pc = pc;\n"
+    "      basic_samples[slot].depth = depth;\n"
+    "      for (int k = 0; k < depth; k++) basic_samples[slot].frames[k] = basic_where.frames[k];\n"
+    "      seen = key;\n"
+    "    }\n"
+    "    if (seen == key) {\n"
+    "      __atomic_fetch_add(&basic_samples[slot].count, 1, __ATOMIC_RELAXED);\n"
+    "      return;\n"
+    "    }\n"
+    "  }\n"
+    "  __atomic_fetch_add(&basic_samples_lost, 1, __ATOMIC_RELAXED);\n"
+    "}\n"
+    "static int basic_sample_bias(struct dl_phdr_info *info, size_t size, void *bias) {\n"
+    "  (void)size;\n"
+    "  *(unsigned long *)bias = info->dlpi_addr;\n"
+    "  return 1;\n"
+    "}\n";
+
+// inline a routine at a call statement only up to this many statements, or
+// this many if a profile shows it is hot
+static const int INLINE_STATEMENTS = 8;
+static const int HOT_INLINE_STATEMENTS = 32;
+// and substitute a `return <expr>;` routine only up to this many nodes
+static const std::size_t INLINE_NODES = 32;
+// a branch gets a hint once it has gone one way this many times to every
+// time it went the other, over at least HINT_RUNS runs
+static const std::uint64_t HINT_RATIO = 19;
+static const std::uint64_t HINT_RUNS = 16;
+
+// checks whether a variable was already declared
+bool Emitter::Declared(std::uint32_t id) const
+{
+    return id < symbols.size() && symbols[id].type != Type::NONE;
+}
+
+// records the type of a variable, growing the table to fit the id
+void Emitter::Declare(std::uint32_t id, Type type)
+{
+    if (id >= symbols.size())
+        symbols.resize(id + 1);
+    symbols[id].type = type;
+}
+
+// simply adds to given string
+void Emitter::Add(const std::string &s)
+{
+    code += s;
+}
+// adds line to given string
+void Emitter::AddLine(const std::string &s)
+{
+    if (!line.empty())
+        code += line + "\n";
+    code += s + "\n";
+}
+
+// adds header to header vector
+void Emitter::AddHeader(const std::string &h)
+{
+    headers.push_back(h);
+}
+
+// constructs final c code
+std::string Emitter::ToString()
+{
+    std::string final_string;
+    // starts with adding headers
+    for (size_t i = 0; i < headers.size(); i++)
+        final_string += headers[i] + "\n";
+    if (checked || parallel || counted || sampled)
+        final_string += "#include <stdlib.h>\n";
+    if (parallel)
+        final_string += PARALLEL_RUNTIME;
+    if (sampled)
+        final_string += SAMPLE_RUNTIME;
+    // the bounds check of array indices no loop proved safe
+    if (checked)
+        final_string += "static int basic_index(int size, int i) {\n"
+                        "  if (i < 0 || i >= size) {\n"
+                        "    fprintf(stderr, \"array index %d out of range 0..%d\\n\", i, size - 1);\n"
+                        "    exit(1);\n"
+                        "  }\n"
+                        "  return i;\n"
+                        "}\n";
+    // then the routines and main
+    final_string += globals;
+    final_string += prototypes;
+    final_string += functions;
+    final_string += code;
+    return final_string;
+}
+
+// writes to file
+void Emitter::WriteToFile(const std::string &filename)
+{
+    std::ofstream output(filename);
+    // check if file can be opened
+    if (!output.is_open())
+    {
+        std::cerr << "Failed to open output file: " << filename << "\n";
+        return;
+    }
+    output << ToString();
+    output.close();
+}
+
+// begins with the header and main func that starts every file
+void CodeGen::begin()
+{
+    // the sampler reads registers and the loaded objects, which glibc only
+    // declares for gnu code, and that has to be said before any header
+    if (sample)
+        emitter.AddHeader("#define _GNU_SOURCE");
+    emitter.AddHeader("#include <stdio.h>");
+    emitter.AddLine("int main(void) {");
+    if (instrument)
+        emitter.AddLine("  atexit(basic_prof_dump);");
+    if (sample)
+    {
+        emitter.AddLine("  basic_sample_start();");
+        emitter.AddLine("  const int basic_base = 0;");
+        emitter.AddLine("  (void)basic_base;");
+    }
+}
+
+// runs fn(0) ... fn(n - 1) on up to `threads` threads (this one included),
+// each pulling the next index until none are left
+template <typename Fn>
+static void parallelEach(std::size_t n, unsigned threads, const char *phase, Fn fn)
+{
+    std::atomic<std::size_t> next{0};
+    auto work = [&]
+    {
+        Phase timed(phase);
+        for (std::size_t k; (k = next.fetch_add(1)) < n;)
+            fn(k);
+    };
+    std::vector<std::thread> workers;
+    for (unsigned t = 1; t < std::min<std::size_t>(threads, n); t++)
+        workers.emplace_back(work);
+    work();
+    for (std::thread &t : workers)
+        t.join();
+}
+
+// concludes with every file ending which just returns 0 (and the cold code
+// after it), then lowers the routines and links every call
+void CodeGen::end()
+{
+    emitter.AddLine("  return 0;");
+    emitter.Add(cold);
+    emitter.AddLine("}");
+    blocks.insert(blocks.begin(), map);
+    sites.insert(sites.begin(), marks);
+    if (!routines.empty() || !calls.empty())
+        finishRoutines();
+    if (instrument)
+        profileRuntime();
+    if (sample)
+        sampleRuntime();
+}
+
+// lowers the routines on the worker threads and links every call
+void CodeGen::finishRoutines()
+{
+    std::vector<int> byid(names.size(), -1);
+    for (std::size_t k = 0; k < routines.size(); k++)
+    {
+        std::uint32_t id = routines[k].def.id;
+        if (byid[id] >= 0)
+        {
+            std::cerr << "sub defined twice: " << names.name(id) << "\n";
+            std::exit(1);
+        }
+        byid[id] = k;
+    }
+
+    // routines share nothing but the read only name table and each other's
+    // finished shapes, so both passes split across workers
+    parallelEach(routines.size(), threads, "lower", [&](std::size_t k)
+                 { lower(routines[k]); });
+    parallelEach(routines.size(), threads, "link", [&](std::size_t k)
+                 { routines[k].code = link(routines[k].code, routines[k].calls, byid); });
+    {
+        Phase phase("link");
+        emitter.code = link(emitter.code, calls, byid);
+    }
+    for (const Routine &r : routines)
+    {
+        emitter.prototypes += signature(r) + ";\n";
+        emitter.functions += r.code;
+        emitter.checked = emitter.checked || r.checked;
+        emitter.parallel = emitter.parallel || r.parallel;
+        blocks.insert(blocks.end(), r.blocks.begin(), r.blocks.end());
+        sites.insert(sites.end(), r.sites.begin(), r.sites.end());
+    }
+}
+
+// the counter of every block, and a function run at exit that writes them
+// out with the site each block starts at
+void CodeGen::profileRuntime()
+{
+    std::string table;
+    for (const BlockMap &m : blocks)
+    {
+        std::string size = std::to_string(m.blocks.size());
+        emitter.globals += "static unsigned long long basic_prof_" + m.scope + "[" +
+                           std::to_string(std::max<std::size_t>(m.blocks.size(), 1)) + "];\n";
+        table += "  {\"" + m.scope + "\", basic_prof_" + m.scope + ", " + size + ", (const char *const[]){";
+        for (std::size_t k = 0; k < m.blocks.size(); k++)
+            table += (k ? ", \"" : "\"") + escape(m.blocks[k].file + ":" + std::to_string(m.blocks[k].line)) + "\"";
+        table += m.blocks.empty() ? "\"\"}},\n" : "}},\n";
+    }
+    char hash[17];
+    std::snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)source);
+    emitter.globals += "static const struct {\n"
+                       "  const char *scope;\n"
+                       "  unsigned long long *counts;\n"
+                       "  int size;\n"
+                       "  const char *const *sites;\n"
+                       "} basic_prof_scopes[] = {\n" +
+                       table + "};\n";
+    emitter.globals += "static void basic_prof_dump(void) {\n"
+                       "  const char *path = getenv(\"BASIC_PROFILE\");\n"
+                       "  if (!path) path = \"" + escape(profilePath) + "\";\n"
+                       "  FILE *out = fopen(path, \"w\");\n"
+                       "  if (!out) {\n"
+                       "    fprintf(stderr, \"cannot write profile %s\\n\", path);\n"
+                       "    return;\n"
+                       "  }\n"
+                       "  fprintf(out, \"basic-profile 1 " + hash + "\\n\");\n"
+                       "  for (unsigned s = 0; s < sizeof(basic_prof_scopes) / sizeof(basic_prof_scopes[0]); s++)\n"
+                       "    for (int k = 0; k < basic_prof_scopes[s].size; k++)\n"
+                       "      fprintf(out, \"%s %d %llu %s\\n\", basic_prof_scopes[s].scope, k,\n"
+                       "              basic_prof_scopes[s].counts[k], basic_prof_scopes[s].sites[k]);\n"
+                       "  fclose(out);\n"
+                       "}\n";
+    emitter.counted = true;
+}
+
+// names every frame, numbered across the functions, then a function run at
+// exit that writes the samples out, and one that starts the timer.
+// the file starts "basic-samples 1 <load bias> <program>" and then has one
+// "<count> <address> main;frame;..." line per stack, the address still to be
+// looked up in the program's debug info, which `compile --sample-report`
+// does. BASIC_SAMPLE_HZ sets the rate, 99 a second by default, 0 turns it off.
+void CodeGen::sampleRuntime()
+{
+    std::string table;
+    std::size_t offset = 0;
+    for (const SampleSites &m : sites)
+    {
+        emitter.globals += "enum { basic_site_" + m.scope + " = " + std::to_string(offset) + " };\n";
+        for (const std::string &name : m.names)
+            table += "  \"" + escape(name) + "\",\n";
+        offset += m.names.size();
+    }
+    if (table.empty())
+        table = "  \"\",\n";
+    emitter.globals += "static const char *const basic_site_names[] = {\n" + table + "};\n";
+    emitter.globals += "static void basic_sample_dump(void) {\n"
+                       "  struct itimerval off;\n"
+                       "  memset(&off, 0, sizeof(off));\n"
+                       "  setitimer(ITIMER_PROF, &off, NULL);\n"
+                       "  const char *path = getenv(\"BASIC_SAMPLES\");\n"
+                       "  if (!path) path = \"" + escape(samplePath) + "\";\n"
+                       "  FILE *out = fopen(path, \"w\");\n"
+                       "  if (!out) {\n"
+                       "    fprintf(stderr, \"cannot write samples %s\\n\", path);\n"
+                       "    return;\n"
+                       "  }\n"
+                       "  char exe[4096];\n"
+                       "  ssize_t n = readlink(\"/proc/self/exe\", exe, sizeof(exe) - 1);\n"
+                       "  exe[n < 0 ? 0 : n] = 0;\n"
+                       "  unsigned long bias = 0;\n"
+                       "  dl_iterate_phdr(basic_sample_bias, &bias);\n"
+                       "  fprintf(out, \"basic-samples 1 %lx %s\\n\", bias, exe);\n"
+                       "  for (int s = 0; s < BASIC_SAMPLE_SLOTS; s++) {\n"
+                       "    if (basic_samples[s].count == 0) continue;\n"
+                       "    fprintf(out, \"%llu %lx main\", basic_samples[s].count, basic_samples[s].pc);\n"
+                       "    for (int k = 0; k < basic_samples[s].depth; k++)\n"
+                       "      fprintf(out, \";%s\", basic_site_names[basic_samples[s].frames[k]]);\n"
+                       "    fputc('\\n', out);\n"
+                       "  }\n"
+                       "  if (basic_samples_lost) fprintf(out, \"%llu 0 main\\n\", basic_samples_lost);\n"
+                       "  fclose(out);\n"
+                       "}\n"
+                       "static void basic_sample_start(void) {\n"
+                       "  const char *env = getenv(\"BASIC_SAMPLE_HZ\");\n"
+                       "  long hz = env ? atol(env) : 99;\n"
+                       "  if (hz < 1) return;\n"
+                       "  long us = 1000000 / (hz > 10000 ? 10000 : hz);\n"
+                       "  struct sigaction act;\n"
+                       "  memset(&act, 0, sizeof(act));\n"
+                       "  act.sa_sigaction = basic_sample_tick;\n"
+                       "  act.sa_flags = SA_SIGINFO | SA_RESTART;\n"
+                       "  sigemptyset(&act.sa_mask);\n"
+                       "  sigaction(SIGPROF, &act, NULL);\n"
+                       "  atexit(basic_sample_dump);\n"
+                       "  struct itimerval every;\n"
+                       "  every.it_interval.tv_sec = us / 1000000;\n"
+                       "  every.it_interval.tv_usec = us % 1000000;\n"
+                       "  every.it_value = every.it_interval;\n"
+                       "  setitimer(ITIMER_PROF, &every, NULL);\n"
+                       "}\n";
+    emitter.sampled = true;
+}
+
+// numbers a frame of the function being written, as c
+std::string CodeGen::site(const std::string &name)
+{
+    marks.names.push_back(name);
+    return "basic_site_" + marks.scope + " + " + std::to_string(marks.names.size() - 1);
+}
+
+// the #line telling the compiler, and through its debug info the profiler,
+// which source line the c after it comes from
+std::string CodeGen::lineMark(std::uint32_t line) const
+{
+    return line == 0 ? "" : "#line " + std::to_string(line) + " \"" + escape(file) + "\"";
+}
+
+// sets up a generator for a function of its own, with this one's settings
+void CodeGen::configure(CodeGen &gen, const std::string &scope) const
+{
+    gen.lowering = true;
+    gen.file = file;
+    gen.instrument = instrument;
+    gen.profile = profile;
+    gen.map.scope = scope;
+    gen.sample = sample;
+    gen.marks.scope = scope;
+}
+
+// starts a new block at s, counting it in an instrumented program
+void CodeGen::enter(const Stmt &s)
+{
+    std::string counter = "basic_prof_" + map.scope + "[" + std::to_string(map.blocks.size()) + "]";
+    map.blocks.push_back(Site{file, s.line});
+    leader = false;
+    if (!instrument)
+        return;
+    if (shared)
+        emitter.AddLine("  __atomic_fetch_add(&" + counter + ", 1, __ATOMIC_RELAXED);");
+    else
+        emitter.AddLine("  " + counter + "++;");
+}
+
+// how often the profile says a block of this function ran, false if unknown
+bool CodeGen::hits(std::uint32_t block, std::uint64_t &n) const
+{
+    return profile != nullptr && profile->count(map.scope, block, n);
+}
+
+// 1 if a branch taken yes times and not taken no times is clearly likely,
+// 0 if clearly unlikely, -1 if neither or there are too few runs to tell
+int CodeGen::bias(std::uint64_t yes, std::uint64_t no) const
+{
+    if (yes + no < HINT_RUNS)
+        return -1;
+    if (yes >= HINT_RATIO * no)
+        return 1;
+    if (no >= HINT_RATIO * yes)
+        return 0;
+    return -1;
+}
+
+// a pragma unrolling a hot loop by about its usual trip count, empty if the
+// loop is not hot or runs too few times per entry to gain from it
+std::string CodeGen::unroll(std::uint64_t entries, std::uint64_t iterations) const
+{
+    if (profile == nullptr || entries == 0 || iterations * 100 < profile->total)
+        return "";
+    std::uint64_t trip = iterations / entries;
+    int factor = trip >= 64 ? 8 : trip >= 16 ? 4 : trip >= 4 ? 2 : 0;
+    return factor ? "#pragma GCC unroll " + std::to_string(factor) : "";
+}
+
+// declares a variable the first time it is assigned
+void CodeGen::declare(std::uint32_t id)
+{
+    if (!emitter.Declared(id))
+    {
+        emitter.Declare(id, Type::INT);
+        emitter.AddLine("  int " + names.name(id) + ";");
+        declarations++;
+    }
+    else if (emitter.symbols[id].type == Type::ARRAY)
+    {
+        std::cerr << "array needs an index: " << names.name(id) << "\n";
+        std::exit(1);
+    }
+}
+
+// elements of an array, exits if id is not one
+std::uint32_t CodeGen::arraySize(std::uint32_t id) const
+{
+    if (!emitter.Declared(id))
+    {
+        std::cerr << "array used before its dim: " << names.name(id) << "\n";
+        std::exit(1);
+    }
+    if (emitter.symbols[id].type != Type::ARRAY)
+    {
+        std::cerr << "not an array: " << names.name(id) << "\n";
+        std::exit(1);
+    }
+    return emitter.symbols[id].size;
+}
+
+// whether an index needs no check: a loop proved it, or it is a constant
+// inside the array
+bool CodeGen::inRange(int index, std::uint32_t size, const std::vector<Expr> &nodes) const
+{
+    const Expr &e = nodes[index];
+    if (e.kind == Tokens::INTEGER)
+        return e.text.size() <= 9 && std::stoul(e.text) < size;
+    return proven.count(index) > 0;
+}
+
+// an element as c, checked unless the index is known to be in range
+std::string CodeGen::element(std::uint32_t id, int index, const std::vector<Expr> &nodes)
+{
+    std::uint32_t size = arraySize(id);
+    if (inRange(index, size, nodes))
+        return names.name(id) + "[" + render(index, nodes) + "]";
+    emitter.checked = true;
+    return names.name(id) + "[basic_index(" + std::to_string(size) + ", " + render(index, nodes) + ")]";
+}
+
+// every statement in list and below, in order
+template <typename Fn>
+static void eachStatement(const std::vector<Stmt> &list, Fn fn)
+{
+    for (const Stmt &s : list)
+    {
+        fn(s);
+        eachStatement(s.body, fn);
+    }
+}
+
+// finds the indices of a counting loop that cannot leave their array
+//     let i = <lo>;
+//     while i < <hi> repeat ... let i = i + <step>; ... endwhile
+// i only grows, so each statement ahead of the increment sees lo <= i < hi,
+// and i, i + c and i - c index safely if that range fits the array. a label
+// in the body could be reached with any i, so there may be none. returns
+// the indices it added to proven.
+std::vector<int> CodeGen::prove(const Stmt &loop, const std::vector<Expr> &nodes)
+{
+    const Expr &cond = nodes[loop.expr];
+    if (cond.kind != Tokens::COMP || (cond.text != "<" && cond.text != "<="))
+        return {};
+    const Expr &var = nodes[cond.lhs];
+    const Expr &limit = nodes[cond.rhs];
+    if (var.kind != Tokens::IDENT || limit.kind != Tokens::INTEGER || limit.text.size() > 9 ||
+        !start.known || start.id != var.id)
+        return {};
+    long lo = start.value;
+    long hi = std::stol(limit.text) - (cond.text == "<" ? 1 : 0);
+
+    auto constant = [&](int n, long &value)
+    {
+        if (nodes[n].kind != Tokens::INTEGER || nodes[n].text.size() > 9)
+            return false;
+        value = std::stol(nodes[n].text);
+        return true;
+    };
+    auto isvar = [&](int n) { return nodes[n].kind == Tokens::IDENT && nodes[n].id == var.id; };
+    auto assigns = [&](const Stmt &s)
+    {
+        return s.kind == Tokens::LABEL || (s.kind == Tokens::FOR && s.id == var.id) ||
+               ((s.kind == Tokens::LET || s.kind == Tokens::INPUT) && s.index < 0 && s.id == var.id);
+    };
+
+    // the increment is the one top level `let i = i + c` with c > 0, nothing
+    // else may touch i
+    std::size_t step = loop.body.size();
+    for (std::size_t k = 0; k < loop.body.size(); k++)
+    {
+        const Stmt &s = loop.body[k];
+        long c = 0;
+        if (step == loop.body.size() && s.kind == Tokens::LET && s.index < 0 && s.id == var.id &&
+            nodes[s.expr].kind == Tokens::PLUS && isvar(nodes[s.expr].lhs) &&
+            constant(nodes[s.expr].rhs, c) && c > 0)
+        {
+            step = k;
+            continue;
+        }
+        bool touched = assigns(s);
+        eachStatement(s.body, [&](const Stmt &inner) { touched = touched || assigns(inner); });
+        if (touched)
+            return {};
+    }
+
+    return proveRange(loop.body, step, var.id, lo, hi, nodes);
+}
+
+// adds to proven every index in the first count statements of body (and
+// below) that is var, var + c or var - c and stays inside its array while
+// lo <= var <= hi, returns the ones it added
+std::vector<int> CodeGen::proveRange(const std::vector<Stmt> &body, std::size_t count, std::uint32_t var,
+                                     long lo, long hi, const std::vector<Expr> &nodes)
+{
+    std::vector<int> added;
+    auto constant = [&](int n, long &value)
+    {
+        if (nodes[n].kind != Tokens::INTEGER || nodes[n].text.size() > 9)
+            return false;
+        value = std::stol(nodes[n].text);
+        return true;
+    };
+    auto isvar = [&](int n) { return nodes[n].kind == Tokens::IDENT && nodes[n].id == var; };
+
+    // offset of an index from i, if it is i, i + c or i - c
+    auto offset = [&](int n, long &off)
+    {
+        const Expr &e = nodes[n];
+        if (isvar(n))
+        {
+            off = 0;
+            return true;
+        }
+        if (e.kind == Tokens::PLUS && isvar(e.lhs) && constant(e.rhs, off))
+            return true;
+        if (e.kind == Tokens::PLUS && isvar(e.rhs) && constant(e.lhs, off))
+            return true;
+        if (e.kind == Tokens::MINUS && e.rhs >= 0 && isvar(e.lhs) && constant(e.rhs, off))
+        {
+            off = -off;
+            return true;
+        }
+        return false;
+    };
+    auto check = [&](std::uint32_t array, int index)
+    {
+        long off = 0;
+        if (!emitter.Declared(array) || emitter.symbols[array].type != Type::ARRAY || !offset(index, off))
+            return;
+        if (lo + off >= 0 && hi + off < long(emitter.symbols[array].size) && !proven.count(index))
+        {
+            proven.insert(index);
+            added.push_back(index);
+        }
+    };
+    std::vector<int> work;
+    auto roots = [&](const Stmt &s)
+    {
+        if (s.index >= 0)
+            check(s.id, s.index);
+        for (int root : {s.expr, s.index})
+        {
+            if (root >= 0)
+                work.push_back(root);
+        }
+    };
+    for (std::size_t k = 0; k < count; k++)
+    {
+        roots(body[k]);
+        eachStatement(body[k].body, roots);
+    }
+    while (!work.empty())
+    {
+        int n = work.back();
+        work.pop_back();
+        if (nodes[n].kind == Tokens::LBRACKET)
+            check(nodes[n].id, nodes[n].lhs);
+        if (nodes[n].lhs >= 0)
+            work.push_back(nodes[n].lhs);
+        if (nodes[n].rhs >= 0)
+            work.push_back(nodes[n].rhs);
+    }
+    return added;
+}
+
+void CodeGen::statement(const Stmt &s, const std::vector<Expr> &nodes)
+{
+    // a statement runs in the current block, or starts one if it follows a
+    // jump or a block statement. a label starts one after it, as a goto lands
+    // there. an include's statements and a sub are placed on their own.
+    bool placed = s.kind != Tokens::INCLUDE && s.kind != Tokens::SUB;
+    if (s.kind == Tokens::LABEL)
+        emitter.AddLine(names.name(s.id) + ": ;");
+    if (placed && (leader || s.kind == Tokens::LABEL))
+        enter(s);
+    if (placed)
+        map.statements.emplace_back(Site{file, s.line}, map.blocks.size() - 1);
+    if (placed && sample)
+        emitter.line = lineMark(s.line);
+
+    switch (s.kind)
+    {
+    // print a string as is or an integer with a format specifier
+    case Tokens::PRINT:
+        if (s.expr < 0)
+            emitter.AddLine("  printf(\"" + escape(s.text) + "\\n\");");
+        else
+            emitter.AddLine("  printf(\"%d\\n\", " + render(s.expr, nodes) + ");");
+        break;
+    // declares and assigns the variable
+    case Tokens::LET:
+        if (s.index >= 0)
+        {
+            emitter.AddLine("  " + element(s.id, s.index, nodes) + " = " + render(s.expr, nodes) + ";");
+            break;
+        }
+        declare(s.id);
+        emitter.AddLine("  " + names.name(s.id) + " = " + render(s.expr, nodes) + ";");
+        break;
+    // scans for input from the user, an element through a pointer so the
+    // index is worked out once
+    case Tokens::INPUT:
+    {
+        if (s.index >= 0)
+        {
+            emitter.AddLine("  {");
+            emitter.AddLine("  int *__basic_in = &" + element(s.id, s.index, nodes) + ";");
+            emitter.AddLine("  if (scanf(\"%d\", __basic_in) != 1) *__basic_in = 0;");
+            emitter.AddLine("  }");
+            break;
+        }
+        declare(s.id);
+        const std::string &var = names.name(s.id);
+        emitter.AddLine("  if (scanf(\"%d\", &" + var + ") != 1) " + var + " = 0;");
+        break;
+    }
+    // written above. a goto may come from deeper loops, which it left
+    case Tokens::LABEL:
+        if (sample && framed)
+            emitter.AddLine("  basic_where.depth = basic_base + " + std::to_string(nesting) + ";");
+        break;
+    case Tokens::GOTO:
+        emitter.AddLine("  goto " + names.name(s.id) + ";");
+        break;
+    // the call is patched in once every routine is known
+    case Tokens::CALL:
+        emitter.AddLine("  " + placeholder(nodes[s.expr], nodes, true) + ";");
+        break;
+    case Tokens::RETURN:
+        // a sub's frame goes once the value is worked out
+        if (sample && lowering && framed)
+        {
+            emitter.AddLine("  {");
+            emitter.AddLine("  int __basic_ret = " + (s.expr < 0 ? std::string("0") : render(s.expr, nodes)) + ";");
+            emitter.AddLine("  basic_where.depth = basic_base - 1;");
+            emitter.AddLine("  return __basic_ret;");
+            emitter.AddLine("  }");
+            break;
+        }
+        emitter.AddLine(s.expr < 0 ? "  return 0;" : "  return " + render(s.expr, nodes) + ";");
+        break;
+    // static, so a large array is not on the stack and starts zeroed.
+    // aligned to a cache line, which is also wide enough for any vector unit.
+    case Tokens::DIM:
+    {
+        if (emitter.Declared(s.id))
+        {
+            std::cerr << "dim of a name already in use: " << names.name(s.id) << "\n";
+            std::exit(1);
+        }
+        std::uint32_t size = s.text.size() > 9 ? 0 : std::stoul(s.text);
+        if (size == 0)
+        {
+            std::cerr << "array size must be from 1 to 999999999: " << names.name(s.id) << "\n";
+            std::exit(1);
+        }
+        emitter.Declare(s.id, Type::ARRAY);
+        emitter.symbols[s.id].size = size;
+        declarations++;
+        emitter.AddLine("  static _Alignas(64) int " + names.name(s.id) + "[" + std::to_string(size) + "];");
+        break;
+    }
+    // set aside with its own copy of the nodes it uses, lowered at the end
+    case Tokens::SUB:
+        if (lowering)
+        {
+            std::cerr << "sub must be at top level: " << names.name(s.id) << "\n";
+            std::exit(1);
+        }
+        routines.push_back(extract(s, nodes));
+        break;
+    // an included file's statements go in where the include was
+    case Tokens::INCLUDE:
+    {
+        std::string outer = file;
+        if (!s.body.empty())
+            file = s.text;
+        for (const Stmt &inner : s.body)
+            statement(inner, nodes);
+        file = outer;
+        break;
+    }
+    case Tokens::IF:
+    case Tokens::WHILE:
+        conditional(s, nodes);
+        break;
+    case Tokens::FOR:
+        forLoop(s, nodes);
+        break;
+    default:
+        break;
+    }
+    if (s.kind == Tokens::GOTO || s.kind == Tokens::RETURN || s.kind == Tokens::IF || s.kind == Tokens::WHILE ||
+        s.kind == Tokens::FOR)
+        leader = true;
+
+    // a constant assigned here is where a loop right after starts
+    start.known = s.kind == Tokens::LET && s.index < 0 && nodes[s.expr].kind == Tokens::INTEGER &&
+                  nodes[s.expr].text.size() <= 9;
+    if (start.known)
+    {
+        start.id = s.id;
+        start.value = std::stol(nodes[s.expr].text);
+    }
+}
+
+// constructs if and while statements with necessary parens
+// with a profile, a branch that nearly always goes one way gets a hint, a
+// hot while loop is unrolled by its usual trip count and the body of an if
+// that is hardly ever taken moves after the function's return, so the code
+// that does run stays together
+void CodeGen::conditional(const Stmt &s, const std::vector<Expr> &nodes)
+{
+    bool isif = s.kind == Tokens::IF;
+    std::string cond = render(s.expr, nodes);
+
+    // runs of the block holding the header, and of the body's first block
+    std::uint64_t outside = 0, inside = 0;
+    bool known = !s.body.empty() && hits(map.blocks.size() - 1, outside) && hits(map.blocks.size(), inside) &&
+                 (!isif || inside <= outside);
+    // an if is taken `inside` times of `outside`, a while goes round `inside`
+    // times and leaves `outside` times
+    int likely = known ? bias(inside, isif ? outside - inside : outside) : -1;
+    if (likely >= 0)
+        cond = "(__builtin_expect(!!" + cond + ", " + std::to_string(likely) + "))";
+    // a loop is a frame while it runs
+    if (sample && !isif)
+        emitter.AddLine("  basic_sample_push(basic_base + " + std::to_string(nesting) + ", " +
+                        site("while " + file + ":" + std::to_string(s.line)) + ");");
+    std::string pragma = known && !isif ? unroll(outside, inside) : "";
+    if (!pragma.empty())
+        emitter.AddLine(pragma);
+
+    std::vector<int> safe;
+    if (!isif)
+        safe = prove(s, nodes);
+    start.known = false;
+    leader = true;
+    bool moving = isif && likely == 0;
+    std::string outer;
+    std::size_t declared = declarations;
+    if (moving)
+        outer.swap(emitter.code);
+    else
+        emitter.AddLine((isif ? "  if " : "  while ") + cond + " {");
+    nesting += isif ? 0 : 1;
+    for (const Stmt &inner : s.body)
+        statement(inner, nodes);
+    nesting -= isif ? 0 : 1;
+    // going round again is the loop's line
+    if (sample)
+        emitter.line = lineMark(s.line);
+    // node numbers are reused by later statements
+    for (int index : safe)
+        proven.erase(index);
+    if (!moving)
+    {
+        emitter.AddLine("  }");
+        if (sample && !isif)
+            emitter.AddLine("  basic_where.depth = basic_base + " + std::to_string(nesting) + ";");
+        return;
+    }
+
+    // a body that declares something stays, later code may use it
+    std::string body;
+    body.swap(emitter.code);
+    emitter.code.swap(outer);
+    if (declarations != declared)
+    {
+        emitter.AddLine("  if " + cond + " {");
+        emitter.Add(body);
+        emitter.AddLine("  }");
+        return;
+    }
+    std::string n = std::to_string(colds++);
+    emitter.AddLine("  if " + cond + " goto basic_cold" + n + ";");
+    emitter.AddLine("basic_back" + n + ": ;");
+    cold += "basic_cold" + n + ": ;\n" + body + "  goto basic_back" + n + ";\n";
+}
+
+// writes the tree out as fully parenthesized c, using an explicit work stack
+// so neither deep nor long expressions recurse
+std::string CodeGen::render(int root, const std::vector<Expr> &nodes)
+{
+    std::string out;
+    // each item is either a node to expand or a piece of text to copy
+    struct Work
+    {
+        int node;
+        std::string_view text;
+    };
+    std::vector<Work> work{{root, {}}};
+    while (!work.empty())
+    {
+        Work w = work.back();
+        work.pop_back();
+        if (w.node < 0)
+        {
+            out += w.text;
+            continue;
+        }
+        const Expr &e = nodes[w.node];
+        if (e.kind == Tokens::INTEGER)
+            out += e.text;
+        else if (e.kind == Tokens::IDENT)
+        {
+            if (e.id < binding.size() && binding[e.id] >= 0)
+                out += ARG_OPEN + std::to_string(binding[e.id]) + ARG_CLOSE;
+            else if (emitter.Declared(e.id) && emitter.symbols[e.id].type == Type::ARRAY)
+            {
+                std::cerr << "array needs an index: " << names.name(e.id) << "\n";
+                std::exit(1);
+            }
+            else
+                out += names.name(e.id);
+        }
+        else if (e.kind == Tokens::LBRACKET)
+        {
+            std::uint32_t size = arraySize(e.id);
+            bool safe = inRange(e.lhs, size, nodes);
+            work.push_back({-1, safe ? "]" : ")]"});
+            work.push_back({e.lhs, {}});
+            out += names.name(e.id);
+            if (safe)
+                out += '[';
+            else
+            {
+                out += "[basic_index(" + std::to_string(size) + ", ";
+                emitter.checked = true;
+            }
+        }
+        else if (e.kind == Tokens::CALL)
+            out += placeholder(e, nodes, false);
+        else if (e.rhs < 0)
+        {
+            // prefix: (op operand)
+            work.push_back({-1, ")"});
+            work.push_back({e.lhs, {}});
+            work.push_back({-1, e.text});
+            out += '(';
+        }
+        else
+        {
+            // infix: (lhs op rhs)
+            work.push_back({-1, ")"});
+            work.push_back({e.rhs, {}});
+            work.push_back({-1, " "});
+            work.push_back({-1, e.text});
+            work.push_back({-1, " "});
+            work.push_back({e.lhs, {}});
+            out += '(';
+        }
+    }
+    return out;
+}
+
+// scans every character of string in case there is a backslash or quote so that valid syntax is added
+std::string CodeGen::escape(const std::string &s)
+{
+    std::string out;
+    out.reserve(s.size());
+    for (char ch : s)
+    {
+        // control characters (newlines included) as octal escapes
+        unsigned char u = ch;
+        if (u < 0x20 || u == 0x7f)
+        {
+            const char digits[] = {'\\', char('0' + (u >> 6)), char('0' + ((u >> 3) & 7)), char('0' + (u & 7))};
+            out.append(digits, sizeof(digits));
+            continue;
+        }
+        if (ch == '\\' || ch == '"')
+            out.push_back('\\');
+        out.push_back(ch);
+    }
+    return out;
+}
+
+// records a call site and returns the placeholder standing in for it
+std::string CodeGen::placeholder(const Expr &call, const std::vector<Expr> &nodes, bool statement)
+{
+    PendingCall p{call.id, {}, true, statement};
+    for (int arg = call.lhs; arg >= 0; arg = nodes[arg].rhs)
+    {
+        p.args.push_back(render(nodes[arg].lhs, nodes));
+        if (p.args.back().find(CALL_OPEN) != std::string::npos)
+            p.pure = false;
+    }
+    calls.push_back(std::move(p));
+    return CALL_OPEN + std::to_string(calls.size() - 1) + CALL_CLOSE;
+}
+
+// copies a sub together with just the nodes it uses, renumbered from 0.
+// argument chains point forward, so nodes are gathered first and then kept
+// in their original order.
+Routine CodeGen::extract(const Stmt &s, const std::vector<Expr> &nodes)
+{
+    std::vector<int> keep;
+    std::vector<const Stmt *> stmts{&s};
+    std::vector<int> work;
+    while (!stmts.empty())
+    {
+        const Stmt *at = stmts.back();
+        stmts.pop_back();
+        if (at->expr >= 0)
+            work.push_back(at->expr);
+        if (at->index >= 0)
+            work.push_back(at->index);
+        for (const Stmt &inner : at->body)
+            stmts.push_back(&inner);
+    }
+    while (!work.empty())
+    {
+        int n = work.back();
+        work.pop_back();
+        keep.push_back(n);
+        if (nodes[n].lhs >= 0)
+            work.push_back(nodes[n].lhs);
+        if (nodes[n].rhs >= 0)
+            work.push_back(nodes[n].rhs);
+    }
+    std::sort(keep.begin(), keep.end());
+    auto renumber = [&](int n)
+    {
+        return n < 0 ? n : int(std::lower_bound(keep.begin(), keep.end(), n) - keep.begin());
+    };
+
+    Routine r;
+    r.def = s;
+    r.file = file;
+    for (int n : keep)
+    {
+        Expr e = nodes[n];
+        e.lhs = renumber(e.lhs);
+        e.rhs = renumber(e.rhs);
+        r.nodes.push_back(std::move(e));
+    }
+    std::vector<Stmt *> fix{&r.def};
+    while (!fix.empty())
+    {
+        Stmt *at = fix.back();
+        fix.pop_back();
+        at->expr = renumber(at->expr);
+        at->index = renumber(at->index);
+        for (Stmt &inner : at->body)
+            fix.push_back(&inner);
+    }
+    return r;
+}
+
+// c declaration of a routine
+std::string CodeGen::signature(const Routine &r) const
+{
+    std::string sig = "int sub_" + names.name(r.def.id) + "(";
+    for (std::size_t k = 0; k < r.def.params.size(); k++)
+        sig += (k ? ", int " : "int ") + names.name(r.def.params[k]);
+    if (r.def.params.empty())
+        sig += "void";
+    return sig + ")";
+}
+
+// statements in a tree, and whether any of them rules out inlining as a block
+static int countStatements(const std::vector<Stmt> &list, bool &blocked)
+{
+    int count = 0;
+    for (const Stmt &s : list)
+    {
+        // labels would be defined twice, and a nested return would leave the caller
+        // and a static array would be one per call site
+        if (s.kind == Tokens::LABEL || s.kind == Tokens::GOTO || s.kind == Tokens::RETURN ||
+            s.kind == Tokens::SUB || s.kind == Tokens::DIM)
+            blocked = true;
+        count += 1 + countStatements(s.body, blocked);
+    }
+    return count;
+}
+
+// writes a routine as its own c function on a private emitter, and works out
+// whether and how its calls may be inlined
+void CodeGen::lower(Routine &r)
+{
+    Emitter own;
+    CodeGen gen(own, names);
+    configure(gen, "sub_" + names.name(r.def.id));
+    gen.file = r.file;
+    for (std::uint32_t param : r.def.params)
+        own.Declare(param, Type::INT);
+    // a sub is a frame over the statement that called it, unless it has no
+    // loop and calls nothing, when the lines it runs say where it is well
+    // enough and it is too short to pay for one
+    gen.framed = false;
+    eachStatement(r.def.body, [&](const Stmt &inner)
+                  { gen.framed = gen.framed || inner.kind == Tokens::WHILE || inner.kind == Tokens::FOR; });
+    for (const Expr &e : r.nodes)
+        gen.framed = gen.framed || e.kind == Tokens::CALL;
+    if (sample && gen.framed)
+    {
+        r.prologue = "  int basic_base = basic_sample_enter(" + gen.site("sub " + names.name(r.def.id)) + ");\n";
+        r.epilogue = "  basic_where.depth = basic_base - 1;\n";
+    }
+
+    const std::vector<Stmt> &body = r.def.body;
+    bool tailreturn = !body.empty() && body.back().kind == Tokens::RETURN;
+    std::size_t plain = body.size() - (tailreturn ? 1 : 0);
+    for (std::size_t k = 0; k < plain; k++)
+        gen.statement(body[k], r.nodes);
+    std::string inner = own.code;
+    if (tailreturn)
+        gen.statement(body.back(), r.nodes);
+    else
+        own.AddLine(r.epilogue + "  return 0;");
+    // parallel loop bodies first, they are functions of their own
+    std::string line = sample ? gen.lineMark(r.def.line) + "\n" : "";
+    r.code = own.functions + line + signature(r) + " {\n" + r.prologue + own.code + gen.cold + "}\n";
+    r.calls = std::move(gen.calls);
+    r.checked = own.checked;
+    r.parallel = own.parallel;
+    r.blocks.push_back(gen.map);
+    r.blocks.insert(r.blocks.end(), gen.blocks.begin(), gen.blocks.end());
+    if (sample)
+    {
+        r.sites.push_back(gen.marks);
+        r.sites.insert(r.sites.end(), gen.sites.begin(), gen.sites.end());
+    }
+    if (!r.calls.empty())
+        return;
+
+    // a leaf routine with a short straight body becomes a block at call
+    // statements. a final return's value is dropped there, and calls nothing.
+    // a profile lifts the limit for a hot routine and drops one that never ran.
+    int limit = INLINE_STATEMENTS;
+    std::uint64_t runs = 0;
+    if (!gen.map.blocks.empty() && gen.hits(0, runs))
+        limit = runs == 0 ? -1 : runs * 100 >= profile->total ? HOT_INLINE_STATEMENTS : INLINE_STATEMENTS;
+    bool blocked = !gen.cold.empty();
+    std::vector<Stmt> front(body.begin(), body.begin() + plain);
+    if (countStatements(front, blocked) <= limit && !blocked)
+        r.block = inner;
+
+    // `return <expr>;` over the parameters alone is substituted into the
+    // caller, except when counting, where the call is what gets counted
+    if (!instrument && plain == 0 && tailreturn && body.back().expr >= 0 && r.nodes.size() <= INLINE_NODES)
+    {
+        std::uint32_t top = 0;
+        for (std::uint32_t param : r.def.params)
+            top = std::max(top, param + 1);
+        gen.binding.assign(top, -1);
+        for (std::size_t k = 0; k < r.def.params.size(); k++)
+            gen.binding[r.def.params[k]] = k;
+        bool onlyparams = true;
+        for (const Expr &e : r.nodes)
+        {
+            if (e.kind == Tokens::LBRACKET || (e.kind == Tokens::IDENT && (e.id >= top || gen.binding[e.id] < 0)))
+                onlyparams = false;
+        }
+        if (onlyparams)
+            r.shape = gen.render(body.back().expr, r.nodes);
+    }
+}
+
+// c for a for loop. the bounds are worked out once, first then last, and the
+// variable is left one past last like the loop had counted it up there
+void CodeGen::forLoop(const Stmt &s, const std::vector<Expr> &nodes)
+{
+    const std::string &var = names.name(s.id);
+    bool labelled = false;
+    eachStatement(s.body, [&](const Stmt &inner)
+                  {
+                      if (inner.id == s.id && (inner.kind == Tokens::FOR ||
+                                               ((inner.kind == Tokens::LET || inner.kind == Tokens::INPUT) && inner.index < 0)))
+                      {
+                          std::cerr << "for loop variable assigned in its body: " << var << "\n";
+                          std::exit(1);
+                      }
+                      labelled = labelled || inner.kind == Tokens::LABEL;
+                  });
+    if (s.parallel)
+    {
+        parallelFor(s, nodes);
+        return;
+    }
+
+    declare(s.id);
+    if (sample)
+        emitter.AddLine("  basic_sample_push(basic_base + " + std::to_string(nesting) + ", " +
+                        site("for " + file + ":" + std::to_string(s.line)) + ");");
+    const Expr &bounds = nodes[s.expr];
+    emitter.AddLine("  " + var + " = " + render(bounds.lhs, nodes) + ";");
+    emitter.AddLine("  {");
+    emitter.AddLine("  int __basic_last = " + render(bounds.rhs, nodes) + ";");
+    std::uint64_t entries = 0, iterations = 0;
+    if (!s.body.empty() && hits(map.blocks.size() - 1, entries) && hits(map.blocks.size(), iterations))
+    {
+        std::string pragma = unroll(entries, iterations);
+        if (!pragma.empty())
+            emitter.AddLine(pragma);
+    }
+    emitter.AddLine("  for (; " + var + " <= __basic_last; " + var + "++) {");
+    // constant bounds are the range of the variable, unless a label lets
+    // control in from elsewhere
+    std::vector<int> safe;
+    const Expr &first = nodes[bounds.lhs];
+    const Expr &last = nodes[bounds.rhs];
+    if (!labelled && first.kind == Tokens::INTEGER && last.kind == Tokens::INTEGER && first.text.size() <= 9 &&
+        last.text.size() <= 9)
+        safe = proveRange(s.body, s.body.size(), s.id, std::stol(first.text), std::stol(last.text), nodes);
+    start.known = false;
+    leader = true;
+    nesting++;
+    for (const Stmt &inner : s.body)
+        statement(inner, nodes);
+    nesting--;
+    if (sample)
+        emitter.line = lineMark(s.line);
+    for (int index : safe)
+        proven.erase(index);
+    emitter.AddLine("  }");
+    emitter.AddLine("  }");
+    if (sample)
+        emitter.AddLine("  basic_where.depth = basic_base + " + std::to_string(nesting) + ";");
+}
+
+// finds a variable the statements read before assigning it in the same
+// iteration, one that is written somewhere in the loop. defined holds the
+// variables already assigned on every path to here.
+static bool carried(const std::vector<Stmt> &list, const std::vector<Expr> &nodes,
+                    const std::unordered_set<std::uint32_t> &written, std::unordered_set<std::uint32_t> &defined,
+                    std::uint32_t &id)
+{
+    for (const Stmt &s : list)
+    {
+        std::vector<int> work;
+        for (int root : {s.expr, s.index})
+        {
+            if (root >= 0)
+                work.push_back(root);
+        }
+        while (!work.empty())
+        {
+            const Expr &e = nodes[work.back()];
+            work.pop_back();
+            if (e.kind == Tokens::IDENT && written.count(e.id) && !defined.count(e.id))
+            {
+                id = e.id;
+                return true;
+            }
+            if (e.lhs >= 0)
+                work.push_back(e.lhs);
+            if (e.rhs >= 0)
+                work.push_back(e.rhs);
+        }
+        if ((s.kind == Tokens::LET || s.kind == Tokens::INPUT) && s.index < 0)
+            defined.insert(s.id);
+        else if (s.kind == Tokens::INCLUDE)
+        {
+            // same level, what it assigns counts afterwards
+            if (carried(s.body, nodes, written, defined, id))
+                return true;
+        }
+        else if (hasBlock(s.kind))
+        {
+            std::unordered_set<std::uint32_t> inner = defined;
+            if (s.kind == Tokens::FOR)
+                inner.insert(s.id);
+            if (carried(s.body, nodes, written, inner, id))
+                return true;
+            if (s.kind == Tokens::FOR)
+                defined.insert(s.id);
+        }
+    }
+    return false;
+}
+
+// a reduction variable read anywhere in the tree at n, if there is one
+static bool readsReduction(int n, const std::vector<Expr> &nodes,
+                           const std::unordered_map<std::uint32_t, std::string> &reduced, std::uint32_t &id)
+{
+    std::vector<int> work{n};
+    while (!work.empty())
+    {
+        const Expr &e = nodes[work.back()];
+        work.pop_back();
+        if (e.kind == Tokens::IDENT && reduced.count(e.id))
+        {
+            id = e.id;
+            return true;
+        }
+        if (e.lhs >= 0)
+            work.push_back(e.lhs);
+        if (e.rhs >= 0)
+            work.push_back(e.rhs);
+    }
+    return false;
+}
+
+// whether the trees at a and b are the same expression
+static bool sameExpr(int a, int b, const std::vector<Expr> &nodes)
+{
+    if (a < 0 || b < 0)
+        return a == b;
+    const Expr &x = nodes[a];
+    const Expr &y = nodes[b];
+    return x.kind == y.kind && x.text == y.text && x.id == y.id && sameExpr(x.lhs, y.lhs, nodes) &&
+           sameExpr(x.rhs, y.rhs, nodes);
+}
+
+// finds a reduction variable the statements use other than to update it in
+// the form of its reduction, with no reduction variable in e:
+//     sum(v)  let v = v + e;  or  let v = e + v;
+//     min(v)  if e < v then let v = e; endif  or  if v > e then ...
+//     max(v)  if e > v then let v = e; endif  or  if v < e then ...
+// (or <= and >=). anything else would see or leave a thread's partial, which
+// is not the variable's value at that iteration.
+static bool misusedReduction(const std::vector<Stmt> &list, const std::vector<Expr> &nodes,
+                             const std::unordered_map<std::uint32_t, std::string> &reduced, std::uint32_t &id)
+{
+    auto isvar = [&](int n, std::uint32_t v) { return nodes[n].kind == Tokens::IDENT && nodes[n].id == v; };
+    for (const Stmt &s : list)
+    {
+        std::uint32_t unused = 0;
+        if (s.kind == Tokens::LET && s.index < 0 && reduced.count(s.id) && reduced.at(s.id) == "sum")
+        {
+            const Expr &e = nodes[s.expr];
+            if (e.kind == Tokens::PLUS && e.rhs >= 0 &&
+                ((isvar(e.lhs, s.id) && !readsReduction(e.rhs, nodes, reduced, unused)) ||
+                 (isvar(e.rhs, s.id) && !readsReduction(e.lhs, nodes, reduced, unused))))
+                continue;
+        }
+        if (s.kind == Tokens::IF && s.body.size() == 1 && s.body[0].kind == Tokens::LET && s.body[0].index < 0 &&
+            reduced.count(s.body[0].id) && reduced.at(s.body[0].id) != "sum")
+        {
+            const Stmt &let = s.body[0];
+            const Expr &cond = nodes[s.expr];
+            // which way round v belongs for the candidate to win
+            bool below = cond.text == "<" || cond.text == "<=";
+            bool above = cond.text == ">" || cond.text == ">=";
+            bool min = reduced.at(let.id) == "min";
+            int other = -1;
+            if ((below && min) || (above && !min))
+                other = isvar(cond.rhs, let.id) ? cond.lhs : -1;
+            else if (below || above)
+                other = isvar(cond.lhs, let.id) ? cond.rhs : -1;
+            if (other >= 0 && sameExpr(other, let.expr, nodes) && !readsReduction(let.expr, nodes, reduced, unused))
+                continue;
+        }
+
+        for (int root : {s.expr, s.index})
+        {
+            if (root >= 0 && readsReduction(root, nodes, reduced, id))
+                return true;
+        }
+        if (((s.kind == Tokens::LET || s.kind == Tokens::INPUT) && s.index < 0 && reduced.count(s.id)) ||
+            (s.kind == Tokens::FOR && reduced.count(s.id)))
+        {
+            id = s.id;
+            return true;
+        }
+        if (misusedReduction(s.body, nodes, reduced, id))
+            return true;
+    }
+    return false;
+}
+
+// exits with why a parallel loop cannot run in parallel
+[[noreturn]] static void rejectParallel(const std::string &var, const std::string &why)
+{
+    std::cerr << "parallel loop over " << var << ": " << why << "\n";
+    std::exit(1);
+}
+
+// a parallel for becomes a function over a range of iterations, handed to
+// the worker pool in chunks. scalars it only reads are copied in, arrays are
+// shared, scalars it assigns are private to each iteration and reductions
+// are private to each thread and combined at the end. the loop is rejected
+// if one iteration could see what another did.
+void CodeGen::parallelFor(const Stmt &s, const std::vector<Expr> &nodes)
+{
+    const std::string &var = names.name(s.id);
+
+    std::vector<std::pair<std::string, std::uint32_t>> reductions;
+    std::unordered_map<std::uint32_t, std::string> reduced;
+    for (std::size_t k = 0; k + 1 < s.params.size(); k += 2)
+    {
+        const std::string &op = names.name(s.params[k]);
+        std::uint32_t id = s.params[k + 1];
+        if (op != "sum" && op != "min" && op != "max")
+            rejectParallel(var, "unknown reduction " + op + ", expected sum, min or max");
+        if (id == s.id)
+            rejectParallel(var, "the loop variable cannot be a reduction");
+        if (!reduced.emplace(id, op).second)
+            rejectParallel(var, names.name(id) + " is reduced twice");
+        if (!emitter.Declared(id) || emitter.symbols[id].type != Type::INT)
+            rejectParallel(var, names.name(id) + " must be a variable assigned before the loop");
+        reductions.emplace_back(op, id);
+    }
+
+    // what the body does, and whether it may run out of order
+    std::unordered_set<std::uint32_t> written, changed, reads, used;
+    std::vector<std::pair<std::uint32_t, int>> accesses; // array, index
+    std::vector<int> work;
+    eachStatement(s.body, [&](const Stmt &inner)
+                  {
+                      switch (inner.kind)
+                      {
+                      case Tokens::PRINT:
+                      case Tokens::INPUT:
+                          rejectParallel(var, "print and input would happen in no particular order");
+                      case Tokens::LABEL:
+                      case Tokens::GOTO:
+                          rejectParallel(var, "labels and goto cannot cross between threads");
+                      case Tokens::CALL:
+                      case Tokens::RETURN:
+                          rejectParallel(var, "subs cannot be called or returned from inside it");
+                      case Tokens::DIM:
+                          rejectParallel(var, "an array dimmed inside it would be shared by every thread");
+                      case Tokens::FOR:
+                          if (inner.parallel)
+                              rejectParallel(var, "parallel loops do not nest");
+                          written.insert(inner.id);
+                          break;
+                      case Tokens::LET:
+                          if (inner.index >= 0)
+                          {
+                              changed.insert(inner.id);
+                              accesses.emplace_back(inner.id, inner.index);
+                          }
+                          else if (!reduced.count(inner.id))
+                              written.insert(inner.id);
+                          break;
+                      default:
+                          break;
+                      }
+                      for (int root : {inner.expr, inner.index})
+                      {
+                          if (root >= 0)
+                              work.push_back(root);
+                      }
+                  });
+    while (!work.empty())
+    {
+        const Expr &e = nodes[work.back()];
+        work.pop_back();
+        if (e.kind == Tokens::CALL)
+            rejectParallel(var, "subs cannot be called or returned from inside it");
+        if (e.kind == Tokens::IDENT)
+            reads.insert(e.id);
+        if (e.kind == Tokens::LBRACKET)
+            accesses.emplace_back(e.id, e.lhs);
+        if (e.lhs >= 0)
+            work.push_back(e.lhs);
+        if (e.rhs >= 0)
+            work.push_back(e.rhs);
+    }
+    std::uint32_t id = 0;
+    if (misusedReduction(s.body, nodes, reduced, id))
+    {
+        const std::string &v = names.name(id);
+        std::string form = reduced[id] == "sum" ? "let " + v + " = " + v + " + e;"
+                                                : "if e " + std::string(reduced[id] == "min" ? "<" : ">") + " " + v +
+                                                      " then let " + v + " = e; endif";
+        rejectParallel(var, v + " is a " + reduced[id] + " reduction, so the loop may only update it as " + form +
+                                " with no reduction in e");
+    }
+    std::unordered_set<std::uint32_t> defined;
+    if (carried(s.body, nodes, written, defined, id))
+        rejectParallel(var, names.name(id) + " is read before it is assigned, so it carries over from another iteration");
+    for (auto &[array, index] : accesses)
+    {
+        arraySize(array);
+        used.insert(array);
+        if (changed.count(array) && !(nodes[index].kind == Tokens::IDENT && nodes[index].id == s.id))
+            rejectParallel(var, names.name(array) + " is assigned, so every use of it must be indexed by " + var + " alone");
+    }
+
+    // stable order for the output
+    auto sorted = [](const std::unordered_set<std::uint32_t> &set)
+    {
+        std::vector<std::uint32_t> out(set.begin(), set.end());
+        std::sort(out.begin(), out.end());
+        return out;
+    };
+    std::vector<std::uint32_t> arrays = sorted(used), privates = sorted(written), captured;
+    for (std::uint32_t read : sorted(reads))
+    {
+        if (read != s.id && !written.count(read) && !reduced.count(read) && emitter.Declared(read) &&
+            emitter.symbols[read].type == Type::INT)
+            captured.push_back(read);
+    }
+
+    // the body, on a private emitter that knows what the function declares
+    std::string fn = "basic_" + map.scope + "_loop" + std::to_string(loops++);
+    Emitter own;
+    CodeGen gen(own, names);
+    configure(gen, fn);
+    gen.shared = true;
+    own.Declare(s.id, Type::INT);
+    for (std::uint32_t v : captured)
+        own.Declare(v, Type::INT);
+    for (std::uint32_t v : privates)
+        own.Declare(v, Type::INT);
+    for (auto &r : reductions)
+        own.Declare(r.second, Type::INT);
+    for (std::uint32_t a : arrays)
+    {
+        own.Declare(a, Type::ARRAY);
+        own.symbols[a].size = emitter.symbols[a].size;
+    }
+    const Expr &bounds = nodes[s.expr];
+    const Expr &first = nodes[bounds.lhs];
+    const Expr &last = nodes[bounds.rhs];
+    if (first.kind == Tokens::INTEGER && last.kind == Tokens::INTEGER && first.text.size() <= 9 &&
+        last.text.size() <= 9)
+        gen.proveRange(s.body, s.body.size(), s.id, std::stol(first.text), std::stol(last.text), nodes);
+    // a chunk is a frame over whatever the thread is running, the loop's
+    // caller on the calling thread and nothing on a worker
+    std::string entry = sample ? gen.site("parallel for " + file + ":" + std::to_string(s.line)) : "";
+    for (const Stmt &inner : s.body)
+        gen.statement(inner, nodes);
+    emitter.checked = emitter.checked || own.checked;
+    blocks.push_back(gen.map);
+    if (sample)
+        sites.push_back(gen.marks);
+
+    std::string def = sample ? lineMark(s.line) + "\n" : "";
+    def += "struct " + fn + " {\n";
+    for (std::uint32_t a : arrays)
+        def += "  int *" + names.name(a) + ";\n";
+    for (std::uint32_t v : captured)
+        def += "  int " + names.name(v) + ";\n";
+    if (!reductions.empty())
+    {
+        // each thread's partials on their own cache line
+        def += "  struct {\n";
+        for (std::size_t k = 0; k < reductions.size(); k++)
+            def += (k == 0 ? "    _Alignas(64) int " : "    int ") + names.name(reductions[k].second) + ";\n";
+        def += "  } red[BASIC_MAX_THREADS];\n";
+    }
+    def += "};\n";
+    def += "static void " + fn + "(void *arg, int first, int last, int slot) {\n";
+    def += "  struct " + fn + " *ctx = arg;\n";
+    if (reductions.empty())
+        def += "  (void)slot;\n";
+    for (std::uint32_t a : arrays)
+        def += "  int *restrict " + names.name(a) + " = ctx->" + names.name(a) + ";\n";
+    for (std::uint32_t v : captured)
+        def += "  int " + names.name(v) + " = ctx->" + names.name(v) + ";\n";
+    for (auto &r : reductions)
+        def += "  int " + names.name(r.second) + " = ctx->red[slot]." + names.name(r.second) + ";\n";
+    if (sample)
+    {
+        def += "  int basic_saved = basic_where.depth;\n";
+        def += "  int basic_base = basic_sample_enter(" + entry + ");\n";
+        def += "  (void)basic_base;\n";
+    }
+    def += "  for (int " + var + " = first; " + var + " <= last; " + var + "++) {\n";
+    for (std::uint32_t v : privates)
+        def += "  int " + names.name(v) + ";\n";
+    def += own.code;
+    if (sample)
+        def += lineMark(s.line) + "\n";
+    def += "  }\n";
+    for (auto &r : reductions)
+        def += "  ctx->red[slot]." + names.name(r.second) + " = " + names.name(r.second) + ";\n";
+    if (sample)
+        def += "  basic_where.depth = basic_saved;\n";
+    if (!gen.cold.empty())
+        def += "  return;\n" + gen.cold;
+    def += "}\n";
+    emitter.functions += def;
+    emitter.parallel = true;
+
+    // the call, with the partials starting at the identity of their operator
+    declare(s.id);
+    emitter.AddLine("  {");
+    emitter.AddLine("  int __basic_first = " + render(bounds.lhs, nodes) + ";");
+    emitter.AddLine("  int __basic_last = " + render(bounds.rhs, nodes) + ";");
+    emitter.AddLine("  struct " + fn + " __basic_ctx;");
+    for (std::uint32_t a : arrays)
+        emitter.AddLine("  __basic_ctx." + names.name(a) + " = " + names.name(a) + ";");
+    for (std::uint32_t v : captured)
+        emitter.AddLine("  __basic_ctx." + names.name(v) + " = " + names.name(v) + ";");
+    if (!reductions.empty())
+    {
+        emitter.AddLine("  for (int __basic_k = 0; __basic_k < BASIC_MAX_THREADS; __basic_k++) {");
+        for (auto &r : reductions)
+            emitter.AddLine("  __basic_ctx.red[__basic_k]." + names.name(r.second) + " = " +
+                            (r.first == "sum" ? "0" : r.first == "min" ? "INT_MAX" : "INT_MIN") + ";");
+        emitter.AddLine("  }");
+    }
+    emitter.AddLine("  basic_parallel(__basic_first, __basic_last, " + fn + ", &__basic_ctx);");
+    if (!reductions.empty())
+    {
+        emitter.AddLine("  for (int __basic_k = 0; __basic_k < BASIC_MAX_THREADS; __basic_k++) {");
+        for (auto &r : reductions)
+        {
+            std::string v = names.name(r.second);
+            std::string part = "__basic_ctx.red[__basic_k]." + v;
+            if (r.first == "sum")
+                emitter.AddLine("  " + v + " = " + v + " + " + part + ";");
+            else
+                emitter.AddLine("  if (" + part + (r.first == "min" ? " < " : " > ") + v + ") " + v + " = " + part + ";");
+        }
+        emitter.AddLine("  }");
+    }
+    emitter.AddLine("  " + var + " = __basic_first <= __basic_last ? __basic_last + 1 : __basic_first;");
+    emitter.AddLine("  }");
+}
+
+// replaces every placeholder in code with its linked call
+std::string CodeGen::link(const std::string &code, const std::vector<PendingCall> &pending,
+                          const std::vector<int> &byid) const
+{
+    if (pending.empty())
+        return code;
+    std::string out;
+    out.reserve(code.size());
+    std::size_t i = 0;
+    while (true)
+    {
+        std::size_t open = code.find(CALL_OPEN, i);
+        if (open == std::string::npos)
+            break;
+        std::size_t close = code.find(CALL_CLOSE, open);
+        out.append(code, i, open - i);
+        out += resolve(pending[std::atoi(code.c_str() + open + 1)], pending, byid);
+        i = close + 1;
+    }
+    out.append(code, i, std::string::npos);
+    return out;
+}
+
+// the code for one call: the routine's expression with the arguments
+// substituted, its body as a block, or a plain c call
+std::string CodeGen::resolve(const PendingCall &call, const std::vector<PendingCall> &pending,
+                             const std::vector<int> &byid) const
+{
+    const std::string &name = names.name(call.routine);
+    int k = call.routine < byid.size() ? byid[call.routine] : -1;
+    if (k < 0)
+    {
+        std::cerr << "call to undefined sub: " << name << "\n";
+        std::exit(1);
+    }
+    const Routine &r = routines[k];
+    if (call.args.size() != r.def.params.size())
+    {
+        std::cerr << "sub " << name << " takes " << r.def.params.size() << " arguments but got "
+                  << call.args.size() << "\n";
+        std::exit(1);
+    }
+    std::vector<std::string> args;
+    for (const std::string &arg : call.args)
+        args.push_back(link(arg, pending, byid));
+
+    if (!call.statement && call.pure && !r.shape.empty())
+    {
+        std::string out;
+        for (std::size_t i = 0; i < r.shape.size(); i++)
+        {
+            if (r.shape[i] != ARG_OPEN)
+            {
+                out += r.shape[i];
+                continue;
+            }
+            std::size_t close = r.shape.find(ARG_CLOSE, i);
+            out += "(" + args[std::atoi(r.shape.c_str() + i + 1)] + ")";
+            i = close;
+        }
+        return out;
+    }
+    if (call.statement && !r.block.empty())
+    {
+        // arguments are evaluated before any parameter can shadow a name they use
+        std::string out = "{\n";
+        for (std::size_t a = 0; a < args.size(); a++)
+            out += "  int __basic_arg" + std::to_string(a) + " = " + args[a] + ";\n";
+        for (std::size_t a = 0; a < args.size(); a++)
+            out += "  int " + names.name(r.def.params[a]) + " = __basic_arg" + std::to_string(a) + ";\n";
+        return out + r.prologue + r.block + r.epilogue + "  }";
+    }
+    std::string out = "sub_" + name + "(";
+    for (std::size_t a = 0; a < args.size(); a++)
+        out += (a ? ", " : "") + args[a];
+    return out + ")";
+}
@@ -0,0 +1,202 @@
+#pragma once
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "profile.hpp"
+#include <cstdint>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// types a variable can have, NONE means not declared yet
+enum class Type : std::uint8_t
+{
+    NONE,
+    INT,
+    ARRAY
+};
+
+// one entry of the symbol table
+struct Symbol
+{
+    Type type = Type::NONE;
+    std::uint32_t size = 0; // elements of an array
+};
+
+// create struct for emitter to keep track of headers and vars
+struct Emitter
+{
+    std::vector<std::string> headers;
+    // indexed directly by interned identifier id
+    std::vector<Symbol> symbols;
+    // file scope variables, then prototypes and bodies of the routines, then main
+    std::string globals;
+    std::string prototypes;
+    std::string functions;
+    std::string code;
+    // some array access is bounds checked, so the checking helper is needed
+    bool checked = false;
+    // a parallel loop needs the worker pool
+    bool parallel = false;
+    // basic blocks are counted and the counts written out at exit
+    bool counted = false;
+    // when sampling, the #line every line added is marked with
+    std::string line;
+    // the program samples where it is and writes the stacks out at exit
+    bool sampled = false;
+
+    // symbol table helpers
+    bool Declared(std::uint32_t id) const;
+    void Declare(std::uint32_t id, Type type);
+
+    // helper functions that add lines and write to file
+    void Add(const std::string &s);
+    void AddLine(const std::string &s);
+    void AddHeader(const std::string &h);
+    std::string ToString();
+    void WriteToFile(const std::string &filename);
+};
+
+// the frames a sampling build names in its stacks for one c function:
+// "while file:line", "for file:line", "parallel for file:line" or
+// "sub NAME". the code refers to them by scope and number, the numbers over
+// every scope are only known once the whole program has been written.
+struct SampleSites
+{
+    std::string scope;
+    std::vector<std::string> names;
+};
+
+// a call site written before every routine is known. the code holds a
+// placeholder for it that link() swaps for the call or an inlined copy.
+struct PendingCall
+{
+    std::uint32_t routine;
+    std::vector<std::string> args; // rendered argument values
+    bool pure;                     // no argument calls anything, so one may be copied
+    bool statement;                // the value is dropped
+};
+
+// a sub, kept until the end of the program so every call can see it
+struct Routine
+{
+    Stmt def;
+    std::vector<Expr> nodes; // just def's expression nodes
+    std::string file;        // where it was defined
+
+    // filled in by lowering
+    std::string code;               // the c function
+    std::vector<PendingCall> calls; // placeholders in code
+    // a routine that is only `return <expr>;` over its parameters, as the
+    // expression with placeholders for the arguments; empty if not one
+    std::string shape;
+    // for a small routine that calls nothing, its body as a c block that
+    // expects the parameters declared in front of it; empty if not one
+    std::string block;
+    bool checked = false;  // the function checks an array index
+    bool parallel = false; // and runs a loop on the worker pool
+    std::vector<BlockMap> blocks; // of the function and its parallel loops
+    std::vector<SampleSites> sites; // likewise, when sampling
+    // when sampling, what goes around an inlined block so it is a frame of
+    // its own, as the function is
+    std::string prologue;
+    std::string epilogue;
+};
+
+// walks the parse tree and writes c through an emitter
+// statements of main are written as they arrive. subs are set aside and, at
+// end(), lowered to their own c functions on worker threads, after which
+// every call site is linked: small routines are inlined, the rest called.
+// statements are grouped into basic blocks, which an instrumented program
+// counts and a profile of such a run steers: branch hints, cold ifs moved
+// out of the way, unrolling of hot loops and which routines get inlined.
+// a sampling build instead ties the c of each statement to its line with
+// #line, and keeps a shadow stack of loops and subs for a timer signal to
+// record along with where it stopped the program.
+struct CodeGen
+{
+    Emitter &emitter;
+    const Interner &names;
+    unsigned threads = 1; // workers for lowering routines
+
+    std::string file;                 // the source the statements come from
+    std::uint64_t source = 0;         // its content hash, recorded with the counts
+    bool instrument = false;          // count every block
+    std::string profilePath;          // where an instrumented program writes its counts
+    const Profile *profile = nullptr; // counts of an instrumented run, if any
+    std::vector<BlockMap> blocks;     // every function's blocks, main's first, complete after end()
+    bool sample = false;              // mark statements for the sampling profiler
+    std::string samplePath;           // where a sampling program writes its stacks
+    std::vector<SampleSites> sites;   // every function's sites, main's first, complete after end()
+
+    std::vector<PendingCall> calls; // placeholders in emitter.code
+    std::vector<Routine> routines;
+
+    CodeGen(Emitter &e, const Interner &n) : emitter(e), names(n) {}
+
+    // header and the opening of main
+    void begin();
+    // one top level statement, with the nodes its expressions index into
+    void statement(const Stmt &s, const std::vector<Expr> &nodes);
+    // closing of main, then the routines
+    void end();
+
+    // writes an expression tree out as fully parenthesized c
+    std::string render(int root, const std::vector<Expr> &nodes);
+
+    // scans every character of string in case there is a backslash or quote so that valid syntax is added
+    static std::string escape(const std::string &s);
+
+private:
+    bool lowering = false;         // emitting a routine body rather than main
+    BlockMap map{"main", {}, {}};  // blocks of the function being written, its scope names its parallel loops
+    SampleSites marks{"main", {}}; // sites of the function being written
+    int nesting = 0;               // loops around the statement being written, within the function
+    bool framed = true;            // the function keeps a frame on the shadow stack, when sampling
+    int loops = 0;                 // parallel loops so far
+    bool leader = true;            // the next statement starts a block
+    bool shared = false;           // counters are bumped from several threads
+    std::string cold;              // rarely taken if bodies, placed after the function's return
+    int colds = 0;                 // cold bodies so far
+    std::size_t declarations = 0;  // variables and arrays declared so far
+    std::vector<int> binding;   // while shaping, parameter index of each id or -1
+
+    // index expressions a loop proves in range, written without a check
+    std::unordered_set<int> proven;
+    // the variable the previous statement of the block set to a constant
+    // (if known), which is where a loop over it starts
+    struct
+    {
+        bool known = false;
+        std::uint32_t id = 0;
+        long value = 0;
+    } start;
+
+    void configure(CodeGen &gen, const std::string &scope) const;
+    void enter(const Stmt &s);
+    bool hits(std::uint32_t block, std::uint64_t &n) const;
+    int bias(std::uint64_t yes, std::uint64_t no) const;
+    std::string unroll(std::uint64_t entries, std::uint64_t iterations) const;
+    void conditional(const Stmt &s, const std::vector<Expr> &nodes);
+    void profileRuntime();
+    std::string site(const std::string &name);
+    std::string lineMark(std::uint32_t line) const;
+    void sampleRuntime();
+    void finishRoutines();
+    void declare(std::uint32_t id);
+    std::uint32_t arraySize(std::uint32_t id) const;
+    bool inRange(int index, std::uint32_t size, const std::vector<Expr> &nodes) const;
+    std::string element(std::uint32_t id, int index, const std::vector<Expr> &nodes);
+    std::vector<int> prove(const Stmt &loop, const std::vector<Expr> &nodes);
+    std::vector<int> proveRange(const std::vector<Stmt> &body, std::size_t count, std::uint32_t var, long lo,
+                                long hi, const std::vector<Expr> &nodes);
+    void forLoop(const Stmt &s, const std::vector<Expr> &nodes);
+    void parallelFor(const Stmt &s, const std::vector<Expr> &nodes);
+    std::string placeholder(const Expr &call, const std::vector<Expr> &nodes, bool statement);
+    Routine extract(const Stmt &s, const std::vector<Expr> &nodes);
+    std::string signature(const Routine &r) const;
+    void lower(Routine &r);
+    std::string link(const std::string &code, const std::vector<PendingCall> &pending,
+                     const std::vector<int> &byid) const;
+    std::string resolve(const PendingCall &call, const std::vector<PendingCall> &pending,
+                        const std::vector<int> &byid) const;
+};
@@ -1,392 +1,661 @@
 #include "lexer.hpp"
+#include "parser.hpp"
+#include "codegen.hpp"
+#include "timing.hpp"
+#include "pipeline.hpp"
+#include "incremental.hpp"
+#include "modules.hpp"
+#include "profile.hpp"
+#include "vm.hpp"
+#include "runner.hpp"
+#include "session.hpp"
 #include <string>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <vector>
-#include <unordered_map>
 #include <cstdlib>
 #include <filesystem>
-
-// g++ -std=c++2a ./cpp/compiler.cpp ./cpp/lexer.cpp -o compile
-// ./compile ./cpp/example.basic
+#include <algorithm>
+#include <thread>
+#include <cstdio>
+#include <chrono>
+#include <memory>
+
+// g++ -std=c++2a -pthread ./cpp/*.cpp -o compile
+// ./compile [--time-report] [--trace=out.json] [--lex-threads=N | --pipeline] [--cache=DIR] [--codegen-threads=N]
+//           [--profile-generate | --profile-use[=FILE] [--hot-lines[=N]] | --profile-sample] ./cpp/example.basic ...
+// ./compile --sample-report[=N] ./cpp/example.basic ...
+// ./compile --serve ./cpp/example.basic
+// ./compile --run [--run-threads=N] [--budget=N] [--memory=N] ./cpp/example.basic ...
+// ./compile --run --interactive [--run-threads=N] [--budget=N] [--memory=N] ./cpp/example.basic
 
 namespace fs = std::filesystem;
 
-// create struct for emitter to keep track of headers and vars
-struct Emitter
+// workers lowering the subs of a program, set once from the command line
+static unsigned codegen_threads = 1;
+
+// profile guided builds: count blocks, or read the counts back from a file
+// (the one next to each input if none is named) and report the hot lines
+static bool profile_generate = false;
+static bool profile_use = false;
+static std::string profile_file;
+static std::size_t hot_lines = 0;
+
+// sampling builds: the program records where it spends its time to a
+// .samples file next to the input, which the report turns into folded
+// stacks and ranks by line and loop
+static bool profile_sample = false;
+static std::size_t sample_report = 0;
+
+// parses and emits one top level statement at a time, dropping each
+// statement's tree once it is written so memory does not grow with the input.
+// includes are spliced in on the way, returns every file the program used.
+static std::vector<std::pair<std::string, std::uint64_t>> translate(Parser &parser, Emitter &emitter, Interner &names,
+                                                                    ModuleLoader &loader, const fs::path &input,
+                                                                    std::uint64_t hash, const Profile *profile)
 {
-    std::vector<std::string> headers;
-    std::unordered_map<std::string, std::string> symbols;
-    std::string code;
-
-    // helper functions that add lines and write to file
-    void Add(const std::string &s);
-    void AddLine(const std::string &s);
-    void AddHeader(const std::string &h);
-    std::string ToString();
-    void WriteToFile(const std::string &filename);
-};
+    IncludeExpander includes(loader, names);
+    includes.seen.insert(input.string());
+    includes.deps.emplace_back(input.string(), hash);
+    fs::path dir = input.parent_path();
+
+    CodeGen gen(emitter, names);
+    gen.threads = codegen_threads;
+    gen.file = input.string();
+    gen.source = hash;
+    gen.instrument = profile_generate;
+    gen.profilePath = fs::path(input).replace_extension(".profile").string();
+    gen.profile = profile;
+    gen.sample = profile_sample;
+    gen.samplePath = fs::path(input).replace_extension(".samples").string();
+    gen.begin();
+    Stmt s;
+    while (parser.next(s))
+    {
+        includes.expand(s, parser.nodes, dir);
+        gen.statement(s, parser.nodes);
+        parser.nodes.clear();
+    }
+    gen.end();
+    if (profile != nullptr && hot_lines > 0)
+        hotLines(gen.blocks, *profile, hot_lines, std::cout);
+    return includes.deps;
+}
 
-// simply adds to given string
-void Emitter::Add(const std::string &s)
+// parser side of the lexer -> parser pipeline
+// interns each batch's new names into the parser's own name table so the
+// parser never reads the interner the lexer thread is still writing. the two
+// tables drift apart once included files add names, so token ids are
+// translated on the way in.
+struct RingSource : TokenSource
 {
-    code += s;
-}
-// adds line to given string
-void Emitter::AddLine(const std::string &s)
+    SpscRing<TokenBatch> &ring;
+    Interner &names;
+    std::vector<std::uint32_t> ids; // lexer id -> parser id
+
+    RingSource(SpscRing<TokenBatch> &r, Interner &n) : ring(r), names(n) {}
+
+    bool refill(std::vector<Token> &tokens) override
+    {
+        TokenBatch b;
+        ring.pop(b);
+        for (const std::string &name : b.names)
+            ids.push_back(names.intern(name));
+        // an open string can only be at the very end, report it before the
+        // parser trips over the missing tokens
+        if (!b.ok)
+        {
+            std::cerr << "Must have closing quote\n";
+            std::exit(1);
+        }
+        for (Token &t : b.tokens)
+        {
+            if (t.type == Tokens::IDENT)
+                t.id = ids[t.id];
+        }
+        tokens.swap(b.tokens);
+        return !b.last;
+    }
+};
+
+// lexes on a second thread while this thread parses, handing tokens over in
+// batches through a bounded ring so memory stays flat however large the input
+static std::vector<std::pair<std::string, std::uint64_t>> pipelinedFrontend(const std::string &words, Interner &names,
+                                                                            Emitter &emitter, ModuleLoader &loader,
+                                                                            const fs::path &input, std::uint64_t hash,
+                                                                            const Profile *profile)
 {
-    code += s + "\n";
+    const std::size_t batch_tokens = 4096;
+    SpscRing<TokenBatch> ring(16);
+    Sample lex_begin, lex_end, parse_begin, parse_end;
+    double start = timeReport().start_us;
+
+    std::thread lexer([&]
+                      {
+                          Phase phase("lex");
+                          lex_begin = Sample::now(start);
+                          StreamLexer stream(words, names);
+                          bool more = true;
+                          while (more)
+                          {
+                              TokenBatch b;
+                              more = stream.next(b, batch_tokens);
+                              ring.push(std::move(b));
+                          }
+                          lex_end = Sample::now(start);
+                      });
+
+    // the parser's own name table, filled from the batches
+    Interner mirror;
+    RingSource source(ring, mirror);
+    std::vector<std::pair<std::string, std::uint64_t>> deps;
+    {
+        Phase phase("parse");
+        parse_begin = Sample::now(start);
+        Parser parser(source);
+        parser.text = &words;
+        deps = translate(parser, emitter, mirror, loader, input, hash, profile);
+        parse_end = Sample::now(start);
+    }
+    lexer.join();
+
+    // how much of the lexing ran while the parser was busy
+    if (timeReport().enabled)
+    {
+        double lex_ms = (lex_end.wall_us - lex_begin.wall_us) / 1e3;
+        double overlap = std::max(0.0, std::min(lex_end.wall_us, parse_end.wall_us) -
+                                           std::max(lex_begin.wall_us, parse_begin.wall_us)) / 1e3;
+        char note[200];
+        std::snprintf(note, sizeof(note),
+                      "pipeline: %.3f ms of %.3f ms lexing overlapped parsing (%.0f%%), "
+                      "lexer stalled %llu times, parser stalled %llu times",
+                      overlap, lex_ms, lex_ms > 0 ? 100 * overlap / lex_ms : 0.0,
+                      (unsigned long long)ring.producer_waits.load(),
+                      (unsigned long long)ring.consumer_waits.load());
+        timeReport().Note(note);
+    }
+    return deps;
 }
 
-// adds header to header vector
-void Emitter::AddHeader(const std::string &h)
+// prints the document's diagnostics and a status line for one request
+static void answer(const Document &doc, const char *file, double us)
 {
-    headers.push_back(h);
+    std::vector<Diagnostic> found = doc.diagnostics();
+    for (const Diagnostic &d : found)
+        std::cout << file << ":" << d.line << ":" << d.column << ": error: " << d.message << "\n";
+    char status[160];
+    std::snprintf(status, sizeof(status), "done %zu errors, %zu tokens relexed, %zu reparsed, %.1f us\n",
+                  found.size(), doc.relexed, doc.reparsed, us);
+    std::cout << status << std::flush;
 }
 
-// constructs final c code
-std::string Emitter::ToString()
+// editor mode: keeps the file lexed and parsed in memory and applies the edits
+// read from stdin, answering each with the diagnostics of the new text
+//   edit <begin> <end> <length>\n<length bytes replacing [begin, end)>
+//   quit
+static int serve(const char *file, std::string words)
 {
-    std::string final_string;
-    // starts with adding headers
-    for (size_t i = 0; i < headers.size(); i++)
-        final_string += headers[i] + "\n";
-    // follows with the code
-    final_string += code;
-    return final_string;
+    using clock = std::chrono::steady_clock;
+    Document doc;
+    auto start = clock::now();
+    doc.open(std::move(words));
+    answer(doc, file, std::chrono::duration<double, std::micro>(clock::now() - start).count());
+
+    std::string request;
+    while (std::cin >> request && request != "quit")
+    {
+        std::size_t begin, end, length;
+        if (request != "edit" || !(std::cin >> begin >> end >> length) || std::cin.get() != '\n')
+        {
+            std::cout << "error: bad request\n" << std::flush;
+            return 1;
+        }
+        std::string replacement(length, '\0');
+        std::cin.read(replacement.data(), length);
+        if (!std::cin || begin > end || end > doc.text.size())
+        {
+            std::cout << "error: bad edit\n" << std::flush;
+            return 1;
+        }
+        start = clock::now();
+        doc.edit(begin, end, replacement);
+        answer(doc, file, std::chrono::duration<double, std::micro>(clock::now() - start).count());
+    }
+    return 0;
 }
 
-// writes to file
-void Emitter::WriteToFile(const std::string &filename)
+// reads a whole source file, false if it cannot be opened
+static bool loadFile(const char *input_file, std::string &words)
 {
-    std::ofstream output(filename);
-    // check if file can be opened
-    if (!output.is_open())
+    Phase phase("load");
+    std::stringstream cont_stream;
+    std::fstream input(input_file, std::ios::in);
+    if (!input.is_open())
     {
-        std::cerr << "Failed to open output file: " << filename << "\n";
-        return;
+        std::cerr << "Failed to open file: " << input_file << "\n";
+        return false;
     }
-    output << ToString();
-    output.close();
+    cont_stream << input.rdbuf();
+    words = cont_stream.str();
+    return true;
 }
 
-struct Parser
+// parses a whole program for the runner with its includes spliced in,
+// false with a message if it has a syntax error
+static bool parseProgram(const char *file, const std::string &words, ModuleLoader &loader, Interner &names,
+                         std::vector<Stmt> &body, std::vector<Expr> &nodes, std::string &error)
 {
-    // create vector for token, checking track of current
-    const std::vector<Token> &tokens;
-    size_t current = 0;
-
-    // create instance of emmiter struct
-    Emitter &emitter;
-
-    Parser(const std::vector<Token> &t, Emitter &e) : tokens(t), emitter(e) {}
-
-    // checks if we reached the end
-    bool atend() const
+    std::vector<Token> tokens;
+    std::size_t i = 0;
+    if (!tokenizeRange(words, i, words.size(), names, tokens))
     {
-        return current >= tokens.size();
+        error = std::string(file) + ": Must have closing quote";
+        return false;
     }
-    // looks at current token
-    const Token &peektoken() const
+    Parser parser(tokens);
+    parser.recover = true;
+    parser.text = &words;
+    while (!parser.atend())
+        body.push_back(parser.statement());
+    if (const Stmt *bad = firstError(body))
     {
-        return tokens[current];
+        error = std::string(file) + ":" + std::to_string(bad->line) + ": " + bad->text;
+        return false;
     }
-    // advances to next token and returns previous
-    const Token &getnexttoken()
+
+    std::error_code ec;
+    fs::path canon = fs::weakly_canonical(file, ec);
+    IncludeExpander includes(loader, names);
+    includes.seen.insert(canon.string());
+    for (Stmt &s : body)
+        includes.expand(s, parser.nodes, canon.parent_path());
+    nodes = std::move(parser.nodes);
+    return true;
+}
+
+// how an instance ended, one line on stderr, false unless it exited
+static bool account(const char *file, const Instance &it)
+{
+    static const char *const stopped[] = {"ready", "waiting for input", "exit", "failed", "over budget",
+                                          "over memory"};
+    char line[200];
+    std::snprintf(line, sizeof(line), "%llu instructions, %llu slices, %.3f ms cpu", (unsigned long long)it.steps,
+                  (unsigned long long)it.slices, it.cpu_ns / 1e6);
+    std::cerr << file << ": " << stopped[int(it.status)];
+    if (it.status == Status::DONE)
+        std::cerr << " " << it.exitcode;
+    else
+        std::cerr << ": " << it.error;
+    std::cerr << ", " << line << "\n";
+    return it.status == Status::DONE;
+}
+
+// runs every input in this process instead of writing c, each as an
+// instance of its own on the work-stealing runner. a program's stdin is the
+// file.in next to it if there is one. outputs are printed in input order
+// once everything has stopped, with one accounting line per program on stderr.
+static int runAll(const std::vector<const char *> &files, ModuleLoader &loader, unsigned threads,
+                  const Limits &limits)
+{
+    std::vector<std::unique_ptr<Program>> programs(files.size());
+    std::vector<std::unique_ptr<Instance>> instances(files.size());
+    std::vector<std::string> problems(files.size());
+    std::vector<Instance *> runnable;
     {
-        if (!atend())
+        Phase phase("parse");
+        for (std::size_t k = 0; k < files.size(); k++)
         {
-            current++;
+            std::string words;
+            if (!loadFile(files[k], words))
+            {
+                problems[k] = std::string(files[k]) + ": cannot be read";
+                continue;
+            }
+            Interner names;
+            std::vector<Stmt> body;
+            std::vector<Expr> nodes;
+            std::string error;
+            programs[k] = std::make_unique<Program>();
+            if (!parseProgram(files[k], words, loader, names, body, nodes, error) ||
+                !programs[k]->compile(body, nodes, names, error))
+            {
+                problems[k] = error.rfind(files[k], 0) == 0 ? error : std::string(files[k]) + ": " + error;
+                continue;
+            }
+            std::string input;
+            std::ifstream in(fs::path(files[k]).replace_extension(".in"), std::ios::in | std::ios::binary);
+            if (in.is_open())
+            {
+                std::stringstream text;
+                text << in.rdbuf();
+                input = text.str();
+            }
+            instances[k] = std::make_unique<Instance>(*programs[k], limits, std::move(input));
+            runnable.push_back(instances[k].get());
         }
-        return tokens[current - 1];
     }
 
-    // returns the last token
-    const Token &last() const
+    Runner runner;
+    runner.threads = threads;
+    runner.run(runnable);
+
+    int result = 0;
+    for (std::size_t k = 0; k < files.size(); k++)
     {
-        return tokens[current - 1];
+        if (files.size() > 1)
+            std::cout << "==> " << files[k] << " <==\n";
+        const Instance *it = instances[k].get();
+        if (it == nullptr)
+        {
+            std::cerr << problems[k] << "\n";
+            result = 1;
+            continue;
+        }
+        std::cout << it->output;
+        if (!account(files[k], *it))
+            result = 1;
     }
+    std::cout << std::flush;
+    timeReport().Note("runner: " + std::to_string(runnable.size()) + " instances on " + std::to_string(threads) +
+                      " threads, " + std::to_string(runner.slices) + " slices, " + std::to_string(runner.steals) +
+                      " stolen");
+    return result;
+}
 
-    // boolean to check the type of a given token
-    bool checktype(Tokens type) const
+// runs one program in this process as a session that talks to the terminal:
+// whenever it wants a number that stdin has not given yet it is suspended,
+// what it printed so far is shown and the next line of stdin resumes it
+static int interact(const char *file, ModuleLoader &loader, unsigned threads, const Limits &limits)
+{
+    std::string words;
+    if (!loadFile(file, words))
+        return 1;
+    Interner names;
+    std::vector<Stmt> body;
+    std::vector<Expr> nodes;
+    std::string error;
+    Program program;
+    if (!parseProgram(file, words, loader, names, body, nodes, error) || !program.compile(body, nodes, names, error))
     {
-        return (!atend() && tokens[current].type == type);
+        std::cerr << (error.rfind(file, 0) == 0 ? error : std::string(file) + ": " + error) << "\n";
+        return 1;
     }
 
-    // takes in a token and checks it against an expected token type, advancing past if equal
-    void expect(Tokens type, const std::string &expected)
+    Executor pool(threads);
+    Instance it(program, limits, "");
+    it.open = true;
+    while (true)
     {
-        if (checktype(type))
-        {
-            getnexttoken();
-            return;
-        }
-        if (atend())
-            std::cerr << "parser expects: " << expected << " but got EOF\n";
+        std::cout << wait(resume(it, pool)) << std::flush;
+        if (it.status != Status::WAITING)
+            break;
+        std::string line;
+        if (std::getline(std::cin, line))
+            it.feed(line + "\n");
         else
-            std::cerr << "parser expects: " << expected
-                      << " but got " << tokenTypeToString(peektoken().type) << "\n";
-        std::exit(1);
+            it.close();
     }
+    timeReport().Note("sessions: " + std::to_string(pool.resumed) + " slices on " + std::to_string(threads) +
+                      " threads");
+    return account(file, it) ? 0 : 1;
+}
 
-    // helper to check for semicolon
-    void semicolon()
+// compiles one input of the batch to the .c file next to it
+// with a cache directory, an input whose output was built from exactly the
+// files (and contents) still on disk is skipped
+static int compileFile(const char *input_file, unsigned lex_threads, bool pipeline, ModuleLoader &loader)
+{
+    fs::path inPath(input_file);
+    fs::path outPath = inPath;
+    outPath.replace_extension(".c");
+
+    // a profile is one more input the output depends on
+    fs::path profilePath;
+    if (profile_use)
     {
-        expect(Tokens::SEMICOLON, "semicolon");
+        profilePath = profile_file.empty() ? fs::path(inPath).replace_extension(".profile") : fs::path(profile_file);
     }
-
-    // handles comparisons
-    std::string comparison()
+    // whatever changes the output for the same inputs, so a build with other
+    // options is never taken for current
+    std::string options = profile_generate ? "--profile-generate" : profile_sample ? "--profile-sample" : "";
+    if (profile_use)
     {
-        // expression first on the left
-        std::string left = expression();
-        bool seen = false;
-        // construct based off both expressions and comparison operator
-        while (checktype(Tokens::COMP))
-        {
-            seen = true;
-            std::string op = peektoken().value.value();
-            getnexttoken();
-            left = "(" + left + " " + op + " " + expression() + ")";
-        }
-        // return error if comparison not found
-        if (!seen)
-        {
-            std::cerr << "parser expects: comparison expression\n";
-            std::exit(1);
-        }
-        return left;
+        std::error_code ec;
+        options = "--profile-use=" + fs::weakly_canonical(profilePath, ec).string();
     }
 
-    std::string expression()
+    fs::path manifestPath;
+    if (!loader.cachedir.empty())
     {
-        // start with a term
-        std::string left = term();
-        // construct based off both terms and unary comparison
-        while (checktype(Tokens::PLUS) || checktype(Tokens::MINUS))
+        manifestPath = DepManifest::pathFor(loader.cachedir, inPath);
+        DepManifest old;
+        if (old.read(manifestPath) && old.output == outPath.string() && old.options == options && hot_lines == 0 &&
+            old.current(loader))
         {
-            std::string op = peektoken().value.value();
-            getnexttoken();
-            left = "(" + left + " " + op + " " + term() + ")";
+            std::cout << "UpToDate: " << outPath << "\n";
+            return 0;
         }
-        return left;
     }
 
-    std::string term()
+    // open file
+    std::string words;
+    if (!loadFile(input_file, words))
+        return 1;
+    std::error_code ec;
+    fs::path canon = fs::weakly_canonical(inPath, ec);
+    std::uint64_t hash = contentHash(words);
+
+    Profile profile;
+    bool profiled = false;
+    if (profile_use)
     {
-        // start with unary
-        std::string left = unary();
-        // construct based off both unaries and comparison operator
-        while (checktype(Tokens::TIMES) || checktype(Tokens::DIVIDE))
+        if (!profile.read(profilePath.string()))
         {
-            std::string op = peektoken().value.value();
-            getnexttoken();
-            left = "(" + left + " " + op + " " + unary() + ")";
+            std::cerr << "Failed to read profile: " << profilePath.string() << "\n";
+            return 1;
         }
-        return left;
+        // counts of another version of the program would steer the wrong code
+        profiled = profile.source == hash;
+        if (!profiled)
+            std::cerr << "Profile " << profilePath.string() << " is of a different version of " << input_file
+                      << ", ignoring it\n";
     }
 
-    std::string unary()
+    // tokenizer words (lexer) and then parse
+    Interner names;
+    Emitter emitter;
+    DepManifest manifest;
+    manifest.options = options;
+    if (pipeline)
     {
-        // checks for operator
-        if (checktype(Tokens::PLUS) || checktype(Tokens::MINUS) || checktype(Tokens::NOT))
-        {
-            std::string op = peektoken().value.value_or("!");
-            getnexttoken();
-            return "(" + op + unary() + ")";
-        }
-        return primary();
+        manifest.deps = pipelinedFrontend(words, names, emitter, loader, canon, hash, profiled ? &profile : nullptr);
     }
-
-    std::string primary()
+    else
     {
-        // advance while there is an integer or identifier
-        if (checktype(Tokens::INTEGER) || checktype(Tokens::IDENT))
+        std::vector<Token> tokens;
         {
-            std::string v = peektoken().value.value();
-            getnexttoken();
-            return v;
+            Phase phase("lex");
+            tokens = lex_threads > 1 ? tokenizerParallel(words, names, lex_threads) : tokenizer(words, names);
         }
-        std::cerr << "parser expects: integer or identifier\n";
-        std::exit(1);
-    }
-
-    // scans every character of string in case there is a backslash or quote so that valid syntax is added
-    static std::string escape(const std::string &s)
-    {
-        std::string out;
-        out.reserve(s.size());
-        for (char ch : s)
         {
-            if (ch == '\\' || ch == '"')
-                out.push_back('\\');
-            out.push_back(ch);
+            Phase phase("parse");
+            Parser parser(tokens);
+            parser.text = &words;
+            manifest.deps = translate(parser, emitter, names, loader, canon, hash, profiled ? &profile : nullptr);
         }
-        return out;
     }
 
-    void parse()
+    // write to a file
+    if (!outPath.parent_path().empty())
     {
-        // begins with the header and main func that starts every file
-        emitter.AddHeader("#include <stdio.h>");
-        emitter.AddLine("int main(void) {");
+        fs::create_directories(outPath.parent_path());
+    }
 
-        // runs statement
-        while (!atend())
-            statement();
+    {
+        Phase phase("emit");
+        emitter.WriteToFile(outPath.string());
+    }
+    std::cout << "WroteToFile: " << outPath << "\n";
 
-        // concludes with every file ending which just returns 0
-        emitter.AddLine("  return 0;");
-        emitter.AddLine("}");
+    // remember what the output was built from
+    if (!manifestPath.empty())
+    {
+        if (profile_use)
+            manifest.deps.emplace_back(fs::weakly_canonical(profilePath, ec).string(), loader.hashOf(profilePath));
+        manifest.output = outPath.string();
+        if (!manifest.write(manifestPath))
+            std::cerr << "Failed to write dependency manifest: " << manifestPath << "\n";
     }
+    return 0;
+}
 
-    void statement()
+int main(int argc, char *argv[])
+{
+    // pull the options out first, leaving the input files
+    bool time_report = false;
+    std::string trace_file;
+    unsigned lex_threads = 1;
+    bool pipeline = false;
+    bool serving = false;
+    std::string cache_dir;
+    bool running = false;
+    bool interactive = false;
+    unsigned run_threads = 1;
+    Limits limits;
+    std::vector<const char *> input_files;
+    bool bad_usage = false;
+    for (int i = 1; i < argc; i++)
     {
-        // handles print branch
-        if (checktype(Tokens::PRINT))
-        {
-            getnexttoken();
-            // if there is a string, add proper syntax
-            if (checktype(Tokens::STRING))
-            {
-                std::string text = escape(peektoken().value.value());
-                emitter.AddLine("  printf(\"" + text + "\\n\");");
-                getnexttoken();
-            }
-            // else add format speicficer
-            else
-            {
-                std::string ex = expression();
-                emitter.AddLine("  printf(\"%d\\n\", " + ex + ");");
-            }
-            semicolon();
-        }
-        // handles let branch
-        else if (checktype(Tokens::LET))
-        {
-            getnexttoken();
-            // expects an indentifier and stores it as a variable
-            expect(Tokens::IDENT, "identifier after let");
-            std::string var = last().value.value();
-            // declares variable
-            if (!emitter.symbols.count(var))
-            {
-                emitter.symbols[var] = "int";
-                emitter.AddLine("  int " + var + ";");
-            }
-            expect(Tokens::ASSIGN, "=");
-            std::string ex = expression();
-            // assigns the variable
-            emitter.AddLine("  " + var + " = " + ex + ";");
-            semicolon();
-        }
-        // handles input branch
-        else if (checktype(Tokens::INPUT))
-        {
-            getnexttoken();
-            expect(Tokens::IDENT, "identifier after input");
-            std::string var = last().value.value();
-            if (emitter.symbols.find(var) == emitter.symbols.end())
-            {
-                emitter.symbols[var] = "int";
-                emitter.AddLine("  int " + var + ";");
-            }
-            // scans for input from the user
-            emitter.AddLine("  if (scanf(\"%d\", &" + var + ") != 1) " + var + " = 0;");
-            semicolon();
-        }
-        // handles label branch
-        else if (checktype(Tokens::LABEL))
+        std::string arg = argv[i];
+        if (arg == "--time-report")
+            time_report = true;
+        else if (arg.rfind("--trace=", 0) == 0)
+            trace_file = arg.substr(8);
+        else if (arg == "--pipeline")
+            pipeline = true;
+        else if (arg == "--serve")
+            serving = true;
+        else if (arg.rfind("--cache=", 0) == 0)
+            cache_dir = arg.substr(8);
+        else if (arg.rfind("--lex-threads=", 0) == 0)
         {
-            getnexttoken();
-            expect(Tokens::IDENT, "identifier after label");
-            std::string lab = last().value.value();
-            emitter.AddLine(lab + ": ;");
-            semicolon();
+            // 0 means one thread per core
+            lex_threads = std::atoi(arg.c_str() + 14);
+            if (lex_threads == 0)
+                lex_threads = std::max(1u, std::thread::hardware_concurrency());
         }
-        // handles goto branch
-        else if (checktype(Tokens::GOTO))
+        else if (arg.rfind("--codegen-threads=", 0) == 0)
         {
-            getnexttoken();
-            expect(Tokens::IDENT, "identifier after goto");
-            std::string lab = last().value.value();
-            emitter.AddLine("  goto " + lab + ";");
-            semicolon();
+            codegen_threads = std::atoi(arg.c_str() + 18);
+            if (codegen_threads == 0)
+                codegen_threads = std::max(1u, std::thread::hardware_concurrency());
         }
-        // constructs if statement with necessary parens
-        else if (checktype(Tokens::IF))
+        else if (arg == "--profile-generate")
+            profile_generate = true;
+        else if (arg == "--profile-use" || arg.rfind("--profile-use=", 0) == 0)
         {
-            getnexttoken();
-            std::string cond = comparison();
-            expect(Tokens::THEN, "then");
-            emitter.AddLine("  if " + cond + " {");
-            while (!checktype(Tokens::ENDIF) && !atend())
-                statement();
-            expect(Tokens::ENDIF, "endif");
-            emitter.AddLine("  }");
+            profile_use = true;
+            profile_file = arg.size() > 13 ? arg.substr(14) : "";
         }
-        // constructs while statement with necessary parens
-        else if (checktype(Tokens::WHILE))
+        else if (arg == "--hot-lines" || arg.rfind("--hot-lines=", 0) == 0)
+            hot_lines = arg.size() > 11 ? std::max(1, std::atoi(arg.c_str() + 12)) : 20;
+        else if (arg == "--profile-sample")
+            profile_sample = true;
+        else if (arg == "--sample-report" || arg.rfind("--sample-report=", 0) == 0)
+            sample_report = arg.size() > 15 ? std::max(1, std::atoi(arg.c_str() + 16)) : 20;
+        else if (arg == "--run")
+            running = true;
+        else if (arg == "--interactive")
+            interactive = true;
+        else if (arg.rfind("--run-threads=", 0) == 0)
         {
-            getnexttoken();
-            std::string cond = comparison();
-            expect(Tokens::REPEAT, "repeat");
-            emitter.AddLine("  while " + cond + " {");
-            while (!checktype(Tokens::ENDWHILE) && !atend())
-                statement();
-            expect(Tokens::ENDWHILE, "endwhile");
-            emitter.AddLine("  }");
+            run_threads = std::atoi(arg.c_str() + 14);
+            if (run_threads == 0)
+                run_threads = std::max(1u, std::thread::hardware_concurrency());
         }
-        // else return error and exit
+        else if (arg.rfind("--budget=", 0) == 0)
+            limits.budget = std::strtoull(arg.c_str() + 9, nullptr, 10);
+        else if (arg.rfind("--memory=", 0) == 0)
+            limits.memory = std::strtoull(arg.c_str() + 9, nullptr, 10);
+        else if (arg.rfind("--", 0) != 0)
+            input_files.push_back(argv[i]);
         else
-        {
-            std::cerr << "Unexpected token: " << tokenTypeToString(peektoken().type) << "\n";
-            std::exit(1);
-        }
+            bad_usage = true;
     }
-};
 
-int main(int argc, char *argv[])
-{
     // validate arg count
-    if (argc != 2)
+    if (input_files.empty() || bad_usage || (pipeline && lex_threads > 1) ||
+        (serving && (pipeline || lex_threads > 1 || input_files.size() != 1)) || (profile_generate && profile_use) ||
+        (hot_lines > 0 && !profile_use) || (!profile_file.empty() && input_files.size() != 1) ||
+        (running && (serving || profile_generate || profile_use)) ||
+        (profile_sample && (profile_generate || profile_use || running || serving)) ||
+        (sample_report > 0 && (profile_generate || profile_use || profile_sample || running || serving)) ||
+        (interactive && (!running || input_files.size() != 1)))
     {
         std::cerr << "incorrect usage\n";
+        std::cerr << "usage: compile [--time-report] [--trace=out.json] [--lex-threads=N | --pipeline] [--cache=DIR]\n"
+                     "               [--codegen-threads=N]\n"
+                     "               [--profile-generate | --profile-use[=FILE] [--hot-lines[=N]] | --profile-sample]\n"
+                     "               file.basic...\n";
+        std::cerr << "       compile --sample-report[=N] file.basic...\n";
+        std::cerr << "       compile --serve file.basic\n";
+        std::cerr << "       compile --run [--run-threads=N] [--budget=N] [--memory=N] file.basic...\n";
+        std::cerr << "       compile --run --interactive [--run-threads=N] [--budget=N] [--memory=N] file.basic\n";
         return 1;
     }
+    timeReport().enabled = time_report || !trace_file.empty();
 
-    // open file
-    std::string words;
+    if (serving)
     {
-        std::stringstream cont_stream;
-        std::fstream input((argv[1]), std::ios::in);
-        if (!input.is_open())
-        {
-            std::cerr << "Failed to open file: " << argv[1] << "\n";
+        std::string words;
+        if (!loadFile(input_files[0], words))
             return 1;
-        }
-        cont_stream << input.rdbuf();
-        words = cont_stream.str();
+        return serve(input_files[0], std::move(words));
     }
 
-    // tokenizer words (lexer) and then parse
-    auto tokens = tokenizer(words);
-    Emitter emitter;
-    Parser parser(tokens, emitter);
-    parser.parse();
-
-    // write to a file
-    fs::path inPath(argv[1]);
-    fs::path outPath = inPath;
-    outPath.replace_extension(".c");
-
-    if (!outPath.parent_path().empty())
+    // one loader for the whole batch, so a shared include is parsed once
+    ModuleLoader loader;
+    loader.cachedir = cache_dir;
+    int status = 0;
+    if (sample_report > 0)
     {
-        fs::create_directories(outPath.parent_path());
+        for (const char *input_file : input_files)
+        {
+            std::string samples = fs::path(input_file).replace_extension(".samples").string();
+            std::string folded = fs::path(input_file).replace_extension(".folded").string();
+            if (!sampleReport(samples, folded, sample_report, std::cout))
+            {
+                std::cerr << "Failed to read " << samples << " or write " << folded << "\n";
+                return 1;
+            }
+        }
+    }
+    else if (interactive)
+        status = interact(input_files[0], loader, run_threads, limits);
+    else if (running)
+        status = runAll(input_files, loader, run_threads, limits);
+    else
+    {
+        for (const char *input_file : input_files)
+        {
+            if (compileFile(input_file, lex_threads, pipeline, loader) != 0)
+                return 1;
+        }
     }
 
-    emitter.WriteToFile(outPath.string());
-    std::cout << "WroteToFile: " << outPath << "\n";
-    return 0;
+    // report where the time went
+    if (time_report)
+    {
+        if (loader.parsed + loader.fromdisk > 0)
+            timeReport().Note("includes: " + std::to_string(loader.parsed) + " modules parsed, " +
+                              std::to_string(loader.fromdisk) + " loaded from the cache");
+        timeReport().Print(std::cerr);
+    }
+    if (!trace_file.empty() && !timeReport().WriteTrace(trace_file))
+    {
+        std::cerr << "Failed to open trace file: " << trace_file << "\n";
+        return 1;
+    }
+    return status;
 }
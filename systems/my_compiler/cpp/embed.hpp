@@ -0,0 +1,990 @@
+#pragma once
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "vm.hpp"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// basic programs compiled along with the c++ they are written in
+//
+//   static constexpr basic_program<"input a; print a * 2;"> twice;
+//   Instance run = twice("21\n");      // run.output == "42\n"
+//   static_assert(!basic_compiles("let = 3;"));
+//
+// the source is lexed, parsed and checked like the runner's Program::compile
+// checks it, all in constant evaluation, and what comes out is the bytecode
+// itself. a program with a syntax or compile error is a c++ compile error.
+// at run time the image only becomes a Program once, on the first call, and
+// every call runs a fresh Instance of it.
+//
+// the constexpr frontend keeps its own plain token and name lists and records
+// the first error instead of exiting or throwing, but shares the token
+// tables with the lexer and the tree types with the parser. includes need
+// the file system, so an embedded program cannot have any.
+
+// a token of the compile time lexer, its text a view of the source
+struct EmbedToken
+{
+    Tokens type = Tokens::SEMICOLON;
+    std::string_view text;
+    std::uint32_t id = 0;
+    std::uint32_t pos = 0;
+};
+
+// a call waiting for every sub to be known
+struct EmbedCall
+{
+    std::uint32_t function;
+    std::uint32_t pc;
+    std::uint32_t routine; // name id
+    std::uint32_t args;
+    std::uint32_t where; // source offset of its statement
+};
+
+// one program on its way through the constexpr frontend
+struct EmbedBuild
+{
+    std::string_view source;
+    std::vector<EmbedToken> tokens;
+    std::vector<std::string_view> names; // by id
+    std::vector<Stmt> body;
+    std::vector<Expr> nodes;
+    Program program;
+    std::string error;      // the first problem, empty while there is none
+    std::uint32_t line = 0; // where it is
+
+    constexpr void fail(std::uint32_t pos, const std::string &message)
+    {
+        if (!error.empty())
+            return;
+        error = message;
+        line = 1;
+        for (std::uint32_t k = 0; k < pos && k < source.size(); k++)
+            line += source[k] == '\n';
+    }
+
+    constexpr std::uint32_t intern(std::string_view name)
+    {
+        for (std::uint32_t id = 0; id < names.size(); id++)
+        {
+            if (names[id] == name)
+                return id;
+        }
+        names.push_back(name);
+        return names.size() - 1;
+    }
+};
+
+constexpr bool embedDigit(char c)
+{
+    return c >= '0' && c <= '9';
+}
+
+constexpr bool embedLetter(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+constexpr std::string embedNumber(std::uint64_t v)
+{
+    std::string digits;
+    do
+    {
+        digits.insert(digits.begin(), char('0' + v % 10));
+        v /= 10;
+    } while (v > 0);
+    return digits;
+}
+
+// the same tokens tokenizeRange makes of the source
+constexpr void embedLex(EmbedBuild &b)
+{
+    std::string_view s = b.source;
+    std::size_t i = 0;
+    while (i < s.size())
+    {
+        char c = s[i];
+        if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
+        {
+            i++;
+            continue;
+        }
+        if (c == '#')
+        {
+            while (i < s.size() && s[i] != '\n')
+                i++;
+            continue;
+        }
+        Tokens type = Tokens::SEMICOLON;
+        std::size_t start = i;
+        if (int len = operatorType(c, i + 1 < s.size() ? s[i + 1] : '\0', type))
+        {
+            i += len;
+            b.tokens.push_back(EmbedToken{type, s.substr(start, len), 0, std::uint32_t(start)});
+        }
+        else if (embedLetter(c))
+        {
+            while (i < s.size() && (embedLetter(s[i]) || embedDigit(s[i])))
+                i++;
+            std::string_view word = s.substr(start, i - start);
+            if (keywordType(word, type))
+                b.tokens.push_back(EmbedToken{type, word, 0, std::uint32_t(start)});
+            else
+                b.tokens.push_back(EmbedToken{Tokens::IDENT, word, b.intern(word), std::uint32_t(start)});
+        }
+        else if (c == '"')
+        {
+            i++;
+            while (i < s.size() && s[i] != '"')
+                i++;
+            if (i >= s.size())
+            {
+                b.fail(start, "Must have closing quote");
+                return;
+            }
+            i++;
+            b.tokens.push_back(EmbedToken{Tokens::STRING, s.substr(start + 1, i - start - 2), 0, std::uint32_t(start)});
+        }
+        else if (embedDigit(c))
+        {
+            while (i < s.size() && embedDigit(s[i]))
+                i++;
+            b.tokens.push_back(EmbedToken{Tokens::INTEGER, s.substr(start, i - start), 0, std::uint32_t(start)});
+        }
+        else
+            i++;
+    }
+}
+
+// the grammar of Parser over the embed token list. after an error it skips
+// to the end, so every loop below stops and the first message is kept.
+struct EmbedParser
+{
+    EmbedBuild &b;
+    std::size_t at = 0;
+    int depth = 0;
+    EmbedToken none; // last() before any token was read
+    std::vector<PendingOp> ops;
+    std::vector<int> operands;
+
+    constexpr explicit EmbedParser(EmbedBuild &build) : b(build) {}
+
+    constexpr bool atend() const { return at >= b.tokens.size(); }
+    constexpr bool checktype(Tokens type) const { return !atend() && b.tokens[at].type == type; }
+    constexpr const EmbedToken &peektoken() const { return b.tokens[at]; }
+    constexpr const EmbedToken &last() const { return at > 0 ? b.tokens[at - 1] : none; }
+    constexpr void getnexttoken()
+    {
+        if (!atend())
+            at++;
+    }
+
+    constexpr void fail(const std::string &message)
+    {
+        b.fail(atend() ? b.source.size() : peektoken().pos, message);
+        at = b.tokens.size();
+    }
+
+    constexpr void expect(Tokens type, const std::string &expected)
+    {
+        if (checktype(type))
+            getnexttoken();
+        else if (atend())
+            fail("parser expects: " + expected + " but got EOF");
+        else
+            fail("parser expects: " + expected + " but got " + tokenTypeToString(peektoken().type));
+    }
+
+    constexpr void semicolon() { expect(Tokens::SEMICOLON, "semicolon"); }
+
+    // takes an rvalue, g++ 12 loses track of a moved string in a by-value
+    // aggregate parameter during constant evaluation
+    constexpr int node(Expr &&e)
+    {
+        b.nodes.push_back(std::move(e));
+        return b.nodes.size() - 1;
+    }
+
+    constexpr int comparison()
+    {
+        int root = parseexpr(COMPARISON);
+        if (b.nodes[root].kind != Tokens::COMP)
+            fail("parser expects: comparison expression");
+        return root;
+    }
+
+    constexpr int expression() { return parseexpr(ADDITIVE); }
+
+    constexpr int parseexpr(int minprec)
+    {
+        std::size_t opbase = ops.size();
+        while (true)
+        {
+            while (!atend() && prefixop(peektoken().type))
+            {
+                ops.push_back(PendingOp{peektoken().type, PREFIX, std::string(peektoken().text)});
+                getnexttoken();
+            }
+            operands.push_back(primary());
+            int prec = atend() ? 0 : infixprecedence(peektoken().type);
+            if (prec == 0 || prec < minprec)
+                break;
+            while (ops.size() > opbase && ops.back().prec >= prec)
+                reduce();
+            ops.push_back(PendingOp{peektoken().type, prec, std::string(peektoken().text)});
+            getnexttoken();
+        }
+        while (ops.size() > opbase)
+            reduce();
+        int root = operands.back();
+        operands.pop_back();
+        return root;
+    }
+
+    constexpr void reduce()
+    {
+        PendingOp op = std::move(ops.back());
+        ops.pop_back();
+        Expr e{op.type, std::move(op.text)};
+        if (op.prec != PREFIX)
+        {
+            e.rhs = operands.back();
+            operands.pop_back();
+        }
+        e.lhs = operands.back();
+        operands.back() = node(std::move(e));
+    }
+
+    constexpr int primary()
+    {
+        if (checktype(Tokens::INTEGER))
+        {
+            getnexttoken();
+            return node(Expr{Tokens::INTEGER, std::string(last().text)});
+        }
+        if (checktype(Tokens::IDENT))
+        {
+            Expr leaf{Tokens::IDENT, {}};
+            leaf.id = peektoken().id;
+            getnexttoken();
+            if (checktype(Tokens::LBRACKET))
+            {
+                leaf.kind = Tokens::LBRACKET;
+                leaf.lhs = subscript();
+            }
+            return node(std::move(leaf));
+        }
+        if (checktype(Tokens::CALL))
+            return call();
+        fail("parser expects: integer or identifier");
+        return node(Expr{Tokens::INTEGER, "0"});
+    }
+
+    constexpr int call()
+    {
+        expect(Tokens::CALL, "call");
+        expect(Tokens::IDENT, "routine name after call");
+        Expr e{Tokens::CALL, {}};
+        e.id = last().id;
+        if (checktype(Tokens::LPAREN))
+        {
+            getnexttoken();
+            int tail = -1;
+            while (!atend() && !checktype(Tokens::RPAREN))
+            {
+                if (tail >= 0)
+                    expect(Tokens::COMMA, ", or )");
+                Expr arg{Tokens::COMMA, {}};
+                arg.lhs = expression();
+                int k = node(std::move(arg));
+                if (tail < 0)
+                    e.lhs = k;
+                else
+                    b.nodes[tail].rhs = k;
+                tail = k;
+            }
+            expect(Tokens::RPAREN, ")");
+        }
+        return node(std::move(e));
+    }
+
+    constexpr int subscript()
+    {
+        expect(Tokens::LBRACKET, "[");
+        int index = expression();
+        expect(Tokens::RBRACKET, "]");
+        return index;
+    }
+
+    constexpr void block(std::vector<Stmt> &out, Tokens terminator)
+    {
+        depth++;
+        while (!checktype(terminator) && !atend())
+            out.push_back(statement());
+        depth--;
+    }
+
+    constexpr Stmt statement()
+    {
+        Stmt s;
+        s.kind = peektoken().type;
+        s.first = at;
+        if (checktype(Tokens::PRINT))
+        {
+            getnexttoken();
+            if (checktype(Tokens::STRING))
+            {
+                s.text = std::string(peektoken().text);
+                getnexttoken();
+            }
+            else
+                s.expr = expression();
+            semicolon();
+        }
+        else if (checktype(Tokens::LET) || checktype(Tokens::INPUT))
+        {
+            bool let = checktype(Tokens::LET);
+            getnexttoken();
+            expect(Tokens::IDENT, let ? "identifier after let" : "identifier after input");
+            s.id = last().id;
+            if (checktype(Tokens::LBRACKET))
+                s.index = subscript();
+            if (let)
+            {
+                expect(Tokens::ASSIGN, "=");
+                s.expr = expression();
+            }
+            semicolon();
+        }
+        else if (checktype(Tokens::DIM))
+        {
+            getnexttoken();
+            expect(Tokens::IDENT, "array name after dim");
+            s.id = last().id;
+            expect(Tokens::LBRACKET, "[");
+            expect(Tokens::INTEGER, "array size");
+            s.text = std::string(last().text);
+            expect(Tokens::RBRACKET, "]");
+            semicolon();
+        }
+        else if (checktype(Tokens::LABEL) || checktype(Tokens::GOTO))
+        {
+            bool label = checktype(Tokens::LABEL);
+            getnexttoken();
+            expect(Tokens::IDENT, label ? "identifier after label" : "identifier after goto");
+            s.id = last().id;
+            semicolon();
+        }
+        else if (checktype(Tokens::INCLUDE))
+            fail("include is not available in an embedded program");
+        else if (checktype(Tokens::CALL))
+        {
+            s.expr = call();
+            semicolon();
+        }
+        else if (checktype(Tokens::RETURN))
+        {
+            getnexttoken();
+            if (!checktype(Tokens::SEMICOLON))
+                s.expr = expression();
+            semicolon();
+        }
+        else if (checktype(Tokens::SUB))
+        {
+            if (depth > 0)
+                fail("sub must be at top level");
+            getnexttoken();
+            expect(Tokens::IDENT, "routine name after sub");
+            s.id = last().id;
+            if (checktype(Tokens::LPAREN))
+            {
+                getnexttoken();
+                while (!atend() && !checktype(Tokens::RPAREN))
+                {
+                    if (!s.params.empty())
+                        expect(Tokens::COMMA, ", or )");
+                    expect(Tokens::IDENT, "parameter name");
+                    s.params.push_back(last().id);
+                }
+                expect(Tokens::RPAREN, ")");
+            }
+            block(s.body, Tokens::ENDSUB);
+            expect(Tokens::ENDSUB, "endsub");
+        }
+        else if (checktype(Tokens::FOR))
+        {
+            getnexttoken();
+            expect(Tokens::IDENT, "loop variable after for");
+            s.id = last().id;
+            expect(Tokens::ASSIGN, "=");
+            Expr bounds{Tokens::TO, {}};
+            bounds.lhs = expression();
+            expect(Tokens::TO, "to");
+            bounds.rhs = expression();
+            s.expr = node(std::move(bounds));
+            if (checktype(Tokens::PARALLEL))
+            {
+                getnexttoken();
+                s.parallel = true;
+                while (checktype(Tokens::IDENT))
+                {
+                    s.params.push_back(peektoken().id);
+                    getnexttoken();
+                    expect(Tokens::LPAREN, "(");
+                    expect(Tokens::IDENT, "reduction variable");
+                    s.params.push_back(last().id);
+                    expect(Tokens::RPAREN, ")");
+                }
+            }
+            block(s.body, Tokens::ENDFOR);
+            expect(Tokens::ENDFOR, "endfor");
+        }
+        else if (checktype(Tokens::IF) || checktype(Tokens::WHILE))
+        {
+            bool isif = checktype(Tokens::IF);
+            getnexttoken();
+            s.expr = comparison();
+            expect(isif ? Tokens::THEN : Tokens::REPEAT, isif ? "then" : "repeat");
+            Tokens closer = isif ? Tokens::ENDIF : Tokens::ENDWHILE;
+            block(s.body, closer);
+            expect(closer, isif ? "endif" : "endwhile");
+        }
+        else
+            fail("Unexpected token: " + tokenTypeToString(peektoken().type));
+        s.end = at;
+        return s;
+    }
+};
+
+// Program::compile's checks and bytecode, with the failures recorded
+struct EmbedAssembler
+{
+    EmbedBuild &b;
+    std::vector<const Stmt *> subs;
+    std::vector<EmbedCall> calls;
+
+    std::uint32_t current = 0;
+    std::vector<int> slot;
+    std::vector<int> array;
+    std::vector<int> labels;
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> gotos;
+    std::vector<std::uint32_t> gotosat; // where each goto is in the source
+    std::uint32_t where = 0; // source offset of the statement being written
+
+    constexpr explicit EmbedAssembler(EmbedBuild &build) : b(build) {}
+
+    constexpr Function &fn() { return b.program.functions[current]; }
+    constexpr std::uint32_t pc() { return fn().code.size(); }
+    constexpr std::uint32_t emit(Op op, std::int32_t arg = 0)
+    {
+        fn().code.push_back(Instr{op, arg});
+        return pc() - 1;
+    }
+    constexpr std::uint32_t temporary() { return fn().slots++; }
+    constexpr std::string name(std::uint32_t id) const { return std::string(b.names[id]); }
+
+    constexpr void fail(const std::string &message) { b.fail(where, message); }
+
+    constexpr void begin(std::string_view function)
+    {
+        current = b.program.functions.size();
+        b.program.functions.push_back(Function{std::string(function), 0, 0, {}});
+        slot.assign(b.names.size(), -1);
+        array.assign(b.names.size(), -1);
+        labels.assign(b.names.size(), -1);
+        gotos.clear();
+        gotosat.clear();
+    }
+
+    constexpr void finish()
+    {
+        emit(Op::PUSH, 0);
+        emit(Op::RET);
+        for (std::size_t k = 0; k < gotos.size(); k++)
+        {
+            auto [at, id] = gotos[k];
+            if (labels[id] < 0)
+            {
+                where = gotosat[k];
+                fail("goto to undefined label: " + name(id));
+                continue;
+            }
+            Instr &jump = fn().code[at];
+            jump.arg = labels[id];
+            jump.op = std::uint32_t(labels[id]) <= at ? Op::LOOP : Op::JUMP;
+        }
+    }
+
+    constexpr int declare(std::uint32_t id)
+    {
+        if (array[id] >= 0)
+            fail("array needs an index: " + name(id));
+        if (slot[id] < 0)
+            slot[id] = temporary();
+        return slot[id];
+    }
+
+    constexpr int variable(std::uint32_t id)
+    {
+        if (array[id] >= 0)
+            fail("array needs an index: " + name(id));
+        else if (slot[id] < 0)
+            fail("variable used before it is assigned: " + name(id));
+        return slot[id] < 0 ? 0 : slot[id];
+    }
+
+    constexpr int arrayOf(std::uint32_t id)
+    {
+        if (array[id] >= 0)
+            return array[id];
+        fail(slot[id] >= 0 ? "not an array: " + name(id) : "array used before its dim: " + name(id));
+        return 0;
+    }
+
+    constexpr void statement(const Stmt &s)
+    {
+        where = b.tokens[s.first].pos;
+        switch (s.kind)
+        {
+        case Tokens::PRINT:
+            if (s.expr < 0)
+            {
+                b.program.strings.push_back(s.text);
+                emit(Op::PRINTS, b.program.strings.size() - 1);
+            }
+            else
+            {
+                expr(s.expr);
+                emit(Op::PRINT);
+            }
+            break;
+        case Tokens::LET:
+            if (s.index >= 0)
+            {
+                int a = arrayOf(s.id);
+                expr(s.index);
+                expr(s.expr);
+                emit(Op::STOREA, a);
+            }
+            else
+            {
+                int v = declare(s.id);
+                expr(s.expr);
+                emit(Op::STORE, v);
+            }
+            break;
+        case Tokens::INPUT:
+            if (s.index >= 0)
+            {
+                int a = arrayOf(s.id);
+                expr(s.index);
+                emit(Op::INPUTA, a);
+            }
+            else
+                emit(Op::INPUT, declare(s.id));
+            break;
+        case Tokens::LABEL:
+            if (labels[s.id] >= 0)
+                fail("label defined twice: " + name(s.id));
+            labels[s.id] = pc();
+            break;
+        case Tokens::GOTO:
+            gotos.emplace_back(emit(Op::JUMP), s.id);
+            gotosat.push_back(where);
+            break;
+        case Tokens::CALL:
+            expr(s.expr);
+            emit(Op::POP);
+            break;
+        case Tokens::RETURN:
+            if (s.expr < 0)
+                emit(Op::PUSH, 0);
+            else
+                expr(s.expr);
+            emit(Op::RET);
+            break;
+        case Tokens::DIM:
+        {
+            if (slot[s.id] >= 0 || array[s.id] >= 0)
+                fail("dim of a name already in use: " + name(s.id));
+            std::uint32_t size = 0;
+            for (char c : s.text)
+                size = s.text.size() > 9 ? 0 : size * 10 + std::uint32_t(c - '0');
+            if (size == 0)
+                fail("array size must be from 1 to 999999999: " + name(s.id));
+            array[s.id] = b.program.arrays.size();
+            b.program.arrays.push_back(size);
+            break;
+        }
+        case Tokens::SUB:
+            if (current != 0)
+                fail("sub must be at top level: " + name(s.id));
+            subs.push_back(&s);
+            break;
+        case Tokens::IF:
+        {
+            expr(s.expr);
+            std::uint32_t skip = emit(Op::JUMPZ);
+            for (const Stmt &inner : s.body)
+                statement(inner);
+            fn().code[skip].arg = pc();
+            break;
+        }
+        case Tokens::WHILE:
+        {
+            std::uint32_t top = pc();
+            expr(s.expr);
+            std::uint32_t exit = emit(Op::JUMPZ);
+            for (const Stmt &inner : s.body)
+                statement(inner);
+            emit(Op::LOOP, top);
+            fn().code[exit].arg = pc();
+            break;
+        }
+        case Tokens::FOR:
+            forLoop(s);
+            break;
+        default:
+            break;
+        }
+    }
+
+    // the scalars a parallel for assigns, which it puts back afterwards
+    constexpr void assigned(const std::vector<Stmt> &list, const Stmt &loop, std::vector<std::uint32_t> &out)
+    {
+        for (const Stmt &inner : list)
+        {
+            bool scalar = inner.kind == Tokens::FOR ||
+                          ((inner.kind == Tokens::LET || inner.kind == Tokens::INPUT) && inner.index < 0);
+            bool reduced = false;
+            for (std::size_t k = 1; k < loop.params.size(); k += 2)
+                reduced = reduced || loop.params[k] == inner.id;
+            bool seen = false;
+            for (std::uint32_t v : out)
+                seen = seen || v == std::uint32_t(slot[inner.id]);
+            if (scalar && inner.id != loop.id && !reduced && slot[inner.id] >= 0 && !seen)
+                out.push_back(slot[inner.id]);
+            assigned(inner.body, loop, out);
+        }
+    }
+
+    constexpr void forLoop(const Stmt &s)
+    {
+        std::vector<std::uint32_t> saved;
+        std::vector<std::uint32_t> keep;
+        if (s.parallel)
+            assigned(s.body, s, saved);
+        for (std::uint32_t v : saved)
+        {
+            keep.push_back(temporary());
+            emit(Op::LOAD, v);
+            emit(Op::STORE, keep.back());
+        }
+
+        const Expr &bounds = b.nodes[s.expr];
+        int var = declare(s.id);
+        expr(bounds.lhs);
+        emit(Op::STORE, var);
+        std::uint32_t last = temporary();
+        expr(bounds.rhs);
+        emit(Op::STORE, last);
+        std::uint32_t top = pc();
+        emit(Op::LOAD, var);
+        emit(Op::LOAD, last);
+        emit(Op::LE);
+        std::uint32_t exit = emit(Op::JUMPZ);
+        for (const Stmt &inner : s.body)
+            statement(inner);
+        emit(Op::LOAD, var);
+        emit(Op::PUSH, 1);
+        emit(Op::ADD);
+        emit(Op::STORE, var);
+        emit(Op::LOOP, top);
+        fn().code[exit].arg = pc();
+
+        for (std::size_t k = 0; k < saved.size(); k++)
+        {
+            emit(Op::LOAD, keep[k]);
+            emit(Op::STORE, saved[k]);
+        }
+    }
+
+    // post order with an explicit stack like Assembler::expr, so a deep
+    // expression costs no constexpr call depth
+    constexpr void expr(int root)
+    {
+        std::vector<std::pair<int, bool>> work{{root, false}}; // node, operands already on the stack
+        while (!work.empty())
+        {
+            auto [at, ready] = work.back();
+            work.pop_back();
+            const Expr &e = b.nodes[at];
+            if (!ready)
+            {
+                switch (e.kind)
+                {
+                case Tokens::INTEGER:
+                {
+                    std::uint32_t v = 0;
+                    for (char c : e.text)
+                        v = v * 10 + std::uint32_t(c - '0');
+                    emit(Op::PUSH, std::int32_t(v));
+                    continue;
+                }
+                case Tokens::IDENT:
+                    emit(Op::LOAD, variable(e.id));
+                    continue;
+                case Tokens::CALL:
+                {
+                    std::vector<int> args;
+                    for (int arg = e.lhs; arg >= 0; arg = b.nodes[arg].rhs)
+                        args.push_back(b.nodes[arg].lhs);
+                    work.emplace_back(at, true);
+                    for (std::size_t k = args.size(); k-- > 0;)
+                        work.emplace_back(args[k], false);
+                    continue;
+                }
+                default:
+                    work.emplace_back(at, true);
+                    if (e.rhs >= 0)
+                        work.emplace_back(e.rhs, false);
+                    if (e.lhs >= 0)
+                        work.emplace_back(e.lhs, false);
+                    continue;
+                }
+            }
+
+            switch (e.kind)
+            {
+            case Tokens::LBRACKET: emit(Op::LOADA, arrayOf(e.id)); break;
+            case Tokens::CALL:
+            {
+                std::uint32_t args = 0;
+                for (int arg = e.lhs; arg >= 0; arg = b.nodes[arg].rhs)
+                    args++;
+                calls.push_back(EmbedCall{current, emit(Op::CALL), e.id, args, where});
+                break;
+            }
+            case Tokens::NOT: emit(Op::NOT); break;
+            case Tokens::PLUS:
+                if (e.rhs >= 0)
+                    emit(Op::ADD);
+                break;
+            case Tokens::MINUS: emit(e.rhs >= 0 ? Op::SUB : Op::NEG); break;
+            case Tokens::TIMES: emit(Op::MUL); break;
+            case Tokens::DIVIDE: emit(Op::DIV); break;
+            case Tokens::COMP:
+                emit(e.text == "==" ? Op::EQ : e.text == "!=" ? Op::NE : e.text == "<" ? Op::LT : e.text == "<=" ? Op::LE
+                                                               : e.text == ">" ? Op::GT : Op::GE);
+                break;
+            default: fail("unexpected expression"); break;
+            }
+        }
+    }
+
+    constexpr void program()
+    {
+        begin("main");
+        for (const Stmt &s : b.body)
+            statement(s);
+        finish();
+
+        std::vector<int> byid(b.names.size(), -1);
+        for (const Stmt *sub : subs)
+        {
+            if (byid[sub->id] >= 0)
+                fail("sub defined twice: " + name(sub->id));
+            begin(b.names[sub->id]);
+            byid[sub->id] = current;
+            for (std::uint32_t param : sub->params)
+                slot[param] = temporary();
+            fn().params = sub->params.size();
+            for (const Stmt &s : sub->body)
+                statement(s);
+            finish();
+        }
+
+        for (const EmbedCall &call : calls)
+        {
+            where = call.where;
+            int k = byid[call.routine];
+            if (k < 0)
+                fail("call to undefined sub: " + name(call.routine));
+            else if (b.program.functions[k].params != call.args)
+                fail("sub " + name(call.routine) + " takes " + embedNumber(b.program.functions[k].params) +
+                     " arguments but got " + embedNumber(call.args));
+            else
+                b.program.functions[call.function].code[call.pc].arg = k;
+        }
+    }
+};
+
+// lexes, parses and checks a program, all of it usable in constant evaluation
+constexpr EmbedBuild embedCompile(std::string_view source)
+{
+    EmbedBuild b;
+    b.source = source;
+    embedLex(b);
+    EmbedParser parser(b);
+    while (b.error.empty() && !parser.atend())
+        b.body.push_back(parser.statement());
+    if (b.error.empty())
+    {
+        EmbedAssembler as(b);
+        as.program();
+    }
+    return b;
+}
+
+// true if the program compiles, for static_assert
+constexpr bool basic_compiles(std::string_view source)
+{
+    return embedCompile(source).error.empty();
+}
+
+// how big the arrays of a program's image have to be
+struct EmbedShape
+{
+    std::size_t functions = 0;
+    std::size_t code = 0;
+    std::size_t strings = 0;
+    std::size_t chars = 0; // of the printed strings and the function names
+    std::size_t arrays = 0;
+};
+
+constexpr EmbedShape embedShape(std::string_view source)
+{
+    EmbedBuild b = embedCompile(source);
+    EmbedShape shape{b.program.functions.size(), 0, b.program.strings.size(), 0, b.program.arrays.size()};
+    for (const Function &f : b.program.functions)
+    {
+        shape.code += f.code.size();
+        shape.chars += f.name.size();
+    }
+    for (const std::string &text : b.program.strings)
+        shape.chars += text.size();
+    return shape;
+}
+
+// where one function is in an image
+struct EmbedFunction
+{
+    std::uint32_t name = 0; // first char
+    std::uint32_t namesize = 0;
+    std::uint32_t params = 0;
+    std::uint32_t slots = 0;
+    std::uint32_t code = 0; // first instruction
+    std::uint32_t size = 0;
+};
+
+// a compiled program as constants, with no allocations left in it
+template <EmbedShape S>
+struct EmbedImage
+{
+    bool ok = false;
+    std::uint32_t line = 0;
+    std::array<char, 200> error{}; // cut short if need be
+    std::array<EmbedFunction, S.functions> functions{};
+    std::array<Instr, S.code> code{};
+    std::array<std::uint32_t, S.strings + 1> strings{}; // where each one starts, then where the last ends
+    std::array<char, S.chars> chars{};
+    std::array<std::uint32_t, S.arrays> arrays{};
+
+    // the runner's form of it
+    Program program() const
+    {
+        Program p;
+        for (const EmbedFunction &f : functions)
+            p.functions.push_back(Function{std::string(chars.data() + f.name, f.namesize), f.params, f.slots,
+                                           std::vector<Instr>(code.begin() + f.code, code.begin() + f.code + f.size)});
+        for (std::size_t k = 0; k < S.strings; k++)
+            p.strings.emplace_back(chars.data() + strings[k], strings[k + 1] - strings[k]);
+        p.arrays.assign(arrays.begin(), arrays.end());
+        return p;
+    }
+};
+
+template <EmbedShape S>
+constexpr EmbedImage<S> embedImage(std::string_view source)
+{
+    EmbedBuild b = embedCompile(source);
+    EmbedImage<S> image;
+    image.ok = b.error.empty();
+    image.line = b.line;
+    for (std::size_t k = 0; k < b.error.size() && k + 1 < image.error.size(); k++)
+        image.error[k] = b.error[k];
+    std::uint32_t code = 0, chars = 0;
+    for (std::size_t k = 0; k < S.strings; k++)
+    {
+        image.strings[k] = chars;
+        for (char c : b.program.strings[k])
+            image.chars[chars++] = c;
+    }
+    image.strings[S.strings] = chars;
+    for (std::size_t k = 0; k < S.functions; k++)
+    {
+        const Function &f = b.program.functions[k];
+        image.functions[k] = EmbedFunction{chars, std::uint32_t(f.name.size()), f.params, f.slots, code,
+                                           std::uint32_t(f.code.size())};
+        for (char c : f.name)
+            image.chars[chars++] = c;
+        for (const Instr &in : f.code)
+            image.code[code++] = in;
+    }
+    for (std::size_t k = 0; k < S.arrays; k++)
+        image.arrays[k] = b.program.arrays[k];
+    return image;
+}
+
+// a string literal as a template argument
+template <std::size_t N>
+struct basic_source
+{
+    char text[N]{};
+
+    constexpr basic_source(const char (&s)[N])
+    {
+        for (std::size_t k = 0; k < N; k++)
+            text[k] = s[k];
+    }
+    constexpr std::string_view view() const { return std::string_view(text, N - 1); }
+};
+
+// names the error in the compiler's message when an embedded program does
+// not compile: the line and the message are its template arguments
+template <std::uint32_t Line, std::array<char, 200> Message>
+struct basic_compile_error
+{
+    static_assert(Line == 0, "embedded basic program does not compile, the arguments above say where and why");
+};
+
+// a basic program compiled with the c++ around it, called like a function
+// each call runs the program once on the given stdin and gives back the
+// finished instance: its output, exit code or why it stopped
+template <basic_source Source>
+struct basic_program
+{
+    static constexpr EmbedShape shape = embedShape(Source.view());
+    static constexpr EmbedImage<shape> image = embedImage<shape>(Source.view());
+    static_assert(sizeof(basic_compile_error<image.ok ? 0 : image.line, image.error>) > 0);
+
+    static const Program &program()
+    {
+        static const Program compiled = image.program();
+        return compiled;
+    }
+
+    Instance operator()(std::string input = "", const Limits &limits = Limits()) const
+    {
+        Instance it(program(), limits, std::move(input));
+        while (!it.run())
+        {
+        }
+        return it;
+    }
+};
@@ -0,0 +1,320 @@
+#include "incremental.hpp"
+#include <algorithm>
+#include <utility>
+
+// one block of the tree on the way down to an edit: a statement list, the old
+// index of the token that closes it, and that token
+struct Level
+{
+    std::vector<Stmt> *list;
+    std::uint32_t end;
+    Tokens closer;
+    Stmt *owner; // the statement the block belongs to, null at the top
+};
+
+// moves every token index at or after `from` by dt, for the part of the tree
+// that follows a splice
+static void shiftTree(std::vector<Stmt> &list, std::uint32_t from, long dt)
+{
+    auto shift = [&](std::uint32_t &v)
+    {
+        if (v >= from)
+            v += dt;
+    };
+    for (Stmt &s : list)
+    {
+        if (s.end < from)
+            continue;
+        shift(s.first);
+        shift(s.end);
+        if (s.error)
+            shift(s.id);
+        if (!s.error && hasBlock(s.kind))
+        {
+            shift(s.bodyfirst);
+            shift(s.bodyend);
+            shiftTree(s.body, from, dt);
+        }
+    }
+}
+
+// first statement of a block that ends after token t
+static std::size_t statementAfter(const std::vector<Stmt> &list, std::uint32_t t)
+{
+    auto it = std::upper_bound(list.begin(), list.end(), t,
+                               [](std::uint32_t at, const Stmt &s) { return at < s.end; });
+    return it - list.begin();
+}
+
+void Document::open(std::string source)
+{
+    text = std::move(source);
+    names = Interner();
+    lexall();
+    parseall();
+}
+
+void Document::lexall()
+{
+    tokens.clear();
+    shiftfrom = 0;
+    shiftby = 0;
+    std::size_t i = 0;
+    lexok = tokenizeRange(text, i, text.size(), names, tokens);
+    lexerror = i;
+    relexed = tokens.size();
+}
+
+void Document::parseall()
+{
+    body.clear();
+    nodes.clear();
+    Parser parser(tokens);
+    parser.recover = true;
+    while (!parser.atend())
+        body.push_back(parser.statement());
+    nodes.swap(parser.nodes);
+    livenodes = nodes.size();
+    reparsed = tokens.size();
+}
+
+void Document::edit(std::size_t begin, std::size_t end, const std::string &replacement)
+{
+    end = std::min(end, text.size());
+    begin = std::min(begin, end);
+    long delta = long(replacement.size()) - long(end - begin);
+    text.replace(begin, end - begin, replacement);
+
+    std::size_t damagedend;
+    std::size_t first = relex(begin, end, delta, damagedend);
+    long dt = long(relexed) - long(damagedend - first);
+    reparse(first, damagedend, dt);
+
+    // every re-parse leaves the replaced statements' nodes behind, start over
+    // once they clearly outweigh the live ones
+    if (nodes.size() > 4 * livenodes + 65536)
+        parseall();
+}
+
+// re-lexes around an edit that is already in text, which moved everything
+// after the old end by delta chars. returns the index of the first old token
+// redone; old tokens [first, damagedend) are replaced by `relexed` new ones.
+std::size_t Document::relex(std::size_t begin, std::size_t end, long delta, std::size_t &damagedend)
+{
+    // restart at the last token that starts before the edit, it may have grown
+    // into the edit. tokens always start outside strings and comments.
+    std::size_t lo = 0, hi = tokens.size();
+    while (lo < hi)
+    {
+        std::size_t mid = (lo + hi) / 2;
+        if (offset(mid) < begin)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    std::size_t first = lo > 0 ? lo - 1 : 0;
+    settle(first);
+    std::size_t i = first < tokens.size() && offset(first) < begin ? offset(first) : 0;
+
+    // lex one token at a time until a new token starts exactly where an old
+    // one past the edit now starts. from there the text is unchanged, so the
+    // old tokens are still right.
+    std::vector<Token> fresh;
+    std::size_t j = first;
+    bool synced = false;
+    while (true)
+    {
+        std::size_t count = fresh.size();
+        bool ok = tokenizeRange(text, i, text.size(), names, fresh, 1);
+        if (fresh.size() == count)
+        {
+            lexok = ok;
+            lexerror = i;
+            break;
+        }
+        long at = fresh.back().pos;
+        while (j < tokens.size() && (offset(j) < end || long(offset(j)) + delta < at))
+            j++;
+        if (j < tokens.size() && long(offset(j)) + delta == at)
+        {
+            fresh.pop_back();
+            synced = true;
+            break;
+        }
+    }
+    if (!synced)
+        j = tokens.size();
+    else if (!lexok)
+        lexerror += delta;
+
+    // splice, the new tokens have their real offsets and the unchanged tail
+    // moves by delta on top of what it was owed already
+    // moves the tail at most once, the cost of an edit that changes the token count
+    std::size_t common = std::min(fresh.size(), j - first);
+    std::move(fresh.begin(), fresh.begin() + common, tokens.begin() + first);
+    if (fresh.size() > common)
+        tokens.insert(tokens.begin() + j, std::make_move_iterator(fresh.begin() + common),
+                      std::make_move_iterator(fresh.end()));
+    else
+        tokens.erase(tokens.begin() + first + common, tokens.begin() + j);
+    shiftfrom = first + fresh.size();
+    shiftby += delta;
+
+    damagedend = j;
+    relexed = fresh.size();
+    return first;
+}
+
+// moves the pending shift to start at token k, fixing the tokens in between
+void Document::settle(std::size_t k)
+{
+    for (; shiftfrom < k; shiftfrom++)
+        tokens[shiftfrom].pos += shiftby;
+    for (; shiftfrom > k; shiftfrom--)
+        tokens[shiftfrom - 1].pos -= shiftby;
+}
+
+// re-parses the statements covering old tokens [first, damagedend), which are
+// now new tokens starting at first (dt more than before)
+// goes down to the innermost block holding the whole damage and
+// re-parses from the first damaged statement until the parse lands on a
+// statement boundary of the old tree past the damage. if the block's shape
+// changed (its closer moved, or a statement ran past it) the owning statement
+// is damaged instead and the next block out is tried, up to the top level.
+void Document::reparse(std::uint32_t first, std::uint32_t damagedend, long dt)
+{
+    std::uint32_t oldcount = tokens.size() - dt;
+    std::vector<Level> path{Level{&body, oldcount, Tokens::SEMICOLON, nullptr}};
+    while (true)
+    {
+        std::vector<Stmt> &list = *path.back().list;
+        std::size_t k = statementAfter(list, first);
+        if (k == list.size())
+            break;
+        Stmt &s = list[k];
+        bool nests = !s.error && hasBlock(s.kind);
+        // a header can end in something the first body token may extend (a
+        // bound expression, a parameter or reduction list), so damage there
+        // is the owner's
+        if (!nests || first <= s.bodyfirst || damagedend > s.bodyend)
+            break;
+        path.push_back(Level{&s.body, s.bodyend, blockCloser(s.kind), &s});
+    }
+
+    std::uint32_t df = first, dj = damagedend;
+    for (std::size_t depth = path.size(); depth-- > 0;)
+    {
+        Level &level = path[depth];
+        std::vector<Stmt> &list = *level.list;
+        bool top = level.owner == nullptr;
+
+        // an error statement may have stopped because of the first damaged
+        // token, so it is redone too
+        std::size_t a = statementAfter(list, df);
+        if (a > 0 && list[a - 1].error && list[a - 1].end == df)
+            a--;
+        std::uint32_t start = a < list.size() ? list[a].first : df;
+        std::uint32_t need = dj + dt;
+        std::uint32_t blockend = level.end + dt;
+
+        Parser parser(tokens, start);
+        parser.recover = true;
+        parser.depth = depth;
+        parser.nodes.swap(nodes);
+        std::vector<Stmt> redone;
+        std::size_t z = a;
+        bool landed = false;
+        while (true)
+        {
+            std::uint32_t at = parser.position;
+            if (at >= need)
+            {
+                if (at == blockend)
+                {
+                    z = list.size();
+                    landed = true;
+                    break;
+                }
+                while (z < list.size() && (list[z].end < dj || long(list[z].end) + dt < at))
+                    z++;
+                if (z < list.size() && long(list[z].end) + dt == at)
+                {
+                    z++;
+                    landed = true;
+                    break;
+                }
+            }
+            if (parser.atend() || (!top && parser.checktype(level.closer)))
+                break;
+            redone.push_back(parser.statement());
+            if (parser.position > blockend)
+                break;
+        }
+        nodes.swap(parser.nodes);
+
+        if (!landed && top)
+        {
+            // cannot happen, the top level always runs to the end of input
+            parseall();
+            return;
+        }
+        if (!landed)
+        {
+            // the block changed shape, damage its whole owner one level out
+            df = level.owner->first;
+            dj = level.owner->end;
+            continue;
+        }
+        if (dt != 0)
+            shiftTree(body, damagedend, dt);
+        list.erase(list.begin() + a, list.begin() + z);
+        list.insert(list.begin() + a, std::make_move_iterator(redone.begin()),
+                    std::make_move_iterator(redone.end()));
+        reparsed = parser.position - start;
+        return;
+    }
+}
+
+// collects error statements in source order
+static void collectErrors(const std::vector<Stmt> &list, std::vector<const Stmt *> &out)
+{
+    for (const Stmt &s : list)
+    {
+        if (s.error)
+            out.push_back(&s);
+        else if (hasBlock(s.kind))
+            collectErrors(s.body, out);
+    }
+}
+
+std::vector<Diagnostic> Document::diagnostics() const
+{
+    std::vector<const Stmt *> errors;
+    collectErrors(body, errors);
+
+    // where each message points, the parser's end of input is where lexing stopped
+    std::size_t eof = lexok ? text.size() : lexerror;
+    std::vector<std::pair<std::size_t, std::string>> found;
+    for (const Stmt *s : errors)
+        found.emplace_back(s->id < tokens.size() ? offset(s->id) : eof, s->text);
+    if (!lexok)
+        found.emplace_back(lexerror, "Must have closing quote");
+
+    // offsets only grow, so one pass over the text finds every line and column
+    std::vector<Diagnostic> out;
+    std::size_t at = 0, linestart = 0;
+    std::uint32_t line = 1;
+    for (auto &f : found)
+    {
+        for (; at < f.first && at < text.size(); at++)
+        {
+            if (text[at] == '\n')
+            {
+                line++;
+                linestart = at + 1;
+            }
+        }
+        out.push_back(Diagnostic{line, std::uint32_t(f.first - linestart + 1), std::move(f.second)});
+    }
+    return out;
+}
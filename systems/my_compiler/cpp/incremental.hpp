@@ -0,0 +1,70 @@
+#pragma once
+#include "lexer.hpp"
+#include "parser.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// one problem found in a document, with a 1 based line and column
+struct Diagnostic
+{
+    std::uint32_t line;
+    std::uint32_t column;
+    std::string message;
+};
+
+// a source file kept lexed and parsed between edits, for editors that check
+// the file on every keystroke
+// an edit re-lexes from the token before it until the new tokens line up with
+// the old ones again, and re-parses only the statements of the innermost
+// if/while/for/sub body around the damage. everything else keeps its tokens and tree,
+// shifted to the new offsets.
+struct Document
+{
+    std::string text;
+    Interner names;
+    std::vector<Token> tokens; // pos may be stale, see offset()
+    std::vector<Stmt> body;
+    std::vector<Expr> nodes; // expression nodes of every statement, append only
+
+    // an unterminated string literal, and the offset of its opening quote
+    bool lexok = true;
+    std::size_t lexerror = 0;
+
+    // work done by the last open or edit, in tokens
+    std::size_t relexed = 0;
+    std::size_t reparsed = 0;
+
+    // replaces the whole text and checks it from scratch
+    void open(std::string source);
+
+    // replaces text[begin, end) with replacement and brings tokens and tree up to date
+    void edit(std::size_t begin, std::size_t end, const std::string &replacement);
+
+    // syntax errors in source order
+    std::vector<Diagnostic> diagnostics() const;
+
+    // where token k starts in text
+    std::size_t offset(std::size_t k) const
+    {
+        return k >= shiftfrom ? std::uint32_t(tokens[k].pos + shiftby) : tokens[k].pos;
+    }
+
+private:
+    // nodes kept after the last full parse, to know when garbage piles up
+    std::size_t livenodes = 0;
+
+    // tokens from shiftfrom on are shiftby chars further than their pos says.
+    // an edit only settles the tokens between the last edit and itself, so
+    // typing in one place never walks the whole token vector. shiftby wraps
+    // around like pos does, so a shift back is just a large unsigned one.
+    std::size_t shiftfrom = 0;
+    std::uint32_t shiftby = 0;
+    void settle(std::size_t k);
+
+    void lexall();
+    void parseall();
+    std::size_t relex(std::size_t begin, std::size_t end, long delta, std::size_t &damagedend);
+    void reparse(std::uint32_t first, std::uint32_t damagedend, long dt);
+};
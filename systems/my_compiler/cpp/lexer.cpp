@@ -1,89 +1,73 @@
 #include "lexer.hpp"
+#include "timing.hpp"
+#include <algorithm>
+#include <cstring>
+#include <thread>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <cctype>
-#include <unordered_map>
+#include <cstdint>
 
 //    ./lexer ../scripts/1.basic
 // g++ -std=c++2a lexer.cpp -o lexer
 
-// print out our tokens as strings
-std::string tokenTypeToString(Tokens type)
+// fnv-1a, good enough for short identifiers
+static std::uint32_t hashName(std::string_view text)
 {
-    switch (type)
+    std::uint32_t h = 2166136261u;
+    for (unsigned char c : text)
     {
-    case Tokens::PRINT:return "PRINT";
-    case Tokens::IF:return "IF";
-    case Tokens::THEN:return "THEN";
-    case Tokens::ENDIF:return "ENDIF";
-    case Tokens::LET:return "LET";
-    case Tokens::INPUT:return "INPUT";
-    case Tokens::WHILE:return "WHILE";
-    case Tokens::REPEAT:return "REPEAT";
-    case Tokens::ENDWHILE:return "ENDWHILE";
-    case Tokens::GOTO:return "GOTO";
-    case Tokens::LABEL:return "LABEL";
-    case Tokens::INTEGER:return "INTEGER";
-    case Tokens::IDENT:return "IDENT";
-    case Tokens::STRING:return "STRING";
-    case Tokens::COMP: return "COMP";
-    case Tokens::ASSIGN:return "ASSIGN";
-    case Tokens::NOT:return "NOT";
-    case Tokens::PLUS:return "PLUS";
-    case Tokens::MINUS:return "MINUS";
-    case Tokens::DIVIDE:return "DIVIDE";
-    case Tokens::TIMES:return "TIMES";
-    case Tokens::SEMICOLON:return "SEMICOLON";
-    default:return "UNKNOWN";
+        h ^= c;
+        h *= 16777619u;
     }
+    return h;
 }
 
-// hashmap of keywords
-std::unordered_map<std::string, Tokens> keywords =
-    {
-        {"print", Tokens::PRINT},
-        {"if", Tokens::IF},
-        {"then", Tokens::THEN},
-        {"endif", Tokens::ENDIF},
-        {"let", Tokens::LET},
-        {"input", Tokens::INPUT},
-        {"while", Tokens::WHILE},
-        {"repeat", Tokens::REPEAT},
-        {"endwhile", Tokens::ENDWHILE},
-        {"goto", Tokens::GOTO},
-        {"label", Tokens::LABEL}};
-
-// hashmap for the two char ops
-std::unordered_map<std::string, Tokens> two_char =
+// returns the id for text, assigning the next dense id the first time it is seen
+std::uint32_t Interner::intern(std::string_view text)
+{
+    // keep the table at most half full
+    if ((names.size() + 1) * 2 > slots.size())
+        grow();
+
+    std::size_t mask = slots.size() - 1;
+    std::size_t i = hashName(text) & mask;
+    while (slots[i] != 0)
     {
-        {"==", Tokens::COMP},
-        {"!=", Tokens::COMP},
-        {"<=", Tokens::COMP},
-        {">=", Tokens::COMP}};
+        if (names[slots[i] - 1] == text)
+            return slots[i] - 1;
+        i = (i + 1) & mask;
+    }
+    std::uint32_t id = names.size();
+    names.emplace_back(text);
+    slots[i] = id + 1;
+    return id;
+}
 
-// hashmap for the one char ops
-std::unordered_map<std::string, Tokens> one_char =
+// doubles the table and reinserts every name
+void Interner::grow()
+{
+    std::vector<std::uint32_t> bigger(slots.empty() ? 64 : slots.size() * 2, 0);
+    std::size_t mask = bigger.size() - 1;
+    for (std::uint32_t id = 0; id < names.size(); id++)
     {
-        {"=", Tokens::ASSIGN},
-        {"<", Tokens::COMP},
-        {">", Tokens::COMP},
-        {"!", Tokens::NOT},
-        {"+", Tokens::PLUS},
-        {"/", Tokens::DIVIDE},
-        {"-", Tokens::MINUS},
-        {"*", Tokens::TIMES},
-        {";", Tokens::SEMICOLON}};
+        std::size_t i = hashName(names[id]) & mask;
+        while (bigger[i] != 0)
+            i = (i + 1) & mask;
+        bigger[i] = id + 1;
+    }
+    slots.swap(bigger);
+}
 
-// main tokenizer function that takes in file as string input
-std::vector<Token> tokenizer(const std::string &str)
+// see lexer.hpp, every token records the offset it starts at
+bool tokenizeRange(const std::string &str, std::size_t &i, std::size_t end,
+                   Interner &names, std::vector<Token> &tokens, std::size_t limit)
 {
-    // create vector to hold tokens
-    std::vector<Token> tokens;
-    std::size_t i = 0;
+    std::size_t stop = limit == SIZE_MAX ? SIZE_MAX : tokens.size() + limit;
 
     // loop through each char till EOF
-    while (i < str.size())
+    while (i < end && tokens.size() < stop)
     {
         char c = str[i];
 
@@ -96,7 +80,7 @@ std::vector<Token> tokenizer(const std::string &str)
         // skip through comments
         if (c == '#')
         {
-            while (i < str.size() && str[i] != '\n')
+            while (i < end && str[i] != '\n')
             {
                 ++i;
             }
@@ -104,26 +88,16 @@ std::vector<Token> tokenizer(const std::string &str)
         }
         // handle one and two char operators
         else if ((c == ';') || (c == '<') || (c == '>') || (c == '*') || (c == '/') ||
-                 (c == '+') || (c == '-') || (c == '=') || (c == '!'))
+                 (c == '+') || (c == '-') || (c == '=') || (c == '!') ||
+                 (c == '(') || (c == ')') || (c == ',') || (c == '[') || (c == ']'))
         {
-            if (i + 1 < str.size())
-            {
-                // check if the first op is followed by a valid second op
-                std::string op2{str[i], str[i + 1]};
-                // if so push back both operators and update i accordingly
-                if (two_char.contains(op2))
-                {
-                    tokens.push_back(Token{two_char.at(op2), op2});
-                    i += 2;
-                    continue;
-                }
-            }
-            // else handle one char operators
-            std::string op1{str[i]};
-            if (one_char.contains(op1))
+            // check if the first op is followed by a valid second op, else take one char
+            Tokens type;
+            int len = operatorType(c, i + 1 < end ? str[i + 1] : '\0', type);
+            if (len > 0)
             {
-                tokens.push_back(Token{one_char.at(op1), op1});
-                ++i;
+                tokens.push_back(Token{type, std::string(str.data() + i, len), 0, std::uint32_t(i)});
+                i += len;
                 continue;
             }
             ++i;
@@ -134,24 +108,25 @@ std::vector<Token> tokenizer(const std::string &str)
         {
             // advances the index while we have a letter or underscore
             std::size_t start_index = i;
-            while (i < str.size() && (isalnum(str[i]) || str[i] == '_'))
+            while (i < end && (isalnum(str[i]) || str[i] == '_'))
             {
                 i++;
             }
 
-            // slices the wanted token use the i index
-            std::string substring = str.substr(start_index, i - start_index);
+            // views the wanted token use the i index
+            std::string_view word(str.data() + start_index, i - start_index);
 
-            // if that word is part of our keyword hashmap
-            if (keywords.contains(substring))
+            // if that word is part of our keyword table
+            Tokens type;
+            if (keywordType(word, type))
             {
                 // add to tokens vector
-                tokens.push_back(Token{keywords[substring], substring});
+                tokens.push_back(Token{type, std::string(word), 0, std::uint32_t(start_index)});
             }
             else
             {
-                // else add it as an identifer
-                tokens.push_back(Token{Tokens::IDENT, substring});
+                // else add it as an identifer, interned once here
+                tokens.push_back(Token{Tokens::IDENT, std::nullopt, names.intern(word), std::uint32_t(start_index)});
             }
             continue;
         }
@@ -159,27 +134,28 @@ std::vector<Token> tokenizer(const std::string &str)
         else if (c == '"')
         {
             // mark the start index and consume the first quote
-            int start_index = i;
+            std::size_t start_index = i;
             i++;
             // advance through till we reach the end quote
-            while ((i < str.size()) && (str[i] != '"'))
+            while ((i < end) && (str[i] != '"'))
             {
                 i++;
             }
 
-            // make sure we throw an error if there is no closing quote
-            if (i >= str.size())
+            // make sure we report an error if there is no closing quote,
+            // leaving i on the quote that opened it
+            if (i >= end)
             {
-                std::cerr << "Must have closing quote\n";
-                std::exit(1);
+                i = start_index;
+                return false;
             }
 
             // splice the substring using the i index and push it back as a string
             std::string substring = str.substr((start_index + 1), i - (start_index + 1));
-            tokens.push_back(Token{Tokens::STRING, substring});
+            tokens.push_back(Token{Tokens::STRING, substring, 0, std::uint32_t(start_index)});
 
             // consumes the closing quote
-            if (i < str.size() && str[i] == '"')
+            if (i < end && str[i] == '"')
             {
                 i++;
             }
@@ -189,14 +165,14 @@ std::vector<Token> tokenizer(const std::string &str)
         else if (std::isdigit(c))
         {
             // advance i till we reach the end of the digit
-            int start_index = i;
-            while ((i < str.size()) && std::isdigit(str[i]))
+            std::size_t start_index = i;
+            while ((i < end) && std::isdigit(str[i]))
             {
                 i++;
             }
             // splice based off i index
             std::string substring = str.substr(start_index, i - start_index);
-            tokens.push_back(Token{Tokens::INTEGER, substring});
+            tokens.push_back(Token{Tokens::INTEGER, substring, 0, std::uint32_t(start_index)});
         }
         // else advance
         else
@@ -204,6 +180,182 @@ std::vector<Token> tokenizer(const std::string &str)
             i++;
         }
     }
+    return true;
+}
+
+// main tokenizer function that takes in file as string input
+std::vector<Token> tokenizer(const std::string &str, Interner &names)
+{
+    // create vector to hold tokens
+    std::vector<Token> tokens;
+    std::size_t i = 0;
+    if (!tokenizeRange(str, i, str.size(), names, tokens))
+    {
+        std::cerr << "Must have closing quote\n";
+        std::exit(1);
+    }
     // finally return all our tokens
     return tokens;
-}
\ No newline at end of file
+}
+
+// lexes the next batch, carrying along any names it interned for the first time
+bool StreamLexer::next(TokenBatch &batch, std::size_t max)
+{
+    batch.tokens.clear();
+    batch.names.clear();
+    std::size_t known = names.size();
+    batch.ok = tokenizeRange(str, pos, str.size(), names, batch.tokens, max);
+    for (std::size_t id = known; id < names.size(); id++)
+        batch.names.push_back(names.name(id));
+    batch.last = !batch.ok || pos >= str.size();
+    return !batch.last;
+}
+
+// lexer states that matter at a line boundary
+// comments always end at the newline, so only an open string can cross one
+enum ScanState
+{
+    OUTSIDE = 0,
+    IN_STRING = 1
+};
+
+// state at the end of str[begin, end) when entering it in state s
+// follows the same rules as tokenizeRange: '#' only starts a comment outside a
+// string and a quote only opens a string outside a comment
+static ScanState scanRange(const std::string &str, std::size_t begin, std::size_t end, ScanState s)
+{
+    std::size_t i = begin;
+    while (i < end)
+    {
+        if (s == IN_STRING)
+        {
+            const void *q = std::memchr(str.data() + i, '"', end - i);
+            if (q == nullptr)
+                return IN_STRING;
+            i = static_cast<const char *>(q) - str.data() + 1;
+            s = OUTSIDE;
+        }
+        else if (str[i] == '"')
+        {
+            s = IN_STRING;
+            i++;
+        }
+        else if (str[i] == '#')
+        {
+            const void *nl = std::memchr(str.data() + i, '\n', end - i);
+            if (nl == nullptr)
+                return OUTSIDE;
+            i = static_cast<const char *>(nl) - str.data() + 1;
+        }
+        else
+        {
+            i++;
+        }
+    }
+    return s;
+}
+
+// runs fn(0) ... fn(n - 1), each on its own thread
+template <typename Fn>
+static void parallelFor(std::size_t n, Fn fn)
+{
+    std::vector<std::thread> workers;
+    workers.reserve(n);
+    for (std::size_t k = 0; k < n; k++)
+        workers.emplace_back(fn, k);
+    for (std::thread &t : workers)
+        t.join();
+}
+
+// splits the source into line aligned chunks, lexes them on worker threads and
+// stitches the results back together in order. produces exactly the tokens and
+// identifier ids that tokenizer() would.
+std::vector<Token> tokenizerParallel(const std::string &str, Interner &names, unsigned threads,
+                                     std::size_t min_chunk)
+{
+    // small inputs are not worth the threads
+    std::size_t chunks = std::min<std::size_t>(threads, str.size() / min_chunk);
+    if (chunks < 2)
+        return tokenizer(str, names);
+
+    // nominal cut points, each pushed forward to just after a newline
+    std::vector<std::size_t> cuts{0};
+    for (std::size_t k = 1; k < chunks; k++)
+    {
+        std::size_t at = str.size() * k / chunks;
+        at = std::max(at, cuts.back());
+        const void *nl = std::memchr(str.data() + at, '\n', str.size() - at);
+        if (nl == nullptr)
+            break;
+        at = static_cast<const char *>(nl) - str.data() + 1;
+        if (at > cuts.back() && at < str.size())
+            cuts.push_back(at);
+    }
+    cuts.push_back(str.size());
+    chunks = cuts.size() - 1;
+
+    // each chunk works out its exit state for both possible entry states
+    std::vector<ScanState> exits(chunks * 2);
+    parallelFor(chunks, [&](std::size_t k)
+                {
+                    exits[k * 2 + OUTSIDE] = scanRange(str, cuts[k], cuts[k + 1], OUTSIDE);
+                    exits[k * 2 + IN_STRING] = scanRange(str, cuts[k], cuts[k + 1], IN_STRING);
+                });
+
+    // walk the chunks in order to find the real entry states, and drop any cut
+    // that lands inside a string literal by merging it into the previous chunk
+    std::vector<std::size_t> safe{0};
+    ScanState state = OUTSIDE;
+    for (std::size_t k = 0; k < chunks; k++)
+    {
+        if (k > 0 && state == OUTSIDE)
+            safe.push_back(cuts[k]);
+        state = exits[k * 2 + state];
+    }
+    safe.push_back(str.size());
+    chunks = safe.size() - 1;
+
+    // an open string at the very end is the one error the lexer reports
+    if (state == IN_STRING)
+    {
+        std::cerr << "Must have closing quote\n";
+        std::exit(1);
+    }
+
+    // lex every chunk with its own interner
+    std::vector<std::vector<Token>> parts(chunks);
+    std::vector<Interner> local(chunks);
+    parallelFor(chunks, [&](std::size_t k)
+                {
+                    Phase phase("lex chunk");
+                    std::size_t at = safe[k];
+                    tokenizeRange(str, at, safe[k + 1], local[k], parts[k]);
+                });
+
+    // local ids were handed out in first-seen order within each chunk, so
+    // interning them chunk by chunk reproduces the sequential numbering
+    std::vector<std::vector<std::uint32_t>> remap(chunks);
+    std::vector<std::size_t> offsets(chunks + 1, 0);
+    for (std::size_t k = 0; k < chunks; k++)
+    {
+        remap[k].reserve(local[k].size());
+        for (const std::string &name : local[k].names)
+            remap[k].push_back(names.intern(name));
+        offsets[k + 1] = offsets[k] + parts[k].size();
+    }
+
+    // move every chunk into place, rewriting identifier ids as we go
+    std::vector<Token> tokens(offsets[chunks]);
+    parallelFor(chunks, [&](std::size_t k)
+                {
+                    Token *out = tokens.data() + offsets[k];
+                    for (Token &t : parts[k])
+                    {
+                        if (t.type == Tokens::IDENT)
+                            t.id = remap[k][t.id];
+                        *out++ = std::move(t);
+                    }
+                    std::vector<Token>().swap(parts[k]);
+                });
+    return tokens;
+}
@@ -1,7 +1,9 @@
 #pragma once 
 #include <string>
+#include <string_view>
 #include <optional>
 #include <vector>
+#include <cstdint>
 
 enum class Tokens
 {
@@ -16,6 +18,16 @@ enum class Tokens
     ENDWHILE,
     GOTO,
     LABEL,
+    INCLUDE,
+    SUB,
+    ENDSUB,
+    CALL,
+    RETURN,
+    DIM,
+    FOR,
+    TO,
+    PARALLEL,
+    ENDFOR,
     INTEGER,
     IDENT,
     STRING,
@@ -26,15 +38,197 @@ enum class Tokens
     MINUS,
     DIVIDE,
     TIMES,
-    SEMICOLON
+    SEMICOLON,
+    LPAREN,
+    RPAREN,
+    COMMA,
+    LBRACKET,
+    RBRACKET
 };
 
+// identifiers carry their interned id instead of a copy of their text
 struct Token
 {
     Tokens type;
     std::optional<std::string> value;
+    std::uint32_t id = 0;
+    std::uint32_t pos = 0; // offset of the token's first char in the source
 };
 
-std::string tokenTypeToString(Tokens type); 
-std::vector<Token> tokenizer(const std::string &str);
+// maps identifier text to dense ids (0, 1, 2, ...) in order of first appearance
+// open addressing over a power of two table, so a known name costs one hash and
+// usually one compare, and never allocates
+struct Interner
+{
+    std::vector<std::string> names;
+    std::vector<std::uint32_t> slots; // id + 1, 0 means empty
+
+    std::uint32_t intern(std::string_view text);
+    const std::string &name(std::uint32_t id) const { return names[id]; }
+    std::size_t size() const { return names.size(); }
+
+private:
+    void grow();
+};
+
+// the token names and tables are constexpr so the compile time frontend in
+// embed.hpp lexes exactly like tokenizeRange
+
+// print out our tokens as strings
+constexpr std::string tokenTypeToString(Tokens type)
+{
+    switch (type)
+    {
+    case Tokens::PRINT:return "PRINT";
+    case Tokens::IF:return "IF";
+    case Tokens::THEN:return "THEN";
+    case Tokens::ENDIF:return "ENDIF";
+    case Tokens::LET:return "LET";
+    case Tokens::INPUT:return "INPUT";
+    case Tokens::WHILE:return "WHILE";
+    case Tokens::REPEAT:return "REPEAT";
+    case Tokens::ENDWHILE:return "ENDWHILE";
+    case Tokens::GOTO:return "GOTO";
+    case Tokens::LABEL:return "LABEL";
+    case Tokens::INCLUDE:return "INCLUDE";
+    case Tokens::SUB:return "SUB";
+    case Tokens::ENDSUB:return "ENDSUB";
+    case Tokens::CALL:return "CALL";
+    case Tokens::RETURN:return "RETURN";
+    case Tokens::DIM:return "DIM";
+    case Tokens::FOR:return "FOR";
+    case Tokens::TO:return "TO";
+    case Tokens::PARALLEL:return "PARALLEL";
+    case Tokens::ENDFOR:return "ENDFOR";
+    case Tokens::INTEGER:return "INTEGER";
+    case Tokens::IDENT:return "IDENT";
+    case Tokens::STRING:return "STRING";
+    case Tokens::COMP: return "COMP";
+    case Tokens::ASSIGN:return "ASSIGN";
+    case Tokens::NOT:return "NOT";
+    case Tokens::PLUS:return "PLUS";
+    case Tokens::MINUS:return "MINUS";
+    case Tokens::DIVIDE:return "DIVIDE";
+    case Tokens::TIMES:return "TIMES";
+    case Tokens::SEMICOLON:return "SEMICOLON";
+    case Tokens::LPAREN:return "LPAREN";
+    case Tokens::RPAREN:return "RPAREN";
+    case Tokens::COMMA:return "COMMA";
+    case Tokens::LBRACKET:return "LBRACKET";
+    case Tokens::RBRACKET:return "RBRACKET";
+    default:return "UNKNOWN";
+    }
+}
+
+// table of keywords, checked by length first so identifiers rarely compare
+struct Keyword
+{
+    std::string_view text;
+    Tokens type;
+};
+
+inline constexpr Keyword keywords[] = {
+    {"print", Tokens::PRINT},
+    {"if", Tokens::IF},
+    {"then", Tokens::THEN},
+    {"endif", Tokens::ENDIF},
+    {"let", Tokens::LET},
+    {"input", Tokens::INPUT},
+    {"while", Tokens::WHILE},
+    {"repeat", Tokens::REPEAT},
+    {"endwhile", Tokens::ENDWHILE},
+    {"goto", Tokens::GOTO},
+    {"label", Tokens::LABEL},
+    {"include", Tokens::INCLUDE},
+    {"sub", Tokens::SUB},
+    {"endsub", Tokens::ENDSUB},
+    {"call", Tokens::CALL},
+    {"return", Tokens::RETURN},
+    {"dim", Tokens::DIM},
+    {"for", Tokens::FOR},
+    {"to", Tokens::TO},
+    {"parallel", Tokens::PARALLEL},
+    {"endfor", Tokens::ENDFOR}};
+
+// returns true and sets type if the word is a keyword
+constexpr bool keywordType(std::string_view word, Tokens &type)
+{
+    for (const Keyword &k : keywords)
+    {
+        if (k.text.size() == word.size() && k.text == word)
+        {
+            type = k.type;
+            return true;
+        }
+    }
+    return false;
+}
+
+// one and two char operators, returns how many chars matched (0 if none)
+// a switch rather than string keyed maps so no temporary strings are built
+constexpr int operatorType(char c, char next, Tokens &type)
+{
+    // two char comparisons take priority
+    if (next == '=' && (c == '=' || c == '!' || c == '<' || c == '>'))
+    {
+        type = Tokens::COMP;
+        return 2;
+    }
+    switch (c)
+    {
+    case '=': type = Tokens::ASSIGN; return 1;
+    case '<': type = Tokens::COMP; return 1;
+    case '>': type = Tokens::COMP; return 1;
+    case '!': type = Tokens::NOT; return 1;
+    case '+': type = Tokens::PLUS; return 1;
+    case '/': type = Tokens::DIVIDE; return 1;
+    case '-': type = Tokens::MINUS; return 1;
+    case '*': type = Tokens::TIMES; return 1;
+    case ';': type = Tokens::SEMICOLON; return 1;
+    case '(': type = Tokens::LPAREN; return 1;
+    case ')': type = Tokens::RPAREN; return 1;
+    case ',': type = Tokens::COMMA; return 1;
+    case '[': type = Tokens::LBRACKET; return 1;
+    case ']': type = Tokens::RBRACKET; return 1;
+    default: return 0;
+    }
+}
+
+std::vector<Token> tokenizer(const std::string &str, Interner &names);
+
+// tokenizes str[i, end) onto the back of tokens, stopping early once `limit`
+// tokens were added. i is left where lexing stopped, always between tokens, and
+// must start outside any string or comment. returns false if a string literal
+// is still open at end, with i left on its opening quote.
+bool tokenizeRange(const std::string &str, std::size_t &i, std::size_t end,
+                   Interner &names, std::vector<Token> &tokens, std::size_t limit = SIZE_MAX);
+
+// a run of tokens handed from a lexer thread to a parser thread
+// names lists identifiers first seen in this batch, in id order, so the
+// consumer can keep its own copy of the name table without sharing it
+struct TokenBatch
+{
+    std::vector<Token> tokens;
+    std::vector<std::string> names;
+    bool last = false; // no batches follow this one
+    bool ok = true;    // false if the source ended inside a string literal
+};
+
+// lexes a source a batch at a time, so parsing can start before lexing ends
+struct StreamLexer
+{
+    const std::string &str;
+    Interner &names;
+    std::size_t pos = 0;
+
+    StreamLexer(const std::string &s, Interner &n) : str(s), names(n) {}
+
+    // fills batch with up to max tokens, returns false once batch is the last one
+    bool next(TokenBatch &batch, std::size_t max);
+};
+
+// same tokens as tokenizer(), lexed in line aligned chunks on up to `threads` threads
+// chunks are at least min_chunk chars, tests lower it to cut small sources
+std::vector<Token> tokenizerParallel(const std::string &str, Interner &names, unsigned threads,
+                                     std::size_t min_chunk = 1 << 20);
 std::ostream &operator<<(std::ostream &os, const Token &token);
\ No newline at end of file
@@ -0,0 +1,472 @@
+#include "modules.hpp"
+#include "timing.hpp"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// bump whenever Stmt, Expr or the token set changes, old entries are then ignored
+static const std::uint32_t CACHE_VERSION = 5;
+static const char CACHE_MAGIC[8] = {'B', 'A', 'S', 'I', 'C', 'M', 'O', 'D'};
+
+std::uint64_t contentHash(const std::string &text)
+{
+    std::uint64_t h = 14695981039346656037ull;
+    for (unsigned char c : text)
+    {
+        h ^= c;
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+static std::string hex(std::uint64_t v)
+{
+    char buf[17];
+    std::snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)v);
+    return buf;
+}
+
+// whole file into text, false if it cannot be opened
+static bool readFile(const fs::path &path, std::string &text)
+{
+    std::ifstream input(path, std::ios::in | std::ios::binary);
+    if (!input.is_open())
+        return false;
+    std::stringstream contents;
+    contents << input.rdbuf();
+    text = contents.str();
+    return true;
+}
+
+// writes next to the target and renames, so a concurrent run never sees half a file
+static bool writeAtomically(const fs::path &path, const std::string &data)
+{
+    fs::path tmp = path;
+    tmp += ".tmp" + std::to_string(getpid());
+    {
+        std::ofstream out(tmp, std::ios::out | std::ios::binary);
+        if (!out.is_open())
+            return false;
+        out.write(data.data(), data.size());
+        if (!out.good())
+            return false;
+    }
+    std::error_code ec;
+    fs::rename(tmp, path, ec);
+    if (ec)
+        fs::remove(tmp, ec);
+    return !ec;
+}
+
+// file:line:col: message, then exit like the single file compiler does
+[[noreturn]] static void failAt(const fs::path &path, const std::string &text, std::size_t offset,
+                                const std::string &message)
+{
+    std::size_t line = 1, col = 1;
+    for (std::size_t i = 0; i < offset && i < text.size(); i++)
+    {
+        if (text[i] == '\n')
+        {
+            line++;
+            col = 1;
+        }
+        else
+            col++;
+    }
+    std::cerr << path.string() << ":" << line << ":" << col << ": " << message << "\n";
+    std::exit(1);
+}
+
+// serialized form of a module, all integers little end first as the host has them
+struct CacheWriter
+{
+    std::string out;
+
+    void u32(std::uint32_t v) { out.append(reinterpret_cast<const char *>(&v), sizeof(v)); }
+    void str(const std::string &s)
+    {
+        u32(s.size());
+        out += s;
+    }
+    void stmts(const std::vector<Stmt> &list)
+    {
+        u32(list.size());
+        for (const Stmt &s : list)
+        {
+            u32(std::uint32_t(s.kind));
+            u32(s.first);
+            u32(s.end);
+            u32(s.line);
+            u32(s.id);
+            u32(s.expr);
+            u32(s.index);
+            u32(s.parallel);
+            str(s.text);
+            u32(s.bodyfirst);
+            u32(s.bodyend);
+            stmts(s.body);
+            u32(s.params.size());
+            for (std::uint32_t id : s.params)
+                u32(id);
+        }
+    }
+};
+
+// reads what CacheWriter wrote, any short or odd read marks the entry bad
+// (readCache then checks the indices it read)
+struct CacheReader
+{
+    const char *at;
+    const char *end;
+    bool ok = true;
+
+    std::uint32_t u32()
+    {
+        std::uint32_t v = 0;
+        if (end - at < 4)
+        {
+            ok = false;
+            return 0;
+        }
+        std::memcpy(&v, at, sizeof(v));
+        at += sizeof(v);
+        return v;
+    }
+    std::string str()
+    {
+        std::uint32_t n = u32();
+        if (!ok || std::uint32_t(end - at) < n)
+        {
+            ok = false;
+            return {};
+        }
+        std::string s(at, n);
+        at += n;
+        return s;
+    }
+    void stmts(std::vector<Stmt> &list, int depth)
+    {
+        std::uint32_t n = u32();
+        if (!ok || n > std::uint32_t(end - at) || depth > 10000)
+        {
+            ok = false;
+            return;
+        }
+        list.resize(n);
+        for (Stmt &s : list)
+        {
+            s.kind = Tokens(u32());
+            s.first = u32();
+            s.end = u32();
+            s.line = u32();
+            s.id = u32();
+            s.expr = int(u32());
+            s.index = int(u32());
+            s.parallel = u32() != 0;
+            s.text = str();
+            s.bodyfirst = u32();
+            s.bodyend = u32();
+            stmts(s.body, depth + 1);
+            std::uint32_t params = u32();
+            if (!ok || params > std::uint32_t(end - at) / 4)
+            {
+                ok = false;
+                return;
+            }
+            for (std::uint32_t k = 0; k < params; k++)
+                s.params.push_back(u32());
+        }
+    }
+};
+
+std::shared_ptr<const Module> ModuleLoader::load(const fs::path &path)
+{
+    std::error_code ec;
+    fs::path canon = fs::canonical(path, ec);
+    if (!ec)
+    {
+        auto known = loaded.find(canon.string());
+        if (known != loaded.end())
+            return known->second;
+    }
+    Phase phase("module");
+    std::string text;
+    if (ec || !readFile(canon, text))
+    {
+        std::cerr << "Failed to open include: " << path.string() << "\n";
+        std::exit(1);
+    }
+
+    std::uint64_t hash = contentHash(text);
+    hashes[canon.string()] = hash;
+    std::shared_ptr<Module> m;
+    if (!cachedir.empty())
+        m = readCache(hash);
+    if (m)
+        fromdisk++;
+    else
+    {
+        // parse it on its own name table, errors name the file they are in
+        m = std::make_shared<Module>();
+        Interner local;
+        std::vector<Token> tokens;
+        std::size_t i = 0;
+        if (!tokenizeRange(text, i, text.size(), local, tokens))
+            failAt(canon, text, i, "Must have closing quote");
+        Parser parser(tokens);
+        parser.recover = true;
+        parser.text = &text;
+        while (!parser.atend())
+            m->body.push_back(parser.statement());
+        if (const Stmt *bad = firstError(m->body))
+            failAt(canon, text, bad->id < tokens.size() ? tokens[bad->id].pos : text.size(), bad->text);
+        m->nodes = std::move(parser.nodes);
+        m->names = std::move(local.names);
+        m->hash = hash;
+        parsed++;
+        if (!cachedir.empty())
+            writeCache(*m);
+    }
+    m->path = canon;
+    loaded.emplace(canon.string(), m);
+    return m;
+}
+
+std::uint64_t ModuleLoader::hashOf(const fs::path &path)
+{
+    std::error_code ec;
+    fs::path canon = fs::canonical(path, ec);
+    if (ec)
+        return 0;
+    auto known = hashes.find(canon.string());
+    if (known != hashes.end())
+        return known->second;
+    std::string text;
+    std::uint64_t hash = readFile(canon, text) ? contentHash(text) : 0;
+    hashes[canon.string()] = hash;
+    return hash;
+}
+
+// whether the id of a statement of this kind is a name
+static bool namesId(Tokens kind)
+{
+    return kind == Tokens::LET || kind == Tokens::INPUT || kind == Tokens::LABEL || kind == Tokens::GOTO ||
+           kind == Tokens::SUB || kind == Tokens::DIM || kind == Tokens::FOR;
+}
+
+// whether the id of a node of this kind is a name
+static bool namesId(const Expr &e)
+{
+    return e.kind == Tokens::IDENT || e.kind == Tokens::LBRACKET || e.kind == Tokens::CALL;
+}
+
+// whether every name and node a cached module refers to is in it, so a
+// foreign or damaged entry that still reads well cannot index out of range
+static bool indicesInRange(const Module &m)
+{
+    // the parser adds operands before the node using them, which also rules out cycles
+    for (std::size_t k = 0; k < m.nodes.size(); k++)
+    {
+        const Expr &e = m.nodes[k];
+        if ((namesId(e) && e.id >= m.names.size()) || e.lhs < -1 || e.lhs >= int(k) || e.rhs < -1 ||
+            e.rhs >= int(k))
+            return false;
+    }
+    int nodes = m.nodes.size();
+    std::vector<const std::vector<Stmt> *> work{&m.body};
+    while (!work.empty())
+    {
+        const std::vector<Stmt> *list = work.back();
+        work.pop_back();
+        for (const Stmt &s : *list)
+        {
+            if ((namesId(s.kind) && s.id >= m.names.size()) || s.expr < -1 || s.expr >= nodes || s.index < -1 ||
+                s.index >= nodes)
+                return false;
+            for (std::uint32_t param : s.params)
+                if (param >= m.names.size())
+                    return false;
+            work.push_back(&s.body);
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<Module> ModuleLoader::readCache(std::uint64_t hash)
+{
+    std::string data;
+    if (!readFile(cachedir / (hex(hash) + ".mod"), data) || data.size() < sizeof(CACHE_MAGIC) ||
+        std::memcmp(data.data(), CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0)
+        return nullptr;
+    CacheReader r{data.data() + sizeof(CACHE_MAGIC), data.data() + data.size()};
+    if (r.u32() != CACHE_VERSION || r.u32() != std::uint32_t(hash) || r.u32() != std::uint32_t(hash >> 32))
+        return nullptr;
+
+    auto m = std::make_shared<Module>();
+    m->hash = hash;
+    std::uint32_t count = r.u32();
+    for (std::uint32_t k = 0; r.ok && k < count; k++)
+        m->names.push_back(r.str());
+    count = r.u32();
+    for (std::uint32_t k = 0; r.ok && k < count; k++)
+    {
+        Expr e{Tokens(r.u32()), r.str()};
+        e.id = r.u32();
+        e.lhs = int(r.u32());
+        e.rhs = int(r.u32());
+        m->nodes.push_back(std::move(e));
+    }
+    r.stmts(m->body, 0);
+    if (!r.ok || r.at != r.end || !indicesInRange(*m))
+        return nullptr;
+    return m;
+}
+
+void ModuleLoader::writeCache(const Module &m)
+{
+    CacheWriter w;
+    w.out.append(CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    w.u32(CACHE_VERSION);
+    w.u32(std::uint32_t(m.hash));
+    w.u32(std::uint32_t(m.hash >> 32));
+    w.u32(m.names.size());
+    for (const std::string &name : m.names)
+        w.str(name);
+    w.u32(m.nodes.size());
+    for (const Expr &e : m.nodes)
+    {
+        w.u32(std::uint32_t(e.kind));
+        w.str(e.text);
+        w.u32(e.id);
+        w.u32(e.lhs);
+        w.u32(e.rhs);
+    }
+    w.stmts(m.body);
+
+    // a cache that cannot be written only costs speed
+    std::error_code ec;
+    fs::create_directories(cachedir, ec);
+    writeAtomically(cachedir / (hex(m.hash) + ".mod"), w.out);
+}
+
+void IncludeExpander::expand(Stmt &s, std::vector<Expr> &nodes, const fs::path &dir)
+{
+    if (s.kind == Tokens::INCLUDE && !s.error)
+    {
+        std::shared_ptr<const Module> m = loader.load(dir / s.text);
+        if (!seen.insert(m->path.string()).second)
+            return;
+        deps.emplace_back(m->path.string(), m->hash);
+        splice(*m, s, nodes);
+        s.text = m->path.string();
+        fs::path inner = m->path.parent_path();
+        for (Stmt &child : s.body)
+            expand(child, nodes, inner);
+    }
+    else if (hasBlock(s.kind))
+    {
+        for (Stmt &child : s.body)
+            expand(child, nodes, dir);
+    }
+}
+
+// copies the module's statements into the include, renumbering its
+// identifiers into the program's name table and its nodes past the ones
+// already in nodes
+void IncludeExpander::splice(const Module &m, Stmt &into, std::vector<Expr> &nodes)
+{
+    std::vector<std::uint32_t> ids(m.names.size());
+    for (std::size_t k = 0; k < m.names.size(); k++)
+        ids[k] = names.intern(m.names[k]);
+
+    int base = nodes.size();
+    for (const Expr &e : m.nodes)
+    {
+        Expr copy = e;
+        if (namesId(copy))
+            copy.id = ids[copy.id];
+        if (copy.lhs >= 0)
+            copy.lhs += base;
+        if (copy.rhs >= 0)
+            copy.rhs += base;
+        nodes.push_back(std::move(copy));
+    }
+
+    into.body = m.body;
+    std::vector<std::vector<Stmt> *> work{&into.body};
+    while (!work.empty())
+    {
+        std::vector<Stmt> *list = work.back();
+        work.pop_back();
+        for (Stmt &s : *list)
+        {
+            if (namesId(s.kind))
+                s.id = ids[s.id];
+            for (std::uint32_t &param : s.params)
+                param = ids[param];
+            if (s.expr >= 0)
+                s.expr += base;
+            if (s.index >= 0)
+                s.index += base;
+            if (!s.body.empty())
+                work.push_back(&s.body);
+        }
+    }
+}
+
+fs::path DepManifest::pathFor(const fs::path &cachedir, const fs::path &input)
+{
+    std::error_code ec;
+    fs::path canon = fs::weakly_canonical(input, ec);
+    return cachedir / ("deps-" + hex(contentHash(canon.string())) + ".txt");
+}
+
+// text format: a version line, the output path, the options, then one
+// "<hash> <path>" line per dependency
+bool DepManifest::read(const fs::path &file)
+{
+    std::ifstream in(file);
+    std::string line;
+    if (!in.is_open() || !std::getline(in, line) || line != "basic-deps 1")
+        return false;
+    if (!std::getline(in, output) || !std::getline(in, options))
+        return false;
+    deps.clear();
+    while (std::getline(in, line))
+    {
+        std::size_t space = line.find(' ');
+        if (space != 16)
+            return false;
+        deps.emplace_back(line.substr(17), std::strtoull(line.substr(0, 16).c_str(), nullptr, 16));
+    }
+    return !deps.empty();
+}
+
+bool DepManifest::write(const fs::path &file) const
+{
+    std::string data = "basic-deps 1\n" + output + "\n" + options + "\n";
+    for (const auto &dep : deps)
+        data += hex(dep.second) + " " + dep.first + "\n";
+    std::error_code ec;
+    fs::create_directories(file.parent_path(), ec);
+    return writeAtomically(file, data);
+}
+
+bool DepManifest::current(ModuleLoader &loader) const
+{
+    std::error_code ec;
+    if (!fs::exists(output, ec))
+        return false;
+    for (const auto &dep : deps)
+    {
+        if (loader.hashOf(dep.first) != dep.second)
+            return false;
+    }
+    return true;
+}
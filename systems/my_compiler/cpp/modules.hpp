@@ -0,0 +1,89 @@
+#pragma once
+#include "lexer.hpp"
+#include "parser.hpp"
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// 64 bit fnv-1a of a whole file, the key of the module cache
+std::uint64_t contentHash(const std::string &text);
+
+// a file parsed on its own, ready to be spliced into any program that
+// includes it. ids in names, nodes and body are local to the module.
+struct Module
+{
+    std::filesystem::path path; // canonical
+    std::uint64_t hash = 0;
+    std::vector<std::string> names;
+    std::vector<Expr> nodes;
+    std::vector<Stmt> body;
+};
+
+// reads, parses and caches modules for every program of one run
+// each file is parsed at most once per run. with a cache directory, a parsed
+// module is also saved under its content hash so later runs (and other
+// files with the same text) skip lexing and parsing altogether.
+struct ModuleLoader
+{
+    std::filesystem::path cachedir; // empty for no on-disk cache
+
+    // what happened so far, for the time report
+    std::size_t parsed = 0;
+    std::size_t fromdisk = 0;
+
+    // the module at path, exits with a message if it cannot be read or parsed
+    std::shared_ptr<const Module> load(const std::filesystem::path &path);
+
+    // content hash of a file, read at most once per run (0 if unreadable)
+    std::uint64_t hashOf(const std::filesystem::path &path);
+
+private:
+    std::unordered_map<std::string, std::shared_ptr<const Module>> loaded;
+    std::unordered_map<std::string, std::uint64_t> hashes;
+
+    std::shared_ptr<Module> readCache(std::uint64_t hash);
+    void writeCache(const Module &m);
+};
+
+// resolves the include statements of one program
+// the first include of a file gets the file's statements as its body, with
+// ids moved into the program's name table, and the file's canonical path as
+// its text. later includes of the same file stay empty.
+struct IncludeExpander
+{
+    ModuleLoader &loader;
+    Interner &names;
+    std::unordered_set<std::string> seen; // canonical paths already included
+    // every file the program pulled in, with the hash it had, for the
+    // dependency manifest
+    std::vector<std::pair<std::string, std::uint64_t>> deps;
+
+    IncludeExpander(ModuleLoader &l, Interner &n) : loader(l), names(n) {}
+
+    // fills in the includes found anywhere in s, appending to nodes. dir is
+    // the directory of the file s came from, include paths are relative to it.
+    void expand(Stmt &s, std::vector<Expr> &nodes, const std::filesystem::path &dir);
+
+private:
+    void splice(const Module &m, Stmt &into, std::vector<Expr> &nodes);
+};
+
+// per-input record of everything a generated file was built from
+// lets a batch run skip inputs whose output is still current, so changing
+// an included file rebuilds exactly the programs that include it
+struct DepManifest
+{
+    std::string output;
+    std::string options; // compiler options that change the generated code
+    std::vector<std::pair<std::string, std::uint64_t>> deps;
+
+    static std::filesystem::path pathFor(const std::filesystem::path &cachedir, const std::filesystem::path &input);
+    bool read(const std::filesystem::path &file);
+    bool write(const std::filesystem::path &file) const;
+    // true if the output exists and every dependency still has its hash
+    bool current(ModuleLoader &loader) const;
+};
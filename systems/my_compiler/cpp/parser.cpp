@@ -0,0 +1,443 @@
+#include "parser.hpp"
+#include <iostream>
+#include <cstdlib>
+#include <utility>
+#include <algorithm>
+
+// prints and exits, or throws when the caller wants to recover
+void Parser::fail(const std::string &message)
+{
+    if (recover)
+        throw ParseError(message, position);
+    std::cerr << message << "\n";
+    std::exit(1);
+}
+
+// takes in a token and checks it against an expected token type, advancing past if equal
+void Parser::expect(Tokens type, const std::string &expected)
+{
+    if (checktype(type))
+    {
+        getnexttoken();
+        return;
+    }
+    if (atend())
+        fail("parser expects: " + expected + " but got EOF");
+    else
+        fail("parser expects: " + expected + " but got " + tokenTypeToString(peektoken().type));
+}
+
+// helper to check for semicolon
+void Parser::semicolon()
+{
+    expect(Tokens::SEMICOLON, "semicolon");
+}
+
+// handles comparisons, which must have at least one comparison operator on top
+int Parser::comparison()
+{
+    int root = parseexpr(COMPARISON);
+    if (nodes[root].kind != Tokens::COMP)
+    {
+        fail("parser expects: comparison expression");
+    }
+    return root;
+}
+
+// handles arithmetic expressions, stopping before any comparison operator
+int Parser::expression()
+{
+    return parseexpr(ADDITIVE);
+}
+
+// iterative precedence climbing over an explicit operator stack
+// parses operators binding at least as tight as minprec and returns the root node
+int Parser::parseexpr(int minprec)
+{
+    size_t opbase = ops.size();
+    size_t operandbase = operands.size();
+    try
+    {
+        while (true)
+        {
+            // stack up any prefix operators
+            while (!atend() && prefixop(peektoken().type))
+            {
+                ops.push_back(PendingOp{peektoken().type, PREFIX, peektoken().value.value_or("!")});
+                getnexttoken();
+            }
+            // then the operand itself
+            operands.push_back(primary());
+
+            // stop unless an infix operator that binds tightly enough follows
+            int prec = atend() ? 0 : infixprecedence(peektoken().type);
+            if (prec == 0 || prec < minprec)
+                break;
+            // everything on the stack that binds at least as tight is complete (left associative)
+            while (ops.size() > opbase && ops.back().prec >= prec)
+                reduce();
+            ops.push_back(PendingOp{peektoken().type, prec, peektoken().value.value()});
+            getnexttoken();
+        }
+    }
+    catch (const ParseError &)
+    {
+        // leave the stacks as we found them for the next statement
+        ops.resize(opbase);
+        operands.resize(operandbase);
+        throw;
+    }
+    while (ops.size() > opbase)
+        reduce();
+    int root = operands.back();
+    operands.pop_back();
+    return root;
+}
+
+// pops one operator and its operands off the stacks and pushes the combined node
+void Parser::reduce()
+{
+    PendingOp op = std::move(ops.back());
+    ops.pop_back();
+    Expr node{op.type, std::move(op.text)};
+    if (op.prec != PREFIX)
+    {
+        node.rhs = operands.back();
+        operands.pop_back();
+    }
+    node.lhs = operands.back();
+    operands.back() = nodes.size();
+    nodes.push_back(std::move(node));
+}
+
+// integer, identifier, array element or call
+int Parser::primary()
+{
+    if (checktype(Tokens::INTEGER))
+    {
+        nodes.push_back(Expr{Tokens::INTEGER, peektoken().value.value()});
+        getnexttoken();
+        return nodes.size() - 1;
+    }
+    if (checktype(Tokens::IDENT))
+    {
+        Expr leaf{Tokens::IDENT, {}};
+        leaf.id = peektoken().id;
+        getnexttoken();
+        // an array element, name[index]
+        if (checktype(Tokens::LBRACKET))
+        {
+            leaf.kind = Tokens::LBRACKET;
+            leaf.lhs = subscript();
+        }
+        nodes.push_back(leaf);
+        return nodes.size() - 1;
+    }
+    if (checktype(Tokens::CALL))
+        return call();
+    fail("parser expects: integer or identifier");
+}
+
+// call name [ ( expression {, expression} ) ], the arguments become a chain
+// of COMMA nodes hanging off the CALL node
+int Parser::call()
+{
+    expect(Tokens::CALL, "call");
+    expect(Tokens::IDENT, "routine name after call");
+    Expr node{Tokens::CALL, {}};
+    node.id = last().id;
+    if (checktype(Tokens::LPAREN))
+    {
+        getnexttoken();
+        int tail = -1;
+        while (!checktype(Tokens::RPAREN))
+        {
+            if (tail >= 0)
+                expect(Tokens::COMMA, ", or )");
+            int value = expression();
+            nodes.push_back(Expr{Tokens::COMMA, {}});
+            nodes.back().lhs = value;
+            int arg = nodes.size() - 1;
+            if (tail < 0)
+                node.lhs = arg;
+            else
+                nodes[tail].rhs = arg;
+            tail = arg;
+        }
+        getnexttoken();
+    }
+    nodes.push_back(std::move(node));
+    return nodes.size() - 1;
+}
+
+// [ expression ], returning the index expression
+int Parser::subscript()
+{
+    expect(Tokens::LBRACKET, "[");
+    int index = expression();
+    expect(Tokens::RBRACKET, "]");
+    return index;
+}
+
+// parses the next top level statement into out, returns false at the end
+bool Parser::next(Stmt &out)
+{
+    if (atend())
+        return false;
+    out = statement();
+    return true;
+}
+
+// parses statements up to (not including) the terminator or the end
+void Parser::block(std::vector<Stmt> &out, Tokens terminator)
+{
+    depth++;
+    while (!checktype(terminator) && !atend())
+        out.push_back(statement());
+    depth--;
+}
+
+// parses one statement. when recovering, a syntax error becomes an error
+// statement covering the tokens skipped to get back in step
+Stmt Parser::statement()
+{
+    if (!recover)
+        return statementbody();
+
+    std::uint32_t first = position;
+    try
+    {
+        return statementbody();
+    }
+    catch (const ParseError &e)
+    {
+        Stmt bad;
+        bad.error = true;
+        bad.first = first;
+        bad.line = text != nullptr ? lines : 0; // where the statement started
+        bad.text = e.what();
+        bad.id = e.token;
+        // always make progress, then skip to a likely statement boundary
+        if (position == first)
+            getnexttoken();
+        synchronize();
+        bad.end = position;
+        return bad;
+    }
+}
+
+// skips past the next semicolon, stopping early at anything that starts a
+// statement or closes a block so the enclosing blocks keep their shape
+void Parser::synchronize()
+{
+    while (!atend())
+    {
+        switch (peektoken().type)
+        {
+        case Tokens::SEMICOLON:
+            getnexttoken();
+            return;
+        case Tokens::PRINT: case Tokens::LET: case Tokens::INPUT: case Tokens::LABEL:
+        case Tokens::GOTO: case Tokens::INCLUDE: case Tokens::IF: case Tokens::WHILE:
+        case Tokens::SUB: case Tokens::CALL: case Tokens::RETURN: case Tokens::DIM: case Tokens::FOR:
+        case Tokens::ENDIF: case Tokens::ENDWHILE: case Tokens::ENDSUB: case Tokens::ENDFOR:
+            return;
+        default:
+            getnexttoken();
+        }
+    }
+}
+
+// line of an offset no earlier than the last one asked about
+std::uint32_t Parser::lineAt(std::uint32_t pos)
+{
+    std::size_t stop = std::min<std::size_t>(pos, text->size());
+    for (; counted < stop; counted++)
+    {
+        if ((*text)[counted] == '\n')
+            lines++;
+    }
+    return lines;
+}
+
+Stmt Parser::statementbody()
+{
+    Stmt s;
+    s.kind = peektoken().type;
+    s.first = position;
+    if (text != nullptr)
+        s.line = lineAt(peektoken().pos);
+
+    // handles print branch
+    if (checktype(Tokens::PRINT))
+    {
+        getnexttoken();
+        // a string is printed as is
+        if (checktype(Tokens::STRING))
+        {
+            s.text = peektoken().value.value();
+            getnexttoken();
+        }
+        // else an integer expression
+        else
+        {
+            s.expr = expression();
+        }
+        semicolon();
+    }
+    // handles let branch
+    else if (checktype(Tokens::LET))
+    {
+        getnexttoken();
+        // expects an indentifier and stores it as a variable
+        expect(Tokens::IDENT, "identifier after let");
+        s.id = last().id;
+        if (checktype(Tokens::LBRACKET))
+            s.index = subscript();
+        expect(Tokens::ASSIGN, "=");
+        s.expr = expression();
+        semicolon();
+    }
+    // handles input branch
+    else if (checktype(Tokens::INPUT))
+    {
+        getnexttoken();
+        expect(Tokens::IDENT, "identifier after input");
+        s.id = last().id;
+        if (checktype(Tokens::LBRACKET))
+            s.index = subscript();
+        semicolon();
+    }
+    // handles dim branch, an array of a fixed number of integers
+    else if (checktype(Tokens::DIM))
+    {
+        getnexttoken();
+        expect(Tokens::IDENT, "array name after dim");
+        s.id = last().id;
+        expect(Tokens::LBRACKET, "[");
+        expect(Tokens::INTEGER, "array size");
+        s.text = last().value.value();
+        expect(Tokens::RBRACKET, "]");
+        semicolon();
+    }
+    // handles label branch
+    else if (checktype(Tokens::LABEL))
+    {
+        getnexttoken();
+        expect(Tokens::IDENT, "identifier after label");
+        s.id = last().id;
+        semicolon();
+    }
+    // handles goto branch
+    else if (checktype(Tokens::GOTO))
+    {
+        getnexttoken();
+        expect(Tokens::IDENT, "identifier after goto");
+        s.id = last().id;
+        semicolon();
+    }
+    // handles include branch, the driver splices the file in later
+    else if (checktype(Tokens::INCLUDE))
+    {
+        getnexttoken();
+        expect(Tokens::STRING, "file name after include");
+        s.text = last().value.value();
+        semicolon();
+    }
+    // handles call branch, the value of the routine is dropped
+    else if (checktype(Tokens::CALL))
+    {
+        s.expr = call();
+        semicolon();
+    }
+    // handles return branch, with no value the routine returns 0
+    else if (checktype(Tokens::RETURN))
+    {
+        getnexttoken();
+        if (!checktype(Tokens::SEMICOLON))
+            s.expr = expression();
+        semicolon();
+    }
+    // handles sub branch: name, optional parameter list, body, endsub
+    else if (checktype(Tokens::SUB))
+    {
+        if (depth > 0)
+            fail("sub must be at top level");
+        getnexttoken();
+        expect(Tokens::IDENT, "routine name after sub");
+        s.id = last().id;
+        if (checktype(Tokens::LPAREN))
+        {
+            getnexttoken();
+            while (!checktype(Tokens::RPAREN))
+            {
+                if (!s.params.empty())
+                    expect(Tokens::COMMA, ", or )");
+                expect(Tokens::IDENT, "parameter name");
+                s.params.push_back(last().id);
+            }
+            getnexttoken();
+        }
+        s.bodyfirst = position;
+        block(s.body, Tokens::ENDSUB);
+        s.bodyend = position;
+        expect(Tokens::ENDSUB, "endsub");
+    }
+    // handles for branch: variable, bounds, an optional parallel clause with
+    // its reductions as op(variable), body, endfor
+    else if (checktype(Tokens::FOR))
+    {
+        getnexttoken();
+        expect(Tokens::IDENT, "loop variable after for");
+        s.id = last().id;
+        expect(Tokens::ASSIGN, "=");
+        Expr bounds{Tokens::TO, {}};
+        bounds.lhs = expression();
+        expect(Tokens::TO, "to");
+        bounds.rhs = expression();
+        nodes.push_back(std::move(bounds));
+        s.expr = nodes.size() - 1;
+        if (checktype(Tokens::PARALLEL))
+        {
+            getnexttoken();
+            s.parallel = true;
+            // a statement never starts with an identifier, so one here is a reduction
+            while (checktype(Tokens::IDENT))
+            {
+                s.params.push_back(peektoken().id);
+                getnexttoken();
+                expect(Tokens::LPAREN, "(");
+                expect(Tokens::IDENT, "reduction variable");
+                s.params.push_back(last().id);
+                expect(Tokens::RPAREN, ")");
+            }
+        }
+        s.bodyfirst = position;
+        block(s.body, Tokens::ENDFOR);
+        s.bodyend = position;
+        expect(Tokens::ENDFOR, "endfor");
+    }
+    // if and while share a shape: condition, opener, body, closer
+    else if (checktype(Tokens::IF) || checktype(Tokens::WHILE))
+    {
+        bool isif = checktype(Tokens::IF);
+        getnexttoken();
+        s.expr = comparison();
+        if (isif)
+            expect(Tokens::THEN, "then");
+        else
+            expect(Tokens::REPEAT, "repeat");
+        Tokens closer = isif ? Tokens::ENDIF : Tokens::ENDWHILE;
+        s.bodyfirst = position;
+        block(s.body, closer);
+        s.bodyend = position;
+        expect(closer, isif ? "endif" : "endwhile");
+    }
+    // else return error and exit
+    else
+    {
+        fail("Unexpected token: " + tokenTypeToString(peektoken().type));
+    }
+    s.end = position;
+    return s;
+}
@@ -0,0 +1,252 @@
+#pragma once
+#include "lexer.hpp"
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+// binding power of each operator level, higher binds tighter
+// a new operator only needs a level here and a case in infixprecedence or prefixop
+enum Precedence
+{
+    COMPARISON = 1,
+    ADDITIVE = 2,
+    MULTIPLICATIVE = 3,
+    PREFIX = 4
+};
+
+// node of an expression tree, children are indices into the same node vector
+// an array element is an LBRACKET node naming the array in id, with the
+// index in lhs. the bounds of a for are a TO node, first in lhs and last in
+// rhs. a CALL node names the routine in id and points lhs at its first argument.
+// arguments are a chain of COMMA nodes, each holding its value in lhs and
+// the next argument in rhs.
+struct Expr
+{
+    Tokens kind;          // INTEGER, IDENT, LBRACKET, CALL, COMMA, TO or the operator token
+    std::string text;     // digits of a literal or spelling of an operator
+    std::uint32_t id = 0; // identifier id
+    int lhs = -1;         // left operand, or the only operand of a prefix operator
+    int rhs = -1;         // right operand of an infix operator
+};
+
+// operator waiting on the stack for its right operand
+struct PendingOp
+{
+    Tokens type;
+    int prec;
+    std::string text;
+};
+
+// statement of the parse tree
+// token indices are half open, [first, end). every token of a block belongs to
+// exactly one of its statements, so statements of a block are contiguous.
+struct Stmt
+{
+    // PRINT, LET, INPUT, LABEL, GOTO, INCLUDE, CALL, RETURN, DIM, IF, WHILE, FOR or SUB
+    Tokens kind = Tokens::SEMICOLON;
+    std::uint32_t first = 0;  // index of the statement's first token
+    std::uint32_t end = 0;    // one past its last token
+    std::uint32_t line = 0;   // source line of the first token, 0 if the parser had no text
+    std::uint32_t id = 0;     // variable, array, label, routine or loop variable
+    int expr = -1;            // printed, assigned or returned value, the call, the condition or the bounds
+    int index = -1;           // element of the array a let or input stores into
+    std::string text;         // string literal of a print or include, size of a dim, or the error message
+                              // (an include's becomes the included file's path once it is spliced in)
+    bool error = false;       // tokens the parser could not make sense of
+    bool parallel = false;    // a for whose iterations may run on several threads
+    // body of an if, while, for or sub, and the token range it spans (after the
+    // opener, up to the closer). an include gets the included file's
+    // statements here once the driver resolves it, or none if the file was
+    // already included.
+    std::uint32_t bodyfirst = 0;
+    std::uint32_t bodyend = 0;
+    std::vector<Stmt> body;
+    // parameter ids of a sub, or the reductions of a parallel for as
+    // (operator, variable) id pairs
+    std::vector<std::uint32_t> params;
+};
+
+// statements that carry a block of their own
+inline bool hasBlock(Tokens kind)
+{
+    return kind == Tokens::IF || kind == Tokens::WHILE || kind == Tokens::FOR || kind == Tokens::SUB;
+}
+
+// the token that closes a block opened by kind
+inline Tokens blockCloser(Tokens kind)
+{
+    switch (kind)
+    {
+    case Tokens::IF: return Tokens::ENDIF;
+    case Tokens::WHILE: return Tokens::ENDWHILE;
+    case Tokens::FOR: return Tokens::ENDFOR;
+    default: return Tokens::ENDSUB;
+    }
+}
+
+// first syntax error in a tree, null if there is none
+inline const Stmt *firstError(const std::vector<Stmt> &list)
+{
+    for (const Stmt &s : list)
+    {
+        if (s.error)
+            return &s;
+        if (hasBlock(s.kind))
+            if (const Stmt *inner = firstError(s.body))
+                return inner;
+    }
+    return nullptr;
+}
+
+// thrown instead of exiting when the parser recovers from errors
+struct ParseError : std::runtime_error
+{
+    std::uint32_t token; // index of the offending token
+    ParseError(const std::string &message, std::uint32_t at) : std::runtime_error(message), token(at) {}
+};
+
+// hands the parser its tokens a batch at a time
+struct TokenSource
+{
+    virtual ~TokenSource() = default;
+    // replaces batch with the next tokens, returns false when there are no more
+    virtual bool refill(std::vector<Token> &batch) = 0;
+};
+
+// level of an infix operator, 0 if the token is not one
+constexpr int infixprecedence(Tokens type)
+{
+    switch (type)
+    {
+    case Tokens::COMP: return COMPARISON;
+    case Tokens::PLUS: case Tokens::MINUS: return ADDITIVE;
+    case Tokens::TIMES: case Tokens::DIVIDE: return MULTIPLICATIVE;
+    default: return 0;
+    }
+}
+
+// tokens that may start an expression as a prefix operator
+constexpr bool prefixop(Tokens type)
+{
+    return type == Tokens::PLUS || type == Tokens::MINUS || type == Tokens::NOT;
+}
+
+struct Parser
+{
+    // unread tokens of the current batch, and the last token consumed
+    const Token *cur = nullptr;
+    const Token *stop = nullptr;
+    const Token *prev = nullptr;
+
+    // where more tokens come from once the batch runs out (null if none)
+    // the previous batch is kept alive in spare so prev stays valid
+    TokenSource *source = nullptr;
+    std::vector<Token> batch;
+    std::vector<Token> spare;
+
+    // index of the next token, counted from the start of the whole stream
+    std::uint32_t position = 0;
+
+    // how many blocks enclose the statement being parsed, subs only go at 0
+    int depth = 0;
+
+    // when set, errors throw ParseError and statement() turns the bad tokens
+    // into an error statement instead of exiting the process
+    bool recover = false;
+
+    // the source the tokens came from, when statements should know their line.
+    // statements start further on each time, so lines are counted as they go.
+    const std::string *text = nullptr;
+
+    // expression nodes of every statement parsed so far, plus the explicit
+    // stacks used to build them
+    std::vector<Expr> nodes;
+    std::vector<PendingOp> ops;
+    std::vector<int> operands;
+
+    // parses a token vector that is already complete, starting at token `from`
+    explicit Parser(const std::vector<Token> &t, std::uint32_t from = 0)
+        : cur(t.data() + from), stop(t.data() + t.size()), position(from) {}
+
+    // parses tokens as the source produces them
+    explicit Parser(TokenSource &s) : source(&s) {}
+
+    // checks if we reached the end, pulling in the next batch if needed
+    bool atend()
+    {
+        while (cur == stop && source != nullptr)
+        {
+            if (!batch.empty())
+                spare.swap(batch);
+            if (!source->refill(batch))
+                source = nullptr;
+            cur = batch.data();
+            stop = cur + batch.size();
+        }
+        return cur == stop;
+    }
+    // looks at current token
+    const Token &peektoken()
+    {
+        atend();
+        return *cur;
+    }
+    // advances to next token and returns previous
+    const Token &getnexttoken()
+    {
+        if (!atend())
+        {
+            prev = cur++;
+            position++;
+        }
+        return *prev;
+    }
+
+    // returns the last token
+    const Token &last() const
+    {
+        return *prev;
+    }
+
+    // boolean to check the type of a given token
+    bool checktype(Tokens type)
+    {
+        return (!atend() && cur->type == type);
+    }
+
+    // reports a syntax error at the current token
+    [[noreturn]] void fail(const std::string &message);
+
+    // takes in a token and checks it against an expected token type, advancing past if equal
+    void expect(Tokens type, const std::string &expected);
+
+    // helper to check for semicolon
+    void semicolon();
+
+    // expressions, returning the root node index
+    int comparison();
+    int expression();
+    int parseexpr(int minprec);
+    void reduce();
+    int primary();
+    int call();
+    int subscript();
+
+    // parses the next top level statement into out, returns false at the end
+    bool next(Stmt &out);
+
+    // parses one statement, or an error statement when recovering
+    Stmt statement();
+
+    // parses statements up to (not including) the terminator or the end
+    void block(std::vector<Stmt> &out, Tokens terminator);
+
+private:
+    std::size_t counted = 0; // text before this offset has been counted
+    std::uint32_t lines = 1; // line at counted
+
+    Stmt statementbody();
+    void synchronize();
+    std::uint32_t lineAt(std::uint32_t pos);
+};
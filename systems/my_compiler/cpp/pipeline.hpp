@@ -0,0 +1,68 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+// bounded single-producer/single-consumer ring
+// push and pop never take a lock: the producer only writes tail and the
+// consumer only writes head. when the ring is full the producer sleeps on
+// head (backpressure) and when it is empty the consumer sleeps on tail, using
+// c++20 atomic wait so nobody spins.
+template <typename T>
+struct SpscRing
+{
+    explicit SpscRing(std::size_t capacity) : slots(roundup(capacity)), mask(slots.size() - 1) {}
+
+    // blocks while the ring is full
+    void push(T &&item)
+    {
+        std::uint64_t t = tail.load(std::memory_order_relaxed);
+        std::uint64_t h = head.load(std::memory_order_acquire);
+        while (t - h == slots.size())
+        {
+            producer_waits.fetch_add(1, std::memory_order_relaxed);
+            head.wait(h, std::memory_order_acquire);
+            h = head.load(std::memory_order_acquire);
+        }
+        slots[t & mask] = std::move(item);
+        tail.store(t + 1, std::memory_order_release);
+        tail.notify_one();
+    }
+
+    // blocks while the ring is empty
+    void pop(T &item)
+    {
+        std::uint64_t h = head.load(std::memory_order_relaxed);
+        std::uint64_t t = tail.load(std::memory_order_acquire);
+        while (t == h)
+        {
+            consumer_waits.fetch_add(1, std::memory_order_relaxed);
+            tail.wait(t, std::memory_order_acquire);
+            t = tail.load(std::memory_order_acquire);
+        }
+        item = std::move(slots[h & mask]);
+        head.store(h + 1, std::memory_order_release);
+        head.notify_one();
+    }
+
+    // how often each side had to sleep, for the time report
+    std::atomic<std::uint64_t> producer_waits{0};
+    std::atomic<std::uint64_t> consumer_waits{0};
+
+private:
+    static std::size_t roundup(std::size_t n)
+    {
+        std::size_t p = 2;
+        while (p < n)
+            p <<= 1;
+        return p;
+    }
+
+    std::vector<T> slots;
+    std::size_t mask;
+    // each index on its own cache line so the two threads don't false share
+    alignas(64) std::atomic<std::uint64_t> head{0};
+    alignas(64) std::atomic<std::uint64_t> tail{0};
+};
@@ -0,0 +1,251 @@
+#include "profile.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <tuple>
+
+bool Profile::read(const std::string &file)
+{
+    std::ifstream in(file);
+    std::string line;
+    if (!in.is_open() || !std::getline(in, line) || line.rfind("basic-profile 1 ", 0) != 0)
+        return false;
+    source = std::strtoull(line.c_str() + 16, nullptr, 16);
+    counts.clear();
+    total = 0;
+    while (std::getline(in, line))
+    {
+        if (line.empty())
+            continue;
+        // the site after the count is only for people reading the file
+        std::istringstream fields(line);
+        std::string scope;
+        std::uint32_t block;
+        std::uint64_t n;
+        if (!(fields >> scope >> block >> n) || block > (1u << 26))
+            return false;
+        std::vector<std::uint64_t> &scoped = counts[scope];
+        if (scoped.size() <= block)
+            scoped.resize(block + 1);
+        scoped[block] = n;
+        total += n;
+    }
+    return true;
+}
+
+bool Profile::count(const std::string &scope, std::uint32_t block, std::uint64_t &n) const
+{
+    auto found = counts.find(scope);
+    if (found == counts.end() || block >= found->second.size())
+        return false;
+    n = found->second[block];
+    return true;
+}
+
+// lines of a file, empty if it cannot be read
+static std::vector<std::string> sourceLines(const std::string &file)
+{
+    std::vector<std::string> lines;
+    std::ifstream in(file);
+    for (std::string line; std::getline(in, line);)
+        lines.push_back(line);
+    return lines;
+}
+
+// one row of a report: a count, what it counts and the source line it is at
+struct Ranked
+{
+    std::uint64_t n;
+    std::string label;
+    std::string file;
+    std::uint32_t line;
+};
+
+// writes the top rows by count with their share of all and the line's text
+static void writeRanked(std::vector<Ranked> &ranked, std::uint64_t all, std::size_t top, std::ostream &out)
+{
+    std::stable_sort(ranked.begin(), ranked.end(), [](auto &a, auto &b) { return a.n > b.n; });
+    if (ranked.size() > top)
+        ranked.resize(top);
+    std::map<std::string, std::vector<std::string>> texts;
+    for (const Ranked &row : ranked)
+    {
+        auto text = texts.find(row.file);
+        if (text == texts.end())
+            text = texts.emplace(row.file, sourceLines(row.file)).first;
+        std::string source = row.line >= 1 && row.line <= text->second.size() ? text->second[row.line - 1] : "";
+        source.erase(0, source.find_first_not_of(" \t"));
+        char share[80];
+        std::snprintf(share, sizeof(share), "%14llu %6.2f%%  ", (unsigned long long)row.n, 100.0 * row.n / all);
+        out << share << row.label << "  " << source << "\n";
+    }
+}
+
+void hotLines(const std::vector<BlockMap> &maps, const Profile &profile, std::size_t top, std::ostream &out)
+{
+    // a line runs as often as the busiest statement on it, so two statements
+    // of one line in the same block are not counted twice
+    std::map<std::pair<std::string, std::uint32_t>, std::uint64_t> lines;
+    for (const BlockMap &map : maps)
+    {
+        for (auto &[site, block] : map.statements)
+        {
+            std::uint64_t n = 0;
+            if (site.line == 0 || !profile.count(map.scope, block, n))
+                continue;
+            std::uint64_t &line = lines[{site.file, site.line}];
+            line = std::max(line, n);
+        }
+    }
+    std::uint64_t all = 0;
+    std::vector<Ranked> ranked;
+    for (auto &[where, n] : lines)
+    {
+        all += n;
+        if (n > 0)
+            ranked.push_back({n, where.first + ":" + std::to_string(where.second), where.first, where.second});
+    }
+    out << "hot lines, of " << all << " line executions:\n";
+    writeRanked(ranked, all, top, out);
+}
+
+// the kind of frame a site name starts with, if it is a loop's
+static std::size_t loopPrefix(const std::string &name)
+{
+    for (const char *kind : {"while ", "for ", "parallel for "})
+    {
+        std::size_t n = std::strlen(kind);
+        if (name.compare(0, n, kind) == 0)
+            return n;
+    }
+    return 0;
+}
+
+// the source line of each address in a program, through addr2line and the
+// debug info. "?" where it has none, as for an address outside the program.
+static std::vector<std::string> sourceOf(const std::string &program, const std::vector<std::uint64_t> &addresses)
+{
+    std::string quoted = "'";
+    for (char c : program)
+        quoted += c == '\'' ? std::string("'\\''") : std::string(1, c);
+    quoted += "'";
+    std::vector<std::string> found;
+    const std::size_t batch = 512;
+    for (std::size_t at = 0; at < addresses.size(); at += batch)
+    {
+        std::string command = "addr2line -e " + quoted;
+        for (std::size_t k = at; k < std::min(addresses.size(), at + batch); k++)
+        {
+            char hex[24];
+            std::snprintf(hex, sizeof(hex), " %llx", (unsigned long long)addresses[k]);
+            command += hex;
+        }
+        FILE *pipe = popen(command.c_str(), "r");
+        char line[4096];
+        while (pipe != nullptr && found.size() < std::min(addresses.size(), at + batch) &&
+               std::fgets(line, sizeof(line), pipe) != nullptr)
+        {
+            std::string where = line;
+            where.erase(std::min(where.find(" (discriminator"), where.find('\n')));
+            found.push_back(where.compare(0, 2, "??") == 0 || where.size() < 3 || where.substr(where.size() - 2) == ":?" ||
+                                    where.substr(where.size() - 2) == ":0"
+                                ? "?"
+                                : where);
+        }
+        if (pipe != nullptr)
+            pclose(pipe);
+        found.resize(std::min(addresses.size(), at + batch), "?");
+    }
+    return found;
+}
+
+bool sampleReport(const std::string &samples, const std::string &folded, std::size_t top, std::ostream &out)
+{
+    std::ifstream in(samples);
+    std::string header;
+    if (!in.is_open() || !std::getline(in, header) || header.rfind("basic-samples 1 ", 0) != 0)
+        return false;
+    char *rest = nullptr;
+    std::uint64_t bias = std::strtoull(header.c_str() + 16, &rest, 16);
+    std::string program = *rest == ' ' ? rest + 1 : rest;
+
+    // "<count> <address> main;frame;..."
+    std::vector<std::tuple<std::uint64_t, std::uint64_t, std::string>> taken;
+    std::map<std::uint64_t, std::size_t> addresses;
+    for (std::string line; std::getline(in, line);)
+    {
+        std::istringstream fields(line);
+        std::uint64_t n, pc;
+        std::string frames;
+        if (!(fields >> n >> std::hex >> pc) || !std::getline(fields >> std::ws, frames))
+            continue;
+        taken.emplace_back(n, pc, frames);
+        if (pc != 0)
+            addresses.emplace(pc - bias, 0);
+    }
+    std::vector<std::uint64_t> lookup;
+    for (auto &[address, index] : addresses)
+    {
+        index = lookup.size();
+        lookup.push_back(address);
+    }
+    std::vector<std::string> lines = sourceOf(program, lookup);
+
+    // the stacks with their leaf line, as flame graph tools read them
+    std::map<std::string, std::uint64_t> stacks;
+    for (auto &[n, pc, frames] : taken)
+    {
+        std::string leaf = pc == 0 ? "[lost]" : lines[addresses[pc - bias]];
+        stacks[frames + ";" + (leaf == "?" ? "[outside the program]" : leaf)] += n;
+    }
+    std::ofstream write(folded);
+    for (auto &[stack, n] : stacks)
+        write << stack << " " << n << "\n";
+    if (!write)
+        return false;
+
+    // a line gets the samples taken on it, a loop those taken anywhere
+    // inside it, once per stack however often recursion repeats it
+    std::map<std::string, std::uint64_t> hot, loops;
+    std::uint64_t all = 0;
+    for (auto &[stack, n] : stacks)
+    {
+        std::vector<std::string> frames;
+        std::istringstream split(stack);
+        for (std::string frame; std::getline(split, frame, ';');)
+            frames.push_back(frame);
+        all += n;
+        hot[frames.back()] += n;
+        std::sort(frames.begin(), frames.end() - 1);
+        for (auto f = frames.begin(); f != frames.end() - 1; ++f)
+        {
+            if (loopPrefix(*f) > 0 && (f == frames.begin() || *f != *(f - 1)))
+                loops[*f] += n;
+        }
+    }
+
+    auto rank = [](const std::map<std::string, std::uint64_t> &counts)
+    {
+        std::vector<Ranked> ranked;
+        for (auto &[name, n] : counts)
+        {
+            // "[loop ]file:line"
+            std::size_t from = loopPrefix(name), colon = name.rfind(':');
+            if (colon == std::string::npos || colon < from)
+                continue;
+            ranked.push_back({n, name, name.substr(from, colon - from),
+                              std::uint32_t(std::strtoul(name.c_str() + colon + 1, nullptr, 10))});
+        }
+        return ranked;
+    };
+    std::vector<Ranked> byline = rank(hot), inside = rank(loops);
+    out << "hot lines, of " << all << " samples:\n";
+    writeRanked(byline, all, top, out);
+    out << "hot loops, counting everything inside them:\n";
+    writeRanked(inside, all, top, out);
+    return true;
+}
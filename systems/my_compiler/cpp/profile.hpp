@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// a place in the source
+struct Site
+{
+    std::string file;
+    std::uint32_t line = 0;
+};
+
+// the basic blocks of one c function, numbered in the order the code
+// generator met them, and the block each of its statements runs in. an
+// instrumented program counts every block, a later build reads the counts
+// back by scope and number.
+struct BlockMap
+{
+    std::string scope; // main, sub_NAME or the function of a parallel loop
+    std::vector<Site> blocks;
+    std::vector<std::pair<Site, std::uint32_t>> statements;
+};
+
+// block counts written by an instrumented run
+// text format: "basic-profile 1 <source hash>", then one
+// "<scope> <block> <count> <file>:<line>" line per block
+struct Profile
+{
+    std::uint64_t source = 0; // content hash of the program it was taken from
+    std::uint64_t total = 0;  // every block execution
+
+    // false if the file is missing or not a profile
+    bool read(const std::string &file);
+
+    // how often a block ran, false if the profile has no count for it
+    bool count(const std::string &scope, std::uint32_t block, std::uint64_t &n) const;
+
+private:
+    std::unordered_map<std::string, std::vector<std::uint64_t>> counts;
+};
+
+// writes the top source lines by how often they ran, with their text
+void hotLines(const std::vector<BlockMap> &maps, const Profile &profile, std::size_t top, std::ostream &out);
+
+// reads the samples a sampling build wrote, looks up the line of each
+// sampled address in the program's debug info with addr2line, writes the
+// stacks folded ("main;frame;...;file:line n" lines, as flame graph tools
+// read them) and then the top source lines by the samples taken on them and
+// the top loops by the samples taken anywhere inside them. false if the
+// samples cannot be read or the stacks written.
+bool sampleReport(const std::string &samples, const std::string &folded, std::size_t top, std::ostream &out);
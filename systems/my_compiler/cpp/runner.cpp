@@ -0,0 +1,84 @@
+#include "runner.hpp"
+#include "timing.hpp"
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// one worker's instances, locked for the moment it takes from or adds to it
+struct WorkQueue
+{
+    std::mutex lock;
+    std::deque<Instance *> items;
+};
+
+void Runner::run(const std::vector<Instance *> &instances)
+{
+    unsigned n = std::max(1u, threads);
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    for (unsigned k = 0; k < n; k++)
+        queues.push_back(std::make_unique<WorkQueue>());
+    // dealt out in turn, every worker starts with a fair share
+    std::atomic<std::size_t> left{0};
+    for (std::size_t k = 0; k < instances.size(); k++)
+    {
+        if (instances[k]->status != Status::READY)
+            continue;
+        queues[k % n]->items.push_back(instances[k]);
+        left++;
+    }
+    std::atomic<std::uint64_t> stolen{0}, ran{0};
+
+    auto work = [&](unsigned self)
+    {
+        Phase phase("run");
+        WorkQueue &own = *queues[self];
+        while (left.load(std::memory_order_acquire) > 0)
+        {
+            Instance *next = nullptr;
+            {
+                std::lock_guard<std::mutex> guard(own.lock);
+                if (!own.items.empty())
+                {
+                    next = own.items.front();
+                    own.items.pop_front();
+                }
+            }
+            for (unsigned k = 1; next == nullptr && k < n; k++)
+            {
+                WorkQueue &victim = *queues[(self + k) % n];
+                std::lock_guard<std::mutex> guard(victim.lock);
+                if (!victim.items.empty())
+                {
+                    next = victim.items.back();
+                    victim.items.pop_back();
+                    stolen++;
+                }
+            }
+            // everything left is running on other workers right now
+            if (next == nullptr)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+            ran++;
+            if (next->run())
+                left.fetch_sub(1, std::memory_order_release);
+            else
+            {
+                std::lock_guard<std::mutex> guard(own.lock);
+                own.items.push_back(next);
+            }
+        }
+    };
+    std::vector<std::thread> workers;
+    for (unsigned k = 1; k < n; k++)
+        workers.emplace_back(work, k);
+    work(0);
+    for (std::thread &t : workers)
+        t.join();
+    steals += stolen;
+    slices += ran;
+}
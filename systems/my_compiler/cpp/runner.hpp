@@ -0,0 +1,22 @@
+#pragma once
+#include "vm.hpp"
+#include <cstdint>
+#include <vector>
+
+// runs many instances at once on a few threads
+// each worker has a queue of its own: it runs the instance at the front
+// for one quantum and, if it is not finished, puts it at the back, so the
+// instances of one worker take turns. a worker whose queue runs dry steals
+// from the back of another's, so a worker left with long running programs
+// is helped by the ones that finished early.
+struct Runner
+{
+    unsigned threads = 1;
+
+    // what happened, for the time report
+    std::uint64_t steals = 0;
+    std::uint64_t slices = 0;
+
+    // returns once every instance has stopped
+    void run(const std::vector<Instance *> &instances);
+};
@@ -0,0 +1,101 @@
+#include "session.hpp"
+#include "timing.hpp"
+#include <algorithm>
+
+Executor::Executor(unsigned n)
+{
+    for (unsigned k = 0; k < std::max(1u, n); k++)
+        threads.emplace_back(&Executor::work, this);
+}
+
+Executor::~Executor()
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        stopping = true;
+    }
+    ready.notify_all();
+    for (std::thread &t : threads)
+        t.join();
+}
+
+void Executor::post(std::coroutine_handle<> h)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        queue.push_back(h);
+    }
+    ready.notify_one();
+}
+
+void Executor::work()
+{
+    Phase phase("sessions");
+    while (true)
+    {
+        std::coroutine_handle<> next;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            ready.wait(guard, [&] { return stopping || !queue.empty(); });
+            if (queue.empty())
+                return;
+            next = queue.front();
+            queue.pop_front();
+            resumed++;
+        }
+        next.resume();
+    }
+}
+
+// parks the session unless there is something to take already
+bool Inbox::park(std::coroutine_handle<> h)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (!lines.empty() || closed)
+        return false;
+    waiter = h;
+    return true;
+}
+
+// hands a parked session to the pool, outside the lock since it may run at once
+void Inbox::wake(std::unique_lock<std::mutex> &guard)
+{
+    std::coroutine_handle<> h = std::exchange(waiter, {});
+    guard.unlock();
+    if (h)
+        pool.post(h);
+}
+
+void Inbox::post(std::string line)
+{
+    std::unique_lock<std::mutex> guard(lock);
+    lines.push_back(std::move(line));
+    wake(guard);
+}
+
+void Inbox::close()
+{
+    std::unique_lock<std::mutex> guard(lock);
+    closed = true;
+    wake(guard);
+}
+
+std::optional<std::string> Inbox::take()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    if (lines.empty())
+        return std::nullopt;
+    std::string line = std::move(lines.front());
+    lines.pop_front();
+    return line;
+}
+
+Task<std::string> resume(Instance &instance, Executor &pool)
+{
+    // yields between slices, so one busy program does not keep a thread from
+    // the others scheduled on it
+    do
+        co_await pool.schedule();
+    while (!instance.run());
+    co_return std::exchange(instance.output, std::string());
+}
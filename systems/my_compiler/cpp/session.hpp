@@ -0,0 +1,250 @@
+#pragma once
+#include "vm.hpp"
+#include <condition_variable>
+#include <coroutine>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// coroutines for running programs that talk to someone: a program that
+// reaches an input with nothing to read gives its thread back and is only a
+// WAITING instance until it is fed, so thousands of them can wait on a few
+// threads and each can go on on whichever thread is free.
+//
+//   Task<> session(Instance &it, Executor &pool, Inbox &in, std::string &printed)
+//   {
+//       while (true)
+//       {
+//           printed += co_await resume(it, pool); // what it printed until it stopped
+//           if (it.status != Status::WAITING)
+//               break;
+//           if (std::optional<std::string> line = co_await in.next())
+//               it.feed(*line + "\n");
+//           else
+//               it.close();
+//       }
+//   }
+//
+//   it.open = true;
+//   spawn(session(it, pool, in, printed)); // then in.post(line) from anywhere
+
+// a few threads running whatever coroutine was scheduled on them first
+// there is one queue for all of them, so the sessions take turns in the
+// order their slices came in
+class Executor
+{
+public:
+    explicit Executor(unsigned threads);
+    // nothing may be scheduled any more, the threads finish what is queued
+    ~Executor();
+
+    // co_await pool.schedule() goes on on one of the threads
+    auto schedule()
+    {
+        struct Hop
+        {
+            Executor &on;
+            bool await_ready() noexcept { return false; }
+            void await_suspend(std::coroutine_handle<> h) { on.post(h); }
+            void await_resume() noexcept {}
+        };
+        return Hop{*this};
+    }
+
+    // slices run, for the time report
+    std::uint64_t resumed = 0;
+
+private:
+    friend class Inbox;
+    void post(std::coroutine_handle<> h);
+    void work();
+
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<std::coroutine_handle<>> queue;
+    bool stopping = false;
+    std::vector<std::thread> threads;
+};
+
+// where a task keeps its result until it is awaited
+template <typename T>
+struct TaskResult
+{
+    std::optional<T> value;
+    std::exception_ptr failed;
+
+    void return_value(T v) { value = std::move(v); }
+    void unhandled_exception() { failed = std::current_exception(); }
+    T take()
+    {
+        if (failed)
+            std::rethrow_exception(failed);
+        return std::move(*value);
+    }
+};
+
+template <>
+struct TaskResult<void>
+{
+    std::exception_ptr failed;
+
+    void return_void() {}
+    void unhandled_exception() { failed = std::current_exception(); }
+    void take()
+    {
+        if (failed)
+            std::rethrow_exception(failed);
+    }
+};
+
+// a blocked thread waiting for a task, see wait()
+struct TaskLatch
+{
+    std::mutex lock;
+    std::condition_variable opened;
+    bool done = false;
+
+    void open()
+    {
+        // notified under the lock, the waiter may free the latch right after
+        std::lock_guard<std::mutex> guard(lock);
+        done = true;
+        opened.notify_one();
+    }
+};
+
+// a coroutine that starts when it is awaited and, when it finishes, goes
+// straight on with the one awaiting it, on the same thread
+template <typename T = void>
+class Task
+{
+public:
+    struct promise_type : TaskResult<T>
+    {
+        std::coroutine_handle<> next;
+        TaskLatch *latch = nullptr;
+        bool detached = false;
+
+        Task get_return_object() { return Task(std::coroutine_handle<promise_type>::from_promise(*this)); }
+        std::suspend_always initial_suspend() noexcept { return {}; }
+        auto final_suspend() noexcept
+        {
+            struct Finish
+            {
+                bool await_ready() noexcept { return false; }
+                std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> h) noexcept
+                {
+                    promise_type &p = h.promise();
+                    if (p.next)
+                        return p.next;
+                    if (p.latch)
+                    {
+                        // the waiter may destroy the frame as soon as it is open
+                        p.latch->open();
+                        return std::noop_coroutine();
+                    }
+                    if (p.detached)
+                    {
+                        // like a thread nobody joins, a failure has nowhere to go
+                        if (p.failed)
+                            std::terminate();
+                        h.destroy();
+                    }
+                    return std::noop_coroutine();
+                }
+                void await_resume() noexcept {}
+            };
+            return Finish{};
+        }
+    };
+
+    Task(Task &&other) noexcept : h(std::exchange(other.h, {})) {}
+    Task &operator=(Task &&) = delete;
+    ~Task()
+    {
+        if (h)
+            h.destroy();
+    }
+
+    bool await_ready() noexcept { return false; }
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept
+    {
+        h.promise().next = awaiting;
+        return h;
+    }
+    T await_resume() { return h.promise().take(); }
+
+    // for code that is not a coroutine: runs the task and blocks until it
+    // finished, wherever it went meanwhile
+    friend T wait(Task task)
+    {
+        TaskLatch latch;
+        task.h.promise().latch = &latch;
+        task.h.resume();
+        std::unique_lock<std::mutex> guard(latch.lock);
+        latch.opened.wait(guard, [&] { return latch.done; });
+        return task.h.promise().take();
+    }
+
+    // starts a task nobody awaits, on this thread until its first hop, and
+    // frees it when it finishes
+    friend void spawn(Task task)
+    {
+        std::coroutine_handle<promise_type> h = std::exchange(task.h, {});
+        h.promise().detached = true;
+        h.resume();
+    }
+
+private:
+    explicit Task(std::coroutine_handle<promise_type> handle) : h(handle) {}
+    std::coroutine_handle<promise_type> h;
+};
+
+// lines handed to one session from outside, in the order they were posted
+// a session waiting for the next one holds no thread, posting it schedules
+// the session on the pool again
+class Inbox
+{
+public:
+    explicit Inbox(Executor &p) : pool(p) {}
+
+    // co_await in.next() gives the next line, or nothing once closed and empty
+    auto next()
+    {
+        struct Next
+        {
+            Inbox &in;
+            bool await_ready() noexcept { return false; }
+            bool await_suspend(std::coroutine_handle<> h) { return in.park(h); }
+            std::optional<std::string> await_resume() { return in.take(); }
+        };
+        return Next{*this};
+    }
+
+    // from any thread
+    void post(std::string line);
+    void close();
+
+private:
+    bool park(std::coroutine_handle<> h);
+    void wake(std::unique_lock<std::mutex> &guard);
+    std::optional<std::string> take();
+
+    Executor &pool;
+    std::mutex lock;
+    std::deque<std::string> lines;
+    bool closed = false;
+    std::coroutine_handle<> waiter; // the session parked in next(), if any
+};
+
+// runs an instance on the pool, a quantum at a time with the other sessions'
+// slices in between, until it finishes, fails or waits for input. gives
+// back what it printed meanwhile, which it no longer holds.
+// the instance is not touched by anyone else until the task finished.
+Task<std::string> resume(Instance &instance, Executor &pool);
@@ -0,0 +1,185 @@
+#include "timing.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <fstream>
+#include <new>
+#include <sys/resource.h>
+#include <unistd.h>
+
+// counting allocator hook
+// every operator new in the compiler goes through here so a phase can report
+// how many bytes and allocations it caused. relaxed atomics keep it cheap and
+// safe to use from worker threads.
+static std::atomic<std::uint64_t> allocated_bytes{0};
+static std::atomic<std::uint64_t> allocation_count{0};
+
+void *operator new(std::size_t size)
+{
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size)
+{
+    return ::operator new(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+// monotonic clock in microseconds
+static double wallMicros()
+{
+    using namespace std::chrono;
+    return duration<double, std::micro>(steady_clock::now().time_since_epoch()).count();
+}
+
+// process cpu time (all threads) in microseconds
+static double cpuMicros()
+{
+    timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+Sample Sample::now(double start_us)
+{
+    Sample s;
+    s.wall_us = wallMicros() - start_us;
+    s.cpu_us = cpuMicros();
+    s.bytes = allocated_bytes.load(std::memory_order_relaxed);
+    s.allocs = allocation_count.load(std::memory_order_relaxed);
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+        s.peak_rss_kb = usage.ru_maxrss;
+    return s;
+}
+
+TimeReport::TimeReport() : start_us(wallMicros())
+{
+    // the thread that creates the report (main) gets index 0
+    threadIndex();
+}
+
+void TimeReport::Record(const std::string &name, const Sample &begin, const Sample &end)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    phases.push_back(PhaseRecord{name, threadIndex(), begin, end});
+}
+
+// extra line printed under the table
+void TimeReport::Note(const std::string &line)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    notes.push_back(line);
+}
+
+// prints one row per phase, worker threads are tagged with their index
+void TimeReport::Print(std::ostream &os)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    char line[160];
+    std::snprintf(line, sizeof(line), "%-20s %10s %10s %14s %10s %12s\n",
+                  "phase", "wall ms", "cpu ms", "alloc bytes", "allocs", "peak rss KiB");
+    os << line;
+    for (const PhaseRecord &p : phases)
+    {
+        std::string name = p.tid == 0 ? p.name : p.name + " [t" + std::to_string(p.tid) + "]";
+        std::snprintf(line, sizeof(line), "%-20s %10.3f %10.3f %14llu %10llu %12ld\n",
+                      name.c_str(),
+                      (p.end.wall_us - p.begin.wall_us) / 1e3,
+                      (p.end.cpu_us - p.begin.cpu_us) / 1e3,
+                      (unsigned long long)(p.end.bytes - p.begin.bytes),
+                      (unsigned long long)(p.end.allocs - p.begin.allocs),
+                      p.end.peak_rss_kb);
+        os << line;
+    }
+    Sample total = Sample::now(start_us);
+    std::snprintf(line, sizeof(line), "%-20s %10.3f %10s %14llu %10llu %12ld\n",
+                  "total", total.wall_us / 1e3, "",
+                  (unsigned long long)total.bytes, (unsigned long long)total.allocs,
+                  total.peak_rss_kb);
+    os << line;
+    for (const std::string &note : notes)
+        os << note << "\n";
+}
+
+// writes the phases in chrome trace-event format (complete "X" events)
+bool TimeReport::WriteTrace(const std::string &filename)
+{
+    std::ofstream out(filename);
+    if (!out.is_open())
+    {
+        return false;
+    }
+    std::lock_guard<std::mutex> guard(lock);
+    out << "{\"traceEvents\":[\n";
+    int pid = getpid();
+    for (size_t i = 0; i < phases.size(); i++)
+    {
+        const PhaseRecord &p = phases[i];
+        char event[512];
+        std::snprintf(event, sizeof(event),
+                      "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+                      "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"cpu_us\":%.3f,"
+                      "\"alloc_bytes\":%llu,\"allocs\":%llu,\"peak_rss_kb\":%ld}}",
+                      p.name.c_str(), pid, p.tid, p.begin.wall_us,
+                      p.end.wall_us - p.begin.wall_us, p.end.cpu_us - p.begin.cpu_us,
+                      (unsigned long long)(p.end.bytes - p.begin.bytes),
+                      (unsigned long long)(p.end.allocs - p.begin.allocs),
+                      p.end.peak_rss_kb);
+        out << event << (i + 1 < phases.size() ? ",\n" : "\n");
+    }
+    out << "],\"displayTimeUnit\":\"ms\"}\n";
+    return out.good();
+}
+
+int threadIndex()
+{
+    static std::atomic<int> next{0};
+    thread_local int index = next.fetch_add(1);
+    return index;
+}
+
+// never destroyed, so worker threads can still record while the process exits
+TimeReport &timeReport()
+{
+    static TimeReport *report = new TimeReport;
+    return *report;
+}
+
+Phase::Phase(const char *n) : name(n)
+{
+    if (timeReport().enabled)
+        begin = Sample::now(timeReport().start_us);
+}
+
+Phase::~Phase()
+{
+    TimeReport &report = timeReport();
+    if (report.enabled)
+        report.Record(name, begin, Sample::now(report.start_us));
+}
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// snapshot of the process counters we care about at one point in time
+struct Sample
+{
+    double wall_us = 0;        // microseconds since the report started
+    double cpu_us = 0;         // process cpu time in microseconds
+    std::uint64_t bytes = 0;   // bytes handed out by operator new so far
+    std::uint64_t allocs = 0;  // number of operator new calls so far
+    long peak_rss_kb = 0;      // high water mark of resident memory
+
+    static Sample now(double start_us);
+};
+
+// one finished phase (or sub-phase on a worker thread)
+struct PhaseRecord
+{
+    std::string name;
+    int tid;
+    Sample begin;
+    Sample end;
+};
+
+// collects per-phase timings for --time-report and --trace
+struct TimeReport
+{
+    bool enabled = false;
+    double start_us = 0;
+    std::vector<PhaseRecord> phases;
+    std::vector<std::string> notes;
+    std::mutex lock;
+
+    TimeReport();
+    void Record(const std::string &name, const Sample &begin, const Sample &end);
+    void Note(const std::string &line);
+    void Print(std::ostream &os);
+    bool WriteTrace(const std::string &filename);
+};
+
+// small id for the calling thread so trace rows stay readable
+int threadIndex();
+
+// the report shared by every phase in this process
+TimeReport &timeReport();
+
+// scoped guard that times everything until it goes out of scope
+struct Phase
+{
+    const char *name;
+    Sample begin;
+
+    explicit Phase(const char *n);
+    ~Phase();
+};
@@ -0,0 +1,747 @@
+#include "vm.hpp"
+#include <cctype>
+#include <climits>
+#include <ctime>
+#include <stdexcept>
+#include <unordered_set>
+
+// a program the c compiler would refuse too, with the same wording codegen uses
+struct CompileError : std::runtime_error
+{
+    using std::runtime_error::runtime_error;
+};
+
+// a call waiting for every sub to be known
+struct CallSite
+{
+    std::uint32_t function;
+    std::uint32_t pc;
+    std::uint32_t routine; // name id
+    std::uint32_t args;
+};
+
+// writes statements as bytecode, one function at a time
+struct Assembler
+{
+    Program &program;
+    const std::vector<Expr> &nodes;
+    const Interner &names;
+
+    std::vector<const Stmt *> subs; // set aside by main, written after it
+    std::vector<CallSite> calls;
+
+    // the function being written, and its names
+    std::uint32_t current = 0;
+    std::vector<int> slot;   // by id, -1 until assigned
+    std::vector<int> array;  // by id, -1 until dimmed
+    std::vector<int> labels; // by id, -1 until defined
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> gotos; // pc, label id
+
+    Assembler(Program &p, const std::vector<Expr> &n, const Interner &i) : program(p), nodes(n), names(i) {}
+
+    Function &fn() { return program.functions[current]; }
+    std::uint32_t pc() { return fn().code.size(); }
+    std::uint32_t emit(Op op, std::int32_t arg = 0)
+    {
+        fn().code.push_back(Instr{op, arg});
+        return pc() - 1;
+    }
+
+    void begin(const std::string &name);
+    void finish();
+    int declare(std::uint32_t id);
+    int variable(std::uint32_t id);
+    int arrayOf(std::uint32_t id);
+    std::uint32_t temporary() { return fn().slots++; }
+    void statement(const Stmt &s);
+    void forLoop(const Stmt &s);
+    void expr(int root);
+};
+
+// starts a new function with empty name tables
+void Assembler::begin(const std::string &name)
+{
+    current = program.functions.size();
+    program.functions.push_back(Function{name, 0, 0, {}});
+    std::size_t n = names.size();
+    slot.assign(n, -1);
+    array.assign(n, -1);
+    labels.assign(n, -1);
+    gotos.clear();
+}
+
+// returns 0 off the end, then points every goto at its label. a jump back
+// is a loop as far as the scheduler is concerned.
+void Assembler::finish()
+{
+    emit(Op::PUSH, 0);
+    emit(Op::RET);
+    for (auto &[at, id] : gotos)
+    {
+        if (labels[id] < 0)
+            throw CompileError("goto to undefined label: " + names.name(id));
+        Instr &jump = fn().code[at];
+        jump.arg = labels[id];
+        jump.op = std::uint32_t(labels[id]) <= at ? Op::LOOP : Op::JUMP;
+    }
+}
+
+// the slot of a variable being assigned, new the first time
+int Assembler::declare(std::uint32_t id)
+{
+    if (array[id] >= 0)
+        throw CompileError("array needs an index: " + names.name(id));
+    if (slot[id] < 0)
+        slot[id] = temporary();
+    return slot[id];
+}
+
+// the slot of a variable being read
+int Assembler::variable(std::uint32_t id)
+{
+    if (array[id] >= 0)
+        throw CompileError("array needs an index: " + names.name(id));
+    if (slot[id] < 0)
+        throw CompileError("variable used before it is assigned: " + names.name(id));
+    return slot[id];
+}
+
+int Assembler::arrayOf(std::uint32_t id)
+{
+    if (array[id] >= 0)
+        return array[id];
+    if (slot[id] >= 0)
+        throw CompileError("not an array: " + names.name(id));
+    throw CompileError("array used before its dim: " + names.name(id));
+}
+
+void Assembler::statement(const Stmt &s)
+{
+    switch (s.kind)
+    {
+    case Tokens::PRINT:
+        if (s.expr < 0)
+        {
+            program.strings.push_back(s.text);
+            emit(Op::PRINTS, program.strings.size() - 1);
+        }
+        else
+        {
+            expr(s.expr);
+            emit(Op::PRINT);
+        }
+        break;
+    case Tokens::LET:
+        if (s.index >= 0)
+        {
+            int a = arrayOf(s.id);
+            expr(s.index);
+            expr(s.expr);
+            emit(Op::STOREA, a);
+            break;
+        }
+        // declared before the value is worked out, like the c declaration
+        {
+            int v = declare(s.id);
+            expr(s.expr);
+            emit(Op::STORE, v);
+        }
+        break;
+    case Tokens::INPUT:
+        if (s.index >= 0)
+        {
+            int a = arrayOf(s.id);
+            expr(s.index);
+            emit(Op::INPUTA, a);
+        }
+        else
+            emit(Op::INPUT, declare(s.id));
+        break;
+    case Tokens::LABEL:
+        if (labels[s.id] >= 0)
+            throw CompileError("label defined twice: " + names.name(s.id));
+        labels[s.id] = pc();
+        break;
+    case Tokens::GOTO:
+        gotos.emplace_back(emit(Op::JUMP), s.id);
+        break;
+    case Tokens::CALL:
+        expr(s.expr);
+        emit(Op::POP);
+        break;
+    case Tokens::RETURN:
+        if (s.expr < 0)
+            emit(Op::PUSH, 0);
+        else
+            expr(s.expr);
+        emit(Op::RET);
+        break;
+    case Tokens::DIM:
+    {
+        if (slot[s.id] >= 0 || array[s.id] >= 0)
+            throw CompileError("dim of a name already in use: " + names.name(s.id));
+        std::uint32_t size = s.text.size() > 9 ? 0 : std::stoul(s.text);
+        if (size == 0)
+            throw CompileError("array size must be from 1 to 999999999: " + names.name(s.id));
+        array[s.id] = program.arrays.size();
+        program.arrays.push_back(size);
+        break;
+    }
+    case Tokens::SUB:
+        if (current != 0)
+            throw CompileError("sub must be at top level: " + names.name(s.id));
+        subs.push_back(&s);
+        break;
+    case Tokens::INCLUDE:
+        for (const Stmt &inner : s.body)
+            statement(inner);
+        break;
+    case Tokens::IF:
+    {
+        expr(s.expr);
+        std::uint32_t skip = emit(Op::JUMPZ);
+        for (const Stmt &inner : s.body)
+            statement(inner);
+        fn().code[skip].arg = pc();
+        break;
+    }
+    case Tokens::WHILE:
+    {
+        std::uint32_t top = pc();
+        expr(s.expr);
+        std::uint32_t exit = emit(Op::JUMPZ);
+        for (const Stmt &inner : s.body)
+            statement(inner);
+        emit(Op::LOOP, top);
+        fn().code[exit].arg = pc();
+        break;
+    }
+    case Tokens::FOR:
+        forLoop(s);
+        break;
+    default:
+        break;
+    }
+}
+
+// every statement in list and below, in order
+template <typename Fn>
+static void eachStatement(const std::vector<Stmt> &list, Fn fn)
+{
+    for (const Stmt &s : list)
+    {
+        fn(s);
+        eachStatement(s.body, fn);
+    }
+}
+
+// a for with its bounds worked out once. a parallel one runs its
+// iterations in order, which is one of the orders the threads could have
+// picked; what it may not leave behind, the values of the scalars it
+// assigns, is put back afterwards.
+void Assembler::forLoop(const Stmt &s)
+{
+    std::vector<std::pair<int, std::uint32_t>> saved; // slot, saved in
+    if (s.parallel)
+    {
+        std::unordered_set<std::uint32_t> reduced, seen;
+        for (std::size_t k = 1; k < s.params.size(); k += 2)
+            reduced.insert(s.params[k]);
+        eachStatement(s.body, [&](const Stmt &inner)
+                      {
+                          bool scalar = inner.kind == Tokens::FOR ||
+                                        ((inner.kind == Tokens::LET || inner.kind == Tokens::INPUT) && inner.index < 0);
+                          if (scalar && inner.id != s.id && !reduced.count(inner.id) && slot[inner.id] >= 0 &&
+                              seen.insert(inner.id).second)
+                              saved.emplace_back(slot[inner.id], 0);
+                      });
+        for (auto &[v, keep] : saved)
+        {
+            keep = temporary();
+            emit(Op::LOAD, v);
+            emit(Op::STORE, keep);
+        }
+    }
+
+    const Expr &bounds = nodes[s.expr];
+    int var = declare(s.id);
+    expr(bounds.lhs);
+    emit(Op::STORE, var);
+    std::uint32_t last = temporary();
+    expr(bounds.rhs);
+    emit(Op::STORE, last);
+    std::uint32_t top = pc();
+    emit(Op::LOAD, var);
+    emit(Op::LOAD, last);
+    emit(Op::LE);
+    std::uint32_t exit = emit(Op::JUMPZ);
+    for (const Stmt &inner : s.body)
+        statement(inner);
+    emit(Op::LOAD, var);
+    emit(Op::PUSH, 1);
+    emit(Op::ADD);
+    emit(Op::STORE, var);
+    emit(Op::LOOP, top);
+    fn().code[exit].arg = pc();
+
+    for (auto &[v, keep] : saved)
+    {
+        emit(Op::LOAD, keep);
+        emit(Op::STORE, v);
+    }
+}
+
+// an integer literal, wrapped to 32 bits like the c assignment would
+static std::int32_t literal(const std::string &digits)
+{
+    std::uint32_t v = 0;
+    for (char ch : digits)
+        v = v * 10 + std::uint32_t(ch - '0');
+    return std::int32_t(v);
+}
+
+// post order over the tree with an explicit stack, so deep expressions do
+// not recurse
+void Assembler::expr(int root)
+{
+    struct Work
+    {
+        int node;
+        bool ready; // operands are already on the stack
+    };
+    std::vector<Work> work{{root, false}};
+    while (!work.empty())
+    {
+        Work w = work.back();
+        work.pop_back();
+        const Expr &e = nodes[w.node];
+        if (!w.ready)
+        {
+            switch (e.kind)
+            {
+            case Tokens::INTEGER:
+                emit(Op::PUSH, literal(e.text));
+                continue;
+            case Tokens::IDENT:
+                emit(Op::LOAD, variable(e.id));
+                continue;
+            case Tokens::CALL:
+            {
+                // arguments left to right
+                std::vector<int> args;
+                for (int arg = e.lhs; arg >= 0; arg = nodes[arg].rhs)
+                    args.push_back(nodes[arg].lhs);
+                work.push_back({w.node, true});
+                for (auto it = args.rbegin(); it != args.rend(); ++it)
+                    work.push_back({*it, false});
+                continue;
+            }
+            default:
+                work.push_back({w.node, true});
+                if (e.rhs >= 0)
+                    work.push_back({e.rhs, false});
+                if (e.lhs >= 0)
+                    work.push_back({e.lhs, false});
+                continue;
+            }
+        }
+
+        switch (e.kind)
+        {
+        case Tokens::LBRACKET:
+            emit(Op::LOADA, arrayOf(e.id));
+            break;
+        case Tokens::CALL:
+        {
+            std::uint32_t args = 0;
+            for (int arg = e.lhs; arg >= 0; arg = nodes[arg].rhs)
+                args++;
+            calls.push_back(CallSite{current, emit(Op::CALL), e.id, args});
+            break;
+        }
+        case Tokens::NOT:
+            emit(Op::NOT);
+            break;
+        case Tokens::PLUS:
+            if (e.rhs >= 0)
+                emit(Op::ADD);
+            break;
+        case Tokens::MINUS:
+            emit(e.rhs >= 0 ? Op::SUB : Op::NEG);
+            break;
+        case Tokens::TIMES:
+            emit(Op::MUL);
+            break;
+        case Tokens::DIVIDE:
+            emit(Op::DIV);
+            break;
+        case Tokens::COMP:
+            emit(e.text == "==" ? Op::EQ : e.text == "!=" ? Op::NE : e.text == "<" ? Op::LT : e.text == "<=" ? Op::LE
+                                                           : e.text == ">" ? Op::GT : Op::GE);
+            break;
+        default:
+            throw CompileError("unexpected expression");
+        }
+    }
+}
+
+bool Program::compile(const std::vector<Stmt> &body, const std::vector<Expr> &nodes, const Interner &names,
+                      std::string &error)
+{
+    functions.clear();
+    strings.clear();
+    arrays.clear();
+    Assembler as(*this, nodes, names);
+    try
+    {
+        as.begin("main");
+        for (const Stmt &s : body)
+            as.statement(s);
+        as.finish();
+
+        // subs see their parameters and what they assign, nothing of main
+        std::vector<int> byid(names.size(), -1);
+        for (const Stmt *sub : as.subs)
+        {
+            if (byid[sub->id] >= 0)
+                throw CompileError("sub defined twice: " + names.name(sub->id));
+            as.begin(names.name(sub->id));
+            byid[sub->id] = as.current;
+            for (std::uint32_t param : sub->params)
+                as.slot[param] = as.temporary();
+            as.fn().params = sub->params.size();
+            for (const Stmt &s : sub->body)
+                as.statement(s);
+            as.finish();
+        }
+
+        for (const CallSite &call : as.calls)
+        {
+            int k = byid[call.routine];
+            if (k < 0)
+                throw CompileError("call to undefined sub: " + names.name(call.routine));
+            if (functions[k].params != call.args)
+                throw CompileError("sub " + names.name(call.routine) + " takes " + std::to_string(functions[k].params) +
+                                   " arguments but got " + std::to_string(call.args));
+            functions[call.function].code[call.pc].arg = k;
+        }
+    }
+    catch (const CompileError &e)
+    {
+        error = e.what();
+        return false;
+    }
+    return true;
+}
+
+Instance::Instance(const Program &p, const Limits &l, std::string stdin_text)
+    : program(p), limits(l), input(std::move(stdin_text))
+{
+    // the arrays exist from the start, like static ones. the cap is checked
+    // before anything is allocated.
+    for (std::uint32_t size : program.arrays)
+        fixed += std::uint64_t(size) * sizeof(std::int32_t);
+    frames.push_back(Frame{0, 0, 0});
+    slots.assign(program.functions[0].slots, 0);
+    if (memory() > limits.memory)
+    {
+        stopWith(Status::OVER_MEMORY, "needs " + std::to_string(memory()) + " bytes");
+        return;
+    }
+    arrays.reserve(program.arrays.size());
+    for (std::uint32_t size : program.arrays)
+        arrays.emplace_back(size, 0);
+}
+
+// bytes the instance holds on to
+std::uint64_t Instance::memory() const
+{
+    return fixed + output.size() + (slots.size() + stack.size()) * sizeof(std::int32_t) +
+           frames.size() * sizeof(Frame);
+}
+
+// ends the run, always false so a failing op can return it
+bool Instance::stopWith(Status s, const std::string &why)
+{
+    status = s;
+    error = why;
+    return false;
+}
+
+// the next integer of stdin like scanf("%d") reads it, 0 if there is none
+std::int32_t Instance::readInt()
+{
+    while (inputat < input.size() && std::isspace((unsigned char)input[inputat]))
+        inputat++;
+    bool negative = false;
+    if (inputat < input.size() && (input[inputat] == '-' || input[inputat] == '+'))
+        negative = input[inputat++] == '-';
+    std::uint32_t v = 0;
+    while (inputat < input.size() && std::isdigit((unsigned char)input[inputat]))
+        v = v * 10 + std::uint32_t(input[inputat++] - '0');
+    return std::int32_t(negative ? 0u - v : v);
+}
+
+// whether readInt can tell what the next number is: one is there with
+// something after it, or stdin has something that is not a number, or it ended
+bool Instance::hasInt() const
+{
+    if (!open)
+        return true;
+    std::size_t at = inputat;
+    while (at < input.size() && std::isspace((unsigned char)input[at]))
+        at++;
+    if (at < input.size() && (input[at] == '-' || input[at] == '+'))
+        at++;
+    while (at < input.size() && std::isdigit((unsigned char)input[at]))
+        at++;
+    return at < input.size();
+}
+
+void Instance::feed(const std::string &text)
+{
+    // what was read already is not needed again
+    input.erase(0, inputat);
+    inputat = 0;
+    input += text;
+    if (status == Status::WAITING)
+        status = Status::READY;
+}
+
+void Instance::close()
+{
+    open = false;
+    if (status == Status::WAITING)
+        status = Status::READY;
+}
+
+bool Instance::run()
+{
+    if (status != Status::READY)
+        return true;
+    timespec begin, end;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &begin);
+    slices++;
+    execute(steps + limits.quantum);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &end);
+    cpu_ns += std::uint64_t(end.tv_sec - begin.tv_sec) * 1000000000 + end.tv_nsec - begin.tv_nsec;
+    return status != Status::READY;
+}
+
+// runs instructions until the program ends or stops, or the first back-edge
+// or call at or past stop. true while it may go on.
+bool Instance::execute(std::uint64_t stop)
+{
+    const Function *fn = &program.functions[frames.back().function];
+    const Instr *code = fn->code.data();
+    std::uint32_t pc = frames.back().pc;
+    std::int32_t *local = slots.data() + frames.back().base;
+    std::uint64_t n = steps;
+
+    // arithmetic wraps around like the c program's would on any usual machine
+    auto binary = [&](auto op)
+    {
+        std::int32_t b = stack.back();
+        stack.pop_back();
+        stack.back() = op(stack.back(), b);
+    };
+    auto wrap = [](std::uint32_t v) { return std::int32_t(v); };
+    // saves where this slice stopped
+    auto pause = [&]
+    {
+        frames.back().pc = pc;
+        steps = n;
+        return true;
+    };
+    // stops before the input op just fetched, which runs again once fed
+    auto wait = [&]
+    {
+        frames.back().pc = pc - 1;
+        steps = n - 1;
+        status = Status::WAITING;
+        return false;
+    };
+
+    while (true)
+    {
+        const Instr in = code[pc++];
+        n++;
+        switch (in.op)
+        {
+        case Op::PUSH:
+            stack.push_back(in.arg);
+            break;
+        case Op::LOAD:
+            stack.push_back(local[in.arg]);
+            break;
+        case Op::STORE:
+            local[in.arg] = stack.back();
+            stack.pop_back();
+            break;
+        case Op::INPUTA:
+            if (!hasInt())
+                return wait();
+            [[fallthrough]];
+        case Op::LOADA:
+        case Op::STOREA:
+        {
+            std::int32_t value = 0;
+            if (in.op == Op::STOREA)
+            {
+                value = stack.back();
+                stack.pop_back();
+            }
+            std::int32_t i = stack.back();
+            stack.pop_back();
+            std::vector<std::int32_t> &a = arrays[in.arg];
+            if (i < 0 || std::uint32_t(i) >= a.size())
+            {
+                steps = n;
+                return stopWith(Status::FAILED, "array index " + std::to_string(i) + " out of range 0.." +
+                                                    std::to_string(a.size() - 1));
+            }
+            if (in.op == Op::LOADA)
+                stack.push_back(a[i]);
+            else
+                a[i] = in.op == Op::STOREA ? value : readInt();
+            break;
+        }
+        case Op::INPUT:
+            if (!hasInt())
+                return wait();
+            local[in.arg] = readInt();
+            break;
+        case Op::ADD:
+            binary([&](std::int32_t a, std::int32_t b) { return wrap(std::uint32_t(a) + std::uint32_t(b)); });
+            break;
+        case Op::SUB:
+            binary([&](std::int32_t a, std::int32_t b) { return wrap(std::uint32_t(a) - std::uint32_t(b)); });
+            break;
+        case Op::MUL:
+            binary([&](std::int32_t a, std::int32_t b) { return wrap(std::uint32_t(a) * std::uint32_t(b)); });
+            break;
+        case Op::DIV:
+            if (stack.back() == 0)
+            {
+                steps = n;
+                return stopWith(Status::FAILED, "division by zero");
+            }
+            binary([](std::int32_t a, std::int32_t b) { return b == -1 ? std::int32_t(0u - std::uint32_t(a)) : a / b; });
+            break;
+        case Op::NEG:
+            stack.back() = wrap(0u - std::uint32_t(stack.back()));
+            break;
+        case Op::NOT:
+            stack.back() = !stack.back();
+            break;
+        case Op::EQ:
+            binary([](std::int32_t a, std::int32_t b) { return std::int32_t(a == b); });
+            break;
+        case Op::NE:
+            binary([](std::int32_t a, std::int32_t b) { return std::int32_t(a != b); });
+            break;
+        case Op::LT:
+            binary([](std::int32_t a, std::int32_t b) { return std::int32_t(a < b); });
+            break;
+        case Op::LE:
+            binary([](std::int32_t a, std::int32_t b) { return std::int32_t(a <= b); });
+            break;
+        case Op::GT:
+            binary([](std::int32_t a, std::int32_t b) { return std::int32_t(a > b); });
+            break;
+        case Op::GE:
+            binary([](std::int32_t a, std::int32_t b) { return std::int32_t(a >= b); });
+            break;
+        case Op::JUMP:
+            pc = in.arg;
+            break;
+        case Op::JUMPZ:
+            if (stack.back() == 0)
+                pc = in.arg;
+            stack.pop_back();
+            break;
+        case Op::LOOP:
+            pc = in.arg;
+            if (n >= limits.budget)
+            {
+                steps = n;
+                return stopWith(Status::OVER_BUDGET, "used its " + std::to_string(limits.budget) + " instructions");
+            }
+            if (n >= stop)
+                return pause();
+            break;
+        case Op::PRINT:
+            output += std::to_string(stack.back());
+            output += '\n';
+            stack.pop_back();
+            if (memory() > limits.memory)
+            {
+                steps = n;
+                return stopWith(Status::OVER_MEMORY, "output passed the memory cap");
+            }
+            break;
+        case Op::PRINTS:
+            output += program.strings[in.arg];
+            output += '\n';
+            if (memory() > limits.memory)
+            {
+                steps = n;
+                return stopWith(Status::OVER_MEMORY, "output passed the memory cap");
+            }
+            break;
+        case Op::CALL:
+        {
+            // recursion has no back-edge, so calls are checked the same way
+            if (n >= limits.budget)
+            {
+                steps = n;
+                return stopWith(Status::OVER_BUDGET, "used its " + std::to_string(limits.budget) + " instructions");
+            }
+            const Function &callee = program.functions[in.arg];
+            frames.back().pc = pc;
+            std::uint32_t base = slots.size();
+            slots.resize(base + callee.slots, 0);
+            std::size_t from = stack.size() - callee.params;
+            for (std::uint32_t k = 0; k < callee.params; k++)
+                slots[base + k] = stack[from + k];
+            stack.resize(from);
+            frames.push_back(Frame{std::uint32_t(in.arg), 0, base});
+            if (memory() > limits.memory)
+            {
+                steps = n;
+                return stopWith(Status::OVER_MEMORY, "call depth passed the memory cap");
+            }
+            fn = &callee;
+            code = fn->code.data();
+            pc = 0;
+            local = slots.data() + base;
+            if (n >= stop)
+                return pause();
+            break;
+        }
+        case Op::RET:
+        {
+            std::int32_t value = stack.back();
+            stack.pop_back();
+            slots.resize(frames.back().base);
+            frames.pop_back();
+            if (frames.empty())
+            {
+                steps = n;
+                status = Status::DONE;
+                exitcode = value;
+                return false;
+            }
+            stack.push_back(value);
+            fn = &program.functions[frames.back().function];
+            code = fn->code.data();
+            pc = frames.back().pc;
+            local = slots.data() + frames.back().base;
+            break;
+        }
+        case Op::POP:
+            stack.pop_back();
+            break;
+        }
+    }
+}
@@ -0,0 +1,139 @@
+#pragma once
+#include "lexer.hpp"
+#include "parser.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// instructions of the in-process runner, a stack machine over 32 bit
+// integers. arg is a constant, a slot of the current frame, an array, a
+// string, a function or a jump target, depending on the op.
+enum class Op : std::uint8_t
+{
+    PUSH,   // pushes arg
+    LOAD,   // pushes slot arg
+    STORE,  // pops into slot arg
+    LOADA,  // pops an index, pushes that element of array arg
+    STOREA, // pops a value, then an index, and stores into array arg
+    INPUT,  // reads an integer into slot arg
+    INPUTA, // pops an index, reads an integer into that element of array arg
+    ADD,
+    SUB,
+    MUL,
+    DIV,
+    NEG,
+    NOT,
+    EQ,
+    NE,
+    LT,
+    LE,
+    GT,
+    GE,
+    JUMP,   // goes forward to arg
+    JUMPZ,  // pops, goes to arg if it was 0
+    LOOP,   // goes back to arg, the one place besides CALL a slice may end
+    PRINT,  // pops and prints it
+    PRINTS, // prints string arg
+    CALL,   // calls function arg, its arguments are on the stack in order
+    RET,    // pops the value and returns it
+    POP
+};
+
+struct Instr
+{
+    Op op;
+    std::int32_t arg = 0;
+};
+
+// main or a sub as bytecode
+struct Function
+{
+    std::string name;
+    std::uint32_t params = 0;
+    std::uint32_t slots = 0; // parameters first, then variables and loop temporaries
+    std::vector<Instr> code;
+};
+
+// a parsed program translated for the runner, shared read only by every
+// instance of it
+struct Program
+{
+    std::vector<Function> functions;   // main first
+    std::vector<std::string> strings;  // printed strings
+    std::vector<std::uint32_t> arrays; // elements of each dim, all static like the c ones
+
+    // translates a parsed program with its includes already spliced in,
+    // false with a message if it would not compile to c either
+    bool compile(const std::vector<Stmt> &body, const std::vector<Expr> &nodes, const Interner &names,
+                 std::string &error);
+};
+
+// what one instance may use
+struct Limits
+{
+    std::uint64_t budget = 1000000000; // instructions over the whole run
+    std::uint64_t memory = 64 << 20;   // bytes of arrays, frames, variables and buffered output
+    std::uint32_t quantum = 100000;    // instructions before it yields at a back-edge or call
+};
+
+enum class Status : std::uint8_t
+{
+    READY,       // can run another slice
+    WAITING,     // reached an input that its stdin has no number for yet
+    DONE,        // ran to the end, exitcode is what main returned
+    FAILED,      // stopped by a run time error
+    OVER_BUDGET, // used up its instructions
+    OVER_MEMORY  // needed more than its memory cap
+};
+
+// one run of a program, with its own memory, stdin and stdout
+// everything it needs between slices is in here, so each slice may run on a
+// different thread (but one at a time). that is also all a program waiting
+// for input holds: its variables, arrays, frames and where each one is.
+struct Instance
+{
+    const Program &program;
+    Limits limits;
+    std::string input;  // stdin not read yet
+    std::string output; // stdout so far
+    bool open = false;  // more stdin may come, so running out of it waits instead of reading 0
+    Status status = Status::READY;
+    int exitcode = 0;
+    std::string error; // why it stopped, unless it is DONE
+
+    // accounting
+    std::uint64_t steps = 0;  // instructions run
+    std::uint64_t slices = 0; // times it was scheduled
+    std::uint64_t cpu_ns = 0; // thread cpu time over all slices
+
+    Instance(const Program &p, const Limits &l, std::string stdin_text);
+
+    // runs until the instance stops or has used its quantum, true once it
+    // stopped: finished, failed, or WAITING until it is fed
+    bool run();
+
+    // appends to stdin, a WAITING instance can run again
+    void feed(const std::string &text);
+    // no more stdin will come, inputs past its end read 0 from now on
+    void close();
+
+private:
+    struct Frame
+    {
+        std::uint32_t function;
+        std::uint32_t pc;
+        std::uint32_t base; // first slot
+    };
+    std::vector<Frame> frames;
+    std::vector<std::int32_t> slots;
+    std::vector<std::int32_t> stack;
+    std::vector<std::vector<std::int32_t>> arrays;
+    std::size_t inputat = 0;
+    std::uint64_t fixed = 0; // bytes of the arrays
+
+    bool execute(std::uint64_t stop);
+    bool stopWith(Status s, const std::string &why);
+    std::uint64_t memory() const;
+    std::int32_t readInt();
+    bool hasInt() const;
+};
@@ -0,0 +1,229 @@
+// the constexpr frontend of embed.hpp makes exactly the bytecode the runner's
+// frontend makes (tokenizeRange, Parser, Program::compile) of every sample,
+// and refuses the same programs with the same message and line
+//
+// usage: ./tests/embed_test   (built and run by make check)
+
+#include "embed.hpp"
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// the runner's frontend, as --run drives it on a file without includes
+static bool compileAtRunTime(std::string_view source, Program &program, std::string &error, std::uint32_t &line)
+{
+    std::string text(source);
+    Interner names;
+    std::vector<Token> tokens;
+    std::size_t i = 0;
+    if (!tokenizeRange(text, i, text.size(), names, tokens))
+    {
+        error = "Must have closing quote";
+        line = 1 + std::count(text.begin(), text.begin() + i, '\n');
+        return false;
+    }
+    Parser parser(tokens);
+    parser.recover = true;
+    parser.text = &text;
+    std::vector<Stmt> body;
+    while (!parser.atend())
+        body.push_back(parser.statement());
+    if (const Stmt *bad = firstError(body))
+    {
+        error = bad->text;
+        line = bad->line;
+        return false;
+    }
+    line = 0;
+    return program.compile(body, parser.nodes, names, error);
+}
+
+static bool sameProgram(const Program &a, const Program &b)
+{
+    if (a.functions.size() != b.functions.size() || a.strings != b.strings || a.arrays != b.arrays)
+        return false;
+    for (std::size_t k = 0; k < a.functions.size(); k++)
+    {
+        const Function &f = a.functions[k];
+        const Function &g = b.functions[k];
+        if (f.name != g.name || f.params != g.params || f.slots != g.slots || f.code.size() != g.code.size())
+            return false;
+        for (std::size_t pc = 0; pc < f.code.size(); pc++)
+            if (f.code[pc].op != g.code[pc].op || f.code[pc].arg != g.code[pc].arg)
+                return false;
+    }
+    return true;
+}
+
+static int failed = 0;
+
+// embeds the sample and checks its image against the run time compile, and
+// that both run to the same output on input
+template <basic_source Source>
+static void sample(const char *name, const std::string &input = "")
+{
+    static constexpr basic_program<Source> embedded;
+    Program expected;
+    std::string error;
+    std::uint32_t line;
+    if (!compileAtRunTime(Source.view(), expected, error, line))
+    {
+        std::cout << "FAIL " << name << ": does not compile at run time: " << error << "\n";
+        failed = 1;
+        return;
+    }
+    if (!sameProgram(embedded.program(), expected))
+    {
+        std::cout << "FAIL " << name << ": bytecode differs\n";
+        failed = 1;
+    }
+    Instance it = embedded(input);
+    Instance other(expected, Limits(), input);
+    while (!other.run())
+    {
+    }
+    if (it.status != Status::DONE || it.output != other.output)
+    {
+        std::cout << "FAIL " << name << ": printed '" << it.output << "', expected '" << other.output << "'\n";
+        failed = 1;
+    }
+}
+
+// both frontends refuse the program with the same message, and the same line
+// for a syntax error (Program::compile reports none)
+template <basic_source Source>
+static void refused(const char *name)
+{
+    static_assert(!basic_compiles(Source.view()));
+    EmbedBuild b = embedCompile(Source.view());
+    Program program;
+    std::string error;
+    std::uint32_t line;
+    if (compileAtRunTime(Source.view(), program, error, line))
+    {
+        std::cout << "FAIL " << name << ": compiles at run time\n";
+        failed = 1;
+    }
+    else if (b.error != error || (line != 0 && b.line != line))
+    {
+        std::cout << "FAIL " << name << ": '" << b.error << "' on line " << b.line << ", expected '" << error
+                  << "' on line " << line << "\n";
+        failed = 1;
+    }
+}
+
+int main()
+{
+    sample<R"(
+sub fib(n)
+    if n < 2 then
+        return n;
+    endif
+    return call fib(n - 1) + call fib(n - 2);
+endsub
+print call fib(15);
+print "fib done";
+)">("fib");
+
+    sample<R"(
+dim v[100];
+let i = 0;
+while i < 100 repeat
+    let v[i] = i * i;
+    let i = i + 1;
+endwhile
+let s = 0;
+for k = 0 to 99
+    let s = s + v[k];
+endfor
+print s;
+print v[7] - v[3] / 2;
+)">("squares");
+
+    sample<R"(
+# comments, gotos and every operator
+let a = 17;
+let b = -5;
+print a / b;
+print -a * b - 3;
+print a - b * 2 + 100 / a;
+if a >= b then
+    print !b;
+endif
+let n = 0;
+label again;
+let n = n + 1;
+if n != 5 then
+    goto again;
+endif
+print n;
+)">("arith");
+
+    sample<R"(
+input n;
+input m;
+let t = 0;
+while n > 0 repeat
+    let t = t + n * m;
+    let n = n - 1;
+endwhile
+print t;
+)">("sum", "100\n3\n");
+
+    sample<R"(
+dim a[64];
+for i = 0 to 63
+    let a[i] = i * 7 - 100;
+endfor
+let s = 0;
+let lo = 1000;
+let hi = -1000;
+for i = 0 to 63 parallel sum(s) min(lo) max(hi)
+    let s = s + a[i];
+    if a[i] < lo then
+        let lo = a[i];
+    endif
+    if a[i] > hi then
+        let hi = a[i];
+    endif
+endfor
+print s;
+print lo;
+print hi;
+)">("reductions");
+
+    sample<R"(
+sub area(w, h)
+    return w * h;
+endsub
+sub show(x)
+    print "area";
+    print x;
+endsub
+call show(call area(6, 7));
+input q;
+call show(call area(q, q));
+return 3;
+)">("subs", "5\n");
+
+    refused<"let = 3;">("no name");
+    refused<"print \"open;\n">("open string");
+    refused<"print 1;\nprint ;\n">("no value");
+    refused<"if 1 then\nendif\n">("no comparison");
+    refused<"goto nowhere;">("undefined label");
+    refused<"print x;">("unassigned");
+    refused<"dim a[5];\nprint a;">("array without index");
+    refused<"let a = call f(1);">("undefined sub");
+    refused<"sub f(x)\nreturn x;\nendsub\nprint call f(1, 2);">("argument count");
+    refused<"while 1 < 2 repeat\nsub f\nendsub\nendwhile\n">("nested sub");
+
+    // an embedded program has no files to include, the runner resolves them
+    // before Program::compile
+    static_assert(!basic_compiles("include \"lib.basic\";"));
+
+    if (failed == 0)
+        std::cout << "embed: ok\n";
+    return failed;
+}
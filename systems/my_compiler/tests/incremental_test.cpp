@@ -0,0 +1,232 @@
+// random edits to a Document leave it with the tokens, tree and diagnostics a
+// fresh parse of the edited text gets. identifiers are compared by name, since
+// the document keeps the names of text that was deleted since it was opened
+//
+// usage: ./tests/incremental_test   (built and run by make check)
+
+#include "incremental.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// pieces of programs, nested blocks and all, to build sources and edits from
+static const char *const fragments[] = {
+    "let a = 1;\n", "let b[a + 2] = a * (b - 3);\n", "print \"hi # there\";\n", "print a + b;\n",
+    "input c;\n", "dim b[10];\n", "label top;\n", "goto top;\n", "call f(a, 2);\n", "return a;\n",
+    "if a < b then\n", "endif\n", "while c != 0 repeat\n", "endwhile\n", "for k = 1 to 9\n",
+    "for k = 1 to n parallel sum(s) max(m)\n", "endfor\n", "sub f(x, y)\n", "endsub\n",
+    "# comment \" with a quote\n", "\"", "#", ";", "(", ")", "[", "]", "=", "<", "if ", "then ", "let ",
+    "endif ", "endwhile ", "a", "b", "7", " ", "\n", "include \"lib.basic\";\n", "!a", "- -a", "+ 1 ",
+    "* b ", ", z", "min(q) ", "(s)\n",
+};
+
+static std::string fragment(std::mt19937 &rng)
+{
+    return fragments[rng() % (sizeof(fragments) / sizeof(fragments[0]))];
+}
+
+// a program whose blocks are mostly well nested, so edits have trees to damage
+static std::string program(std::mt19937 &rng)
+{
+    std::string out;
+    std::vector<std::string> open;
+    for (int n = 20 + rng() % 40; n > 0; n--)
+    {
+        switch (rng() % 6)
+        {
+        case 0:
+            out += "if a < " + std::to_string(rng() % 9) + " then\n";
+            open.push_back("endif\n");
+            break;
+        case 1:
+            out += "while a > 0 repeat\n";
+            open.push_back("endwhile\n");
+            break;
+        case 2:
+            out += rng() % 2 ? "for i = 1 to 5\n" : "for i = 1 to 5 parallel sum(s)\n";
+            open.push_back("endfor\n");
+            break;
+        case 3:
+            if (!open.empty())
+            {
+                out += open.back();
+                open.pop_back();
+                break;
+            }
+            [[fallthrough]];
+        default:
+            out += fragment(rng);
+            break;
+        }
+    }
+    while (!open.empty())
+    {
+        out += open.back();
+        open.pop_back();
+    }
+    return out;
+}
+
+// first body token of every block
+static void blockStarts(const std::vector<Stmt> &list, std::vector<std::uint32_t> &out)
+{
+    for (const Stmt &s : list)
+    {
+        if (!s.error && hasBlock(s.kind))
+        {
+            out.push_back(s.bodyfirst);
+            blockStarts(s.body, out);
+        }
+    }
+}
+
+struct Compare
+{
+    const Document &got;
+    const Document &want;
+    std::string why;
+
+    bool sameName(std::uint32_t a, std::uint32_t b)
+    {
+        return a < got.names.size() && b < want.names.size() && got.names.name(a) == want.names.name(b);
+    }
+
+    bool expr(int a, int b)
+    {
+        if (a < 0 || b < 0)
+            return a == b;
+        const Expr &x = got.nodes[a];
+        const Expr &y = want.nodes[b];
+        bool named = x.kind == Tokens::IDENT || x.kind == Tokens::LBRACKET || x.kind == Tokens::CALL;
+        return x.kind == y.kind && x.text == y.text && (named ? sameName(x.id, y.id) : x.id == y.id) &&
+               expr(x.lhs, y.lhs) && expr(x.rhs, y.rhs);
+    }
+
+    bool stmts(const std::vector<Stmt> &a, const std::vector<Stmt> &b)
+    {
+        if (a.size() != b.size())
+            return fail("statement count");
+        for (std::size_t k = 0; k < a.size(); k++)
+        {
+            const Stmt &x = a[k];
+            const Stmt &y = b[k];
+            if (x.kind != y.kind || x.first != y.first || x.end != y.end || x.error != y.error ||
+                x.text != y.text || x.parallel != y.parallel || x.line != y.line)
+                return fail("statement at token " + std::to_string(y.first));
+            // an error statement's id is the offending token, any other's is a name
+            bool named = !x.error && x.kind != Tokens::PRINT && x.kind != Tokens::IF &&
+                         x.kind != Tokens::WHILE && x.kind != Tokens::INCLUDE && x.kind != Tokens::CALL &&
+                         x.kind != Tokens::RETURN;
+            if (named ? !sameName(x.id, y.id) : x.id != y.id)
+                return fail("statement id at token " + std::to_string(y.first));
+            if (!expr(x.expr, y.expr) || !expr(x.index, y.index))
+                return fail("expression of the statement at token " + std::to_string(y.first));
+            if (x.params.size() != y.params.size())
+                return fail("params at token " + std::to_string(y.first));
+            for (std::size_t p = 0; p < x.params.size(); p++)
+                if (!sameName(x.params[p], y.params[p]))
+                    return fail("params at token " + std::to_string(y.first));
+            if (!x.error && hasBlock(x.kind) &&
+                (x.bodyfirst != y.bodyfirst || x.bodyend != y.bodyend || !stmts(x.body, y.body)))
+                return fail("body of the statement at token " + std::to_string(y.first));
+        }
+        return true;
+    }
+
+    bool fail(const std::string &what)
+    {
+        if (why.empty())
+            why = what;
+        return false;
+    }
+
+    bool all()
+    {
+        if (got.lexok != want.lexok || (!want.lexok && got.lexerror != want.lexerror))
+            return fail("lex error");
+        if (got.tokens.size() != want.tokens.size())
+            return fail("token count");
+        for (std::size_t k = 0; k < want.tokens.size(); k++)
+        {
+            const Token &x = got.tokens[k];
+            const Token &y = want.tokens[k];
+            if (x.type != y.type || x.value != y.value || got.offset(k) != want.offset(k) ||
+                (y.type == Tokens::IDENT && !sameName(x.id, y.id)))
+                return fail("token " + std::to_string(k));
+        }
+        if (!stmts(got.body, want.body))
+            return false;
+        std::vector<Diagnostic> d = got.diagnostics(), e = want.diagnostics();
+        if (d.size() != e.size())
+            return fail("diagnostic count");
+        for (std::size_t k = 0; k < e.size(); k++)
+            if (d[k].line != e[k].line || d[k].column != e[k].column || d[k].message != e[k].message)
+                return fail("diagnostic " + std::to_string(k));
+        return true;
+    }
+};
+
+int main()
+{
+    int failed = 0;
+    std::size_t partial = 0, edits = 0;
+    for (std::uint32_t seed = 1; seed <= 200 && failed == 0; seed++)
+    {
+        std::mt19937 rng(seed);
+        Document doc;
+        doc.open(program(rng));
+        for (int step = 0; step < 60; step++)
+        {
+            // insert, delete or replace somewhere, often at or just inside a
+            // token as typing does, now and then a whole line. a block's first
+            // body token gets extra edits, as the header before it may take them
+            std::vector<std::uint32_t> bodies;
+            blockStarts(doc.body, bodies);
+            std::size_t begin = rng() % (doc.text.size() + 1);
+            std::size_t k = SIZE_MAX;
+            if (rng() % 4 == 0 && !bodies.empty())
+                k = bodies[rng() % bodies.size()];
+            else if (rng() % 2 == 0 && !doc.tokens.empty())
+                k = rng() % doc.tokens.size();
+            if (k < doc.tokens.size())
+                begin = std::min(doc.text.size(), doc.offset(k) + rng() % 3);
+            std::size_t len = rng() % 3 == 0 ? 0 : rng() % 12;
+            std::string with;
+            switch (rng() % 4)
+            {
+            case 0: break;
+            case 1: with = program(rng).substr(0, rng() % 60); break;
+            default: with = fragment(rng); break;
+            }
+            doc.edit(begin, begin + len, with);
+            edits++;
+            if (doc.reparsed < doc.tokens.size())
+                partial++;
+
+            Document fresh;
+            fresh.open(doc.text);
+            Compare check{doc, fresh, ""};
+            if (!check.all())
+            {
+                std::cout << "FAIL seed " << seed << " edit " << step << ": " << check.why << " differs\n";
+                failed = 1;
+                break;
+            }
+        }
+    }
+
+    // most edits should have re-parsed only part of the document
+    if (partial * 2 < edits)
+    {
+        std::cout << "FAIL only " << partial << " of " << edits << " edits re-parsed incrementally\n";
+        failed = 1;
+    }
+
+    if (failed == 0)
+        std::cout << "incremental: ok\n";
+    return failed;
+}
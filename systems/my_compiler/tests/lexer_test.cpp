@@ -0,0 +1,119 @@
+// the parallel lexer gives exactly the tokens of the sequential one, also when
+// its chunk cuts land inside multi-line strings and inside comments that hold
+// quotes. the minimum chunk size is lowered so small sources get cut
+//
+// usage: ./tests/lexer_test   (built and run by make check)
+
+#include "lexer.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+// a program of lets, prints of strings spanning several lines with '#' in
+// them, and comments with quotes in them
+static std::string corpus(std::uint32_t seed, std::size_t size)
+{
+    std::mt19937 rng(seed);
+    std::string out;
+    while (out.size() < size)
+    {
+        switch (rng() % 4)
+        {
+        case 0:
+            out += "let v" + std::to_string(rng() % 50) + " = v" + std::to_string(rng() % 50) + " + " +
+                   std::to_string(rng() % 1000) + ";\n";
+            break;
+        case 1:
+            out += "# a comment with a \" quote in it, and \"another\"\n";
+            break;
+        case 2:
+        {
+            out += "print \"";
+            for (std::uint32_t k = rng() % 6; k > 0; k--)
+                out += "a line # not a comment\n";
+            out += "end\";\n";
+            break;
+        }
+        default:
+            out += "while v1 < 10 repeat let v1 = v1 + 1; endwhile # \"\n";
+            break;
+        }
+    }
+    return out;
+}
+
+// true if some nominal cut of `chunks` pieces, pushed past its newline as
+// tokenizerParallel does, lands inside one of the string tokens
+static bool cutsInsideString(const std::string &str, const std::vector<Token> &tokens, std::size_t chunks)
+{
+    for (std::size_t k = 1; k < chunks; k++)
+    {
+        std::size_t at = str.find('\n', str.size() * k / chunks);
+        if (at == std::string::npos)
+            continue;
+        at++;
+        for (const Token &t : tokens)
+            if (t.type == Tokens::STRING && t.pos < at && at <= t.pos + t.value->size())
+                return true;
+    }
+    return false;
+}
+
+static bool same(const std::vector<Token> &a, const std::vector<Token> &b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (std::size_t k = 0; k < a.size(); k++)
+    {
+        if (a[k].type != b[k].type || a[k].value != b[k].value || a[k].id != b[k].id || a[k].pos != b[k].pos)
+            return false;
+    }
+    return true;
+}
+
+int main()
+{
+    int failed = 0;
+    bool stringcut = false;
+    for (std::uint32_t seed = 1; seed <= 40; seed++)
+    {
+        std::string source = corpus(seed, 2000 + seed * 97);
+        Interner seqnames;
+        std::vector<Token> expected = tokenizer(source, seqnames);
+        stringcut = stringcut || cutsInsideString(source, expected, 4);
+
+        for (std::size_t min_chunk : {16, 100, 400})
+        {
+            Interner names;
+            std::vector<Token> got = tokenizerParallel(source, names, 4, min_chunk);
+            if (!same(got, expected) || names.names != seqnames.names)
+            {
+                std::cout << "FAIL seed " << seed << " min_chunk " << min_chunk << ": tokens differ\n";
+                failed = 1;
+            }
+        }
+    }
+
+    // the corpus must really put cuts inside strings, or the above proves little
+    if (!stringcut)
+    {
+        std::cout << "FAIL no chunk cut landed inside a string\n";
+        failed = 1;
+    }
+
+    // and at the real minimum chunk size, as --lex-threads=4 runs it
+    std::string big = corpus(0, 5 << 20);
+    Interner seqnames, names;
+    if (!same(tokenizerParallel(big, names, 4), tokenizer(big, seqnames)))
+    {
+        std::cout << "FAIL 5 MB corpus: tokens differ\n";
+        failed = 1;
+    }
+
+    if (failed == 0)
+        std::cout << "lexer: ok\n";
+    return failed;
+}
@@ -0,0 +1,106 @@
+#!/bin/sh
+# module cache and dependency manifests: editing an included file rebuilds
+# only the programs that include it, and a truncated or corrupt cache entry
+# is parsed again instead of being loaded
+#
+# usage: ./tests/module_cache.sh   (run from systems/my_compiler after make)
+
+COMPILE=./compile
+DIR=${TMPDIR:-/tmp}/module_cache.$$
+CACHE=$DIR/cache
+mkdir -p "$DIR"
+failed=0
+
+# builds the given programs with the cache, what compile printed is in $DIR/out
+build() {
+    if ! $COMPILE --time-report --cache="$CACHE" "$@" >"$DIR/out" 2>"$DIR/err"; then
+        echo "FAIL build $*: $(cat "$DIR/err")"
+        failed=1
+    fi
+}
+
+# the last build printed status (WroteToFile or UpToDate) for program name
+expect() {
+    if ! grep -q "^$2: .*/$1\.c" "$DIR/out"; then
+        echo "FAIL $3: $1 is not $2"
+        failed=1
+    fi
+}
+
+# the last build parsed $1 modules and loaded $2 from the cache
+includes() {
+    if ! grep -q "includes: $1 modules parsed, $2 loaded from the cache" "$DIR/err"; then
+        echo "FAIL $3: $(grep includes: "$DIR/err")"
+        failed=1
+    fi
+}
+
+# program name prints expected
+prints() {
+    if ! cc -O2 -pthread -o "$DIR/$1" "$DIR/$1.c" || [ "$("$DIR/$1" | tr '\n' ' ')" != "$2" ]; then
+        echo "FAIL $3: $1 does not print '$2'"
+        failed=1
+    fi
+}
+
+printf 'let base = 10;\n' > "$DIR/common.basic"
+printf 'let one = 1;\n' > "$DIR/lib1.basic"
+printf 'let two = 2;\n' > "$DIR/lib2.basic"
+printf 'include "common.basic";\ninclude "lib1.basic";\nprint base + one;\n' > "$DIR/main1.basic"
+printf 'include "common.basic";\ninclude "lib2.basic";\nprint base + two;\n' > "$DIR/main2.basic"
+printf 'print 3;\n' > "$DIR/main3.basic"
+ALL="$DIR/main1.basic $DIR/main2.basic $DIR/main3.basic"
+
+build $ALL
+for m in main1 main2 main3; do expect $m WroteToFile "first build"; done
+includes 3 0 "first build"
+
+build $ALL
+for m in main1 main2 main3; do expect $m UpToDate "second build"; done
+
+# only main1 includes lib1
+printf 'let one = 5;\n' > "$DIR/lib1.basic"
+build $ALL
+expect main1 WroteToFile "lib1 edited"
+expect main2 UpToDate "lib1 edited"
+expect main3 UpToDate "lib1 edited"
+includes 1 1 "lib1 edited"
+prints main1 "15 " "lib1 edited"
+
+# both include common
+printf 'let base = 20;\n' > "$DIR/common.basic"
+build $ALL
+expect main1 WroteToFile "common edited"
+expect main2 WroteToFile "common edited"
+expect main3 UpToDate "common edited"
+includes 1 2 "common edited"
+prints main2 "22 " "common edited"
+
+# every way of breaking the entries main2 loads makes it parse them again
+# (and write them back whole)
+n=0
+for damage in truncate append header tail; do
+    for mod in "$CACHE"/*.mod; do
+        case $damage in
+        truncate) head -c $(($(wc -c < "$mod") / 2)) "$mod" > "$DIR/mod" && mv "$DIR/mod" "$mod" ;;
+        append) printf 'x' >> "$mod" ;;
+        header) printf 'ffff' | dd of="$mod" bs=1 seek=8 conv=notrunc 2>/dev/null ;;
+        tail) printf '\376\377\377\177' | dd of="$mod" bs=1 seek=$(($(wc -c < "$mod") - 4)) conv=notrunc 2>/dev/null ;;
+        esac
+    done
+    n=$((n + 1))
+    printf 'include "common.basic";\ninclude "lib2.basic";\nprint base + two + %d;\n' $n > "$DIR/main2.basic"
+    build "$DIR/main2.basic"
+    expect main2 WroteToFile "$damage cache"
+    includes 2 0 "$damage cache"
+    prints main2 "$((22 + n)) " "$damage cache"
+
+    # the entries written back load again
+    printf 'include "common.basic";\ninclude "lib2.basic";\nprint base + two;\n' > "$DIR/main2.basic"
+    build "$DIR/main2.basic"
+    includes 0 2 "$damage cache rewritten"
+done
+
+rm -rf "$DIR"
+[ "$failed" -eq 0 ] && echo "module cache: ok"
+exit $failed
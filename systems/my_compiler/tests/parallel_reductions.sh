@@ -0,0 +1,120 @@
+#!/bin/sh
+# parallel for reductions: the update forms are accepted and sum correctly,
+# any other use of a reduction variable in the body is rejected
+#
+# usage: ./tests/parallel_reductions.sh   (run from systems/my_compiler after make)
+
+COMPILE=./compile
+DIR=${TMPDIR:-/tmp}/parallel_reductions.$$
+mkdir -p "$DIR"
+failed=0
+
+# compiles the program on stdin, which must be accepted and print expected
+accepts() {
+    cat > "$DIR/$1.basic"
+    if ! $COMPILE "$DIR/$1.basic" >/dev/null 2>"$DIR/err" ||
+        ! cc -O2 -pthread -o "$DIR/$1" "$DIR/$1.c"; then
+        echo "FAIL $1: not accepted: $(cat "$DIR/err")"
+        failed=1
+        return
+    fi
+    got=$(BASIC_THREADS=4 "$DIR/$1" | tr '\n' ' ')
+    if [ "$got" != "$2" ]; then
+        echo "FAIL $1: printed '$got', expected '$2'"
+        failed=1
+    fi
+}
+
+# compiles the program on stdin, which must be rejected as misusing var
+rejects() {
+    cat > "$DIR/$1.basic"
+    if $COMPILE "$DIR/$1.basic" >/dev/null 2>"$DIR/err"; then
+        echo "FAIL $1: accepted"
+        failed=1
+    elif ! grep -q "$2 is a .* reduction" "$DIR/err"; then
+        echo "FAIL $1: $(cat "$DIR/err")"
+        failed=1
+    fi
+}
+
+accepts forms "144 3 48 " <<BASIC
+let s = 0;
+let lo = 1000;
+let hi = 0;
+for k = 1 to 8 parallel sum(s) min(lo) max(hi)
+    let x = k * 3;
+    let s = s + x;
+    let s = k + s;
+    if x < lo then
+        let lo = x;
+    endif
+    if hi < x * 2 then
+        let hi = x * 2;
+    endif
+endfor
+print s;
+print lo;
+print hi;
+BASIC
+
+rejects product s <<BASIC
+let s = 1;
+for k = 1 to 8 parallel sum(s)
+    let s = s * 2;
+endfor
+BASIC
+
+rejects twice s <<BASIC
+let s = 0;
+for k = 1 to 8 parallel sum(s)
+    let s = s + s;
+endfor
+BASIC
+
+rejects read s <<BASIC
+let s = 0;
+let t = 0;
+for k = 1 to 8 parallel sum(s)
+    let s = s + k;
+    let t = s;
+endfor
+BASIC
+
+rejects condition s <<BASIC
+let s = 0;
+for k = 1 to 8 parallel sum(s)
+    if s > 3 then
+        let s = s + 1;
+    endif
+endfor
+BASIC
+
+rejects other lo <<BASIC
+let s = 0;
+let lo = 100;
+for k = 1 to 8 parallel sum(s) min(lo)
+    let s = s + lo;
+endfor
+BASIC
+
+rejects wrongway lo <<BASIC
+let lo = 100;
+for k = 1 to 8 parallel min(lo)
+    if k > lo then
+        let lo = k;
+    endif
+endfor
+BASIC
+
+rejects mismatch hi <<BASIC
+let hi = 0;
+for k = 1 to 8 parallel max(hi)
+    if k > hi then
+        let hi = k + 1;
+    endif
+endfor
+BASIC
+
+rm -rf "$DIR"
+[ "$failed" -eq 0 ] && echo "parallel reductions: ok"
+exit $failed
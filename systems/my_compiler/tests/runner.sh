@@ -0,0 +1,149 @@
+#!/bin/sh
+# the in-process runner: programs print what their compiled c prints, an
+# instance over its instruction budget or memory cap is stopped without
+# disturbing the others, and a long loop is preempted at its back-edge
+#
+# usage: ./tests/runner.sh   (run from systems/my_compiler after make)
+
+COMPILE=./compile
+DIR=${TMPDIR:-/tmp}/runner.$$
+mkdir -p "$DIR"
+failed=0
+
+# the accounting line compile --run printed for program name
+account() {
+    grep "^$DIR/$1.basic: " "$DIR/err"
+}
+
+cat > "$DIR/fib.basic" <<BASIC
+sub fib(n)
+    if n < 2 then
+        return n;
+    endif
+    return call fib(n - 1) + call fib(n - 2);
+endsub
+print call fib(20);
+print "fib done";
+BASIC
+
+cat > "$DIR/squares.basic" <<BASIC
+dim v[100];
+let i = 0;
+while i < 100 repeat
+    let v[i] = i * i;
+    let i = i + 1;
+endwhile
+let s = 0;
+for k = 0 to 99
+    let s = s + v[k];
+endfor
+print s;
+print v[7] - v[3] / 2;
+BASIC
+
+cat > "$DIR/arith.basic" <<BASIC
+let a = 17;
+let b = -5;
+print a / b;
+print -a * b - 3;
+print a - b * 2 + 100 / a;
+if a >= b then
+    print !b;
+endif
+let n = 0;
+label again;
+let n = n + 1;
+if n < 5 then
+    goto again;
+endif
+print n;
+BASIC
+
+cat > "$DIR/sum.basic" <<BASIC
+input n;
+input m;
+let t = 0;
+while n > 0 repeat
+    let t = t + n * m;
+    let n = n - 1;
+endwhile
+print t;
+BASIC
+printf '100\n3\n' > "$DIR/sum.in"
+
+# a loop with no call in it, long enough for many quanta of 100000
+cat > "$DIR/spin.basic" <<BASIC
+let i = 0;
+let s = 0;
+while i < 300000 repeat
+    let s = s + i / 1000;
+    let i = i + 1;
+endwhile
+print s;
+BASIC
+
+PROGRAMS="fib squares arith sum spin"
+
+# every program alone and all of them on 4 threads print what the c prints
+expected=""
+for p in $PROGRAMS; do
+    if ! $COMPILE "$DIR/$p.basic" >/dev/null || ! cc -O2 -pthread -o "$DIR/$p" "$DIR/$p.c"; then
+        echo "FAIL $p: does not build"
+        failed=1
+        continue
+    fi
+    if [ -f "$DIR/$p.in" ]; then c=$("$DIR/$p" < "$DIR/$p.in"); else c=$("$DIR/$p" < /dev/null); fi
+    if ! got=$($COMPILE --run "$DIR/$p.basic" 2>"$DIR/err") || [ "$got" != "$c" ]; then
+        echo "FAIL $p: --run printed '$got', the c printed '$c'"
+        failed=1
+    fi
+    expected="$expected==> $DIR/$p.basic <==
+$c
+"
+done
+files=$(for p in $PROGRAMS; do printf '%s ' "$DIR/$p.basic"; done)
+if ! $COMPILE --run --run-threads=4 $files > "$DIR/out" 2>"$DIR/err" ||
+    [ "$(cat "$DIR/out")" != "$(printf '%s' "$expected")" ]; then
+    echo "FAIL 4 threads: printed $(cat "$DIR/out")"
+    failed=1
+fi
+
+# the spin loop ran in one slice per quantum, so it was preempted at the
+# back-edge of the while, the only place it can yield
+set -- $(account spin | sed 's/.*exit 0, \([0-9]*\) instructions, \([0-9]*\) slices.*/\1 \2/')
+if [ $# -ne 2 ] || [ "$2" -lt $(($1 / 100000)) ] || [ "$2" -lt 2 ]; then
+    echo "FAIL preemption: $(account spin)"
+    failed=1
+fi
+
+cat > "$DIR/forever.basic" <<BASIC
+let i = 0;
+while 0 < 1 repeat
+    let i = i + 1;
+endwhile
+BASIC
+
+cat > "$DIR/big.basic" <<BASIC
+dim a[1000000];
+let a[999999] = 12345;
+print a[999999];
+BASIC
+
+# over budget and over memory stop only the instance that went over
+if $COMPILE --run --run-threads=2 --budget=100000 --memory=1000000 "$DIR/forever.basic" "$DIR/big.basic" \
+    "$DIR/fib.basic" "$DIR/arith.basic" > "$DIR/out" 2>"$DIR/err"; then
+    echo "FAIL limits: exited 0"
+    failed=1
+fi
+account forever | grep -q ": over budget: " || { echo "FAIL budget: $(account forever)"; failed=1; }
+account big | grep -q ": over memory: " || { echo "FAIL memory: $(account big)"; failed=1; }
+account fib | grep -q ": over budget: " || { echo "FAIL fib budget: $(account fib)"; failed=1; }
+account arith | grep -q ": exit 0, " || { echo "FAIL limits: $(account arith)"; failed=1; }
+if grep -q "^12345$" "$DIR/out"; then
+    echo "FAIL memory: big.basic printed"
+    failed=1
+fi
+
+rm -rf "$DIR"
+[ "$failed" -eq 0 ] && echo "runner: ok"
+exit $failed
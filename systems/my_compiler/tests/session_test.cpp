@@ -0,0 +1,158 @@
+// many sessions spawned on a two thread executor all wait for input at once,
+// holding no thread, and each prints exactly its own answers when their
+// lines are posted in shuffled order, some all at once and some one by one
+//
+// usage: ./tests/session_test   (built and run by make check)
+
+#include "session.hpp"
+#include <algorithm>
+#include <condition_variable>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <string>
+#include <vector>
+
+// reads a factor, then prints each number times it until a 0
+static const char *const echo = "input k;\n"
+                                "input n;\n"
+                                "while n != 0 repeat\n"
+                                "    print n * k;\n"
+                                "    input n;\n"
+                                "endwhile\n"
+                                "print \"bye\";\n";
+
+// counts sessions that got somewhere, for the driver to wait on
+struct Tally
+{
+    std::mutex lock;
+    std::condition_variable changed;
+    int waiting = 0;
+    int finished = 0;
+
+    void bump(int &which)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        which++;
+        changed.notify_all();
+    }
+    void await(int &which, int count)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [&] { return which >= count; });
+    }
+};
+
+struct Session
+{
+    Instance it;
+    Inbox in;
+    std::string printed;
+    Session(const Program &p, Executor &pool) : it(p, Limits(), ""), in(pool) { it.open = true; }
+};
+
+// the loop from the example in session.hpp
+static Task<> session(Session &s, Executor &pool, Tally &tally)
+{
+    bool first = true;
+    while (true)
+    {
+        s.printed += co_await resume(s.it, pool);
+        if (s.it.status != Status::WAITING)
+            break;
+        if (first)
+            tally.bump(tally.waiting);
+        first = false;
+        if (std::optional<std::string> line = co_await s.in.next())
+            s.it.feed(*line + "\n");
+        else
+            s.it.close();
+    }
+    tally.bump(tally.finished);
+}
+
+int main()
+{
+    Interner names;
+    std::vector<Token> tokens = tokenizer(echo, names);
+    Parser parser(tokens);
+    std::vector<Stmt> body;
+    while (!parser.atend())
+        body.push_back(parser.statement());
+    Program program;
+    std::string error;
+    if (!program.compile(body, parser.nodes, names, error))
+    {
+        std::cout << "FAIL compile: " << error << "\n";
+        return 1;
+    }
+
+    const int count = 500;
+    int failed = 0;
+    Tally tally;
+    std::mt19937 rng(7);
+    {
+        Executor pool(2);
+        std::vector<std::unique_ptr<Session>> sessions;
+        for (int k = 0; k < count; k++)
+        {
+            sessions.push_back(std::make_unique<Session>(program, pool));
+            spawn(session(*sessions.back(), pool, tally));
+        }
+
+        // every session has reached its first input and parks on its inbox
+        // before any line comes, 500 of them on 2 threads
+        tally.await(tally.waiting, count);
+
+        // session k gets factor k and the numbers 1..k%7, then is ended with
+        // 0, by a close or with a line too many that it never reads
+        std::vector<int> order(count);
+        for (int k = 0; k < count; k++)
+            order[k] = k;
+        std::shuffle(order.begin(), order.end(), rng);
+        for (int k : order)
+            sessions[k]->in.post(std::to_string(k));
+        for (int round = 1; round <= 7; round++)
+        {
+            std::shuffle(order.begin(), order.end(), rng);
+            for (int k : order)
+            {
+                if (round <= k % 7)
+                    sessions[k]->in.post(std::to_string(round));
+                else if (round == k % 7 + 1)
+                {
+                    switch (k % 3)
+                    {
+                    case 0: sessions[k]->in.post("0"); break;
+                    case 1: sessions[k]->in.close(); break;
+                    default:
+                        sessions[k]->in.post("0");
+                        sessions[k]->in.post("99");
+                        break;
+                    }
+                }
+            }
+        }
+        tally.await(tally.finished, count);
+
+        for (int k = 0; k < count && failed < 5; k++)
+        {
+            std::string expected;
+            for (int n = 1; n <= k % 7; n++)
+                expected += std::to_string(n * k) + "\n";
+            expected += "bye\n";
+            const Session &s = *sessions[k];
+            if (s.it.status != Status::DONE || s.printed != expected)
+            {
+                std::cout << "FAIL session " << k << ": printed '" << s.printed << "'\n";
+                failed++;
+            }
+        }
+    }
+
+    if (failed == 0)
+        std::cout << "session: ok\n";
+    return failed == 0 ? 0 : 1;
+}
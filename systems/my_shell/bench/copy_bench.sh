@@ -0,0 +1,49 @@
+#!/bin/sh
+# builtin cat and tee against coreutils
+# copies a file in the shell with the builtins (splice, tee, copy_file_range)
+# and with /bin/cat and /usr/bin/tee, and reports GB/s for each
+#
+# usage: ./bench/copy_bench.sh [size in MB]   (run from systems/my_shell after make)
+
+MB=${1:-1024}
+DATA=./bench/copy_data
+OUT=./bench/copy_out
+SHELL_BIN=./bin/shell
+
+if [ ! -f "$DATA" ] || [ "$(($(wc -c < "$DATA") / 1048576))" -ne "$MB" ]; then
+    echo "generating ${MB} MB of data..."
+    head -c $((MB * 1048576)) /dev/urandom > "$DATA"
+fi
+# once so the file is in the page cache
+cat "$DATA" > /dev/null
+
+# runs one command line in the shell, three times, and prints the best
+run() {
+    best=0
+    for i in 1 2 3; do
+        rm -f "$OUT"
+        start=$(date +%s%N)
+        printf '%s\nexit\n' "$2" | $SHELL_BIN > /dev/null 2>&1
+        end=$(date +%s%N)
+        ns=$((end - start))
+        if [ "$best" -eq 0 ] || [ "$ns" -lt "$best" ]; then
+            best=$ns
+        fi
+    done
+    if [ -f "$OUT" ] && ! cmp -s "$DATA" "$OUT"; then
+        echo "$1 wrote a different file"
+        return
+    fi
+    # MB * 1048576 bytes in best ns, as GB/s with two decimals
+    centi=$((MB * 1048576 * 100 / (best > 0 ? best : 1)))
+    printf "%-22s %6d ms  %3d.%02d GB/s\n" "$1" "$((best / 1000000))" "$((centi / 100))" "$((centi % 100))"
+}
+
+echo "$(nproc) cpus, ${MB} MB"
+run "builtin cat | cat" "cat $DATA | cat > /dev/null"
+run "coreutils cat | cat" "/bin/cat $DATA | /bin/cat > /dev/null"
+run "builtin cat > file" "cat $DATA > $OUT"
+run "coreutils cat > file" "/bin/cat $DATA > $OUT"
+run "builtin tee" "cat $DATA | tee $OUT | cat > /dev/null"
+run "coreutils tee" "/bin/cat $DATA | /usr/bin/tee $OUT | /bin/cat > /dev/null"
+rm -f "$OUT"
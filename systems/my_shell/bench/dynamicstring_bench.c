@@ -0,0 +1,178 @@
+// dynamicstring microbenchmark
+// times building a string a char at a time against the bulk appends, and
+// Split (a string per token) against SplitViews (offsets only), and counts
+// the mallocs each one makes (linked with --wrap=malloc,--wrap=realloc)
+//
+// usage: make bench   or   ./bin/dynamicstring_bench [size in KB] [rounds]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "dynamicstring.h"
+
+// every malloc and realloc the process makes goes through these
+static long allocations = 0;
+void *__real_malloc(size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size)
+{
+    allocations++;
+    return __real_malloc(size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    allocations++;
+    return __real_realloc(ptr, size);
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// a command-line looking text: words, runs of blanks and a few operators
+static char *make_input(size_t size)
+{
+    static const char *words[] = {"ls", "-l", "grep", ".c", "|", "echo", "hello", ";", "cat", "/usr/include/stdio.h", "&&", "wc"};
+    char *text = malloc(size + 1);
+    if (text == NULL)
+    {
+        return NULL;
+    }
+    size_t n = 0;
+    unsigned seed = 42;
+    while (n < size)
+    {
+        seed = seed * 1103515245 + 12345;
+        const char *w = words[(seed >> 16) % (sizeof(words) / sizeof(words[0]))];
+        for (size_t i = 0; w[i] != '\0' && n < size; i++)
+        {
+            text[n++] = w[i];
+        }
+        // one to three blanks
+        for (unsigned b = 0; b <= (seed >> 8) % 3 && n < size; b++)
+        {
+            text[n++] = (seed & 1) ? ' ' : '\t';
+        }
+    }
+    text[size] = '\0';
+    return text;
+}
+
+int main(int argc, char **argv)
+{
+    size_t size = (argc > 1 ? (size_t)atol(argv[1]) : 1024) * 1024;
+    int rounds = argc > 2 ? atoi(argv[2]) : 20;
+    const char *delims = " \t|;";
+
+    char *text = make_input(size);
+    if (text == NULL)
+    {
+        perror("malloc");
+        return 1;
+    }
+    printf("%zu KB input, %d rounds, delimiters \" \\t|;\"\n", size / 1024, rounds);
+
+    // building the string
+    double t = now_ms();
+    for (int r = 0; r < rounds; r++)
+    {
+        dynamicstring_t *s = DynamicString_Create("");
+        for (size_t i = 0; i < size; i++)
+        {
+            DynamicString_AppendChar(s, text[i]);
+        }
+        DynamicString_Free(s);
+    }
+    double append_char = (now_ms() - t) / rounds;
+
+    t = now_ms();
+    for (int r = 0; r < rounds; r++)
+    {
+        dynamicstring_t *s = DynamicString_Create("");
+        // in 80 byte pieces, about a line at a time
+        for (size_t i = 0; i < size; i += 80)
+        {
+            DynamicString_AppendN(s, text + i, size - i < 80 ? size - i : 80);
+        }
+        DynamicString_Free(s);
+    }
+    double append_n = (now_ms() - t) / rounds;
+
+    t = now_ms();
+    for (int r = 0; r < rounds; r++)
+    {
+        dynamicstring_t *s = DynamicString_Create("");
+        DynamicString_Reserve(s, size + 1);
+        for (size_t i = 0; i < size; i += 80)
+        {
+            DynamicString_AppendN(s, text + i, size - i < 80 ? size - i : 80);
+        }
+        DynamicString_Free(s);
+    }
+    double reserve_n = (now_ms() - t) / rounds;
+
+    printf("%-22s %9.3f ms  %7.1f MB/s\n", "AppendChar", append_char, size / 1048576.0 / (append_char / 1e3));
+    printf("%-22s %9.3f ms  %7.1f MB/s\n", "AppendN", append_n, size / 1048576.0 / (append_n / 1e3));
+    printf("%-22s %9.3f ms  %7.1f MB/s\n", "Reserve + AppendN", reserve_n, size / 1048576.0 / (reserve_n / 1e3));
+
+    // splitting it
+    dynamicstring_t *input = DynamicString_Create(text);
+    int tokens = 0;
+    int view_tokens = 0;
+
+    long before = allocations;
+    t = now_ms();
+    for (int r = 0; r < rounds; r++)
+    {
+        dynamicstring_t **array = NULL;
+        DynamicString_Split(input, delims, &array, &tokens);
+        for (int k = 0; k < tokens; k++)
+        {
+            DynamicString_Free(array[k]);
+        }
+        free(array);
+    }
+    double split = (now_ms() - t) / rounds;
+    long split_allocs = (allocations - before) / rounds;
+
+    before = allocations;
+    t = now_ms();
+    for (int r = 0; r < rounds; r++)
+    {
+        dynamicstring_view_t *views = NULL;
+        DynamicString_SplitViews(input, delims, &views, &view_tokens);
+        free(views);
+    }
+    double split_views = (now_ms() - t) / rounds;
+    long split_views_allocs = (allocations - before) / rounds;
+
+    printf("%-22s %9.3f ms  %7.1f MB/s  %d tokens, %ld allocations\n", "Split", split, size / 1048576.0 / (split / 1e3), tokens, split_allocs);
+    printf("%-22s %9.3f ms  %7.1f MB/s  %d tokens, %ld allocations\n", "SplitViews", split_views, size / 1048576.0 / (split_views / 1e3), view_tokens, split_views_allocs);
+
+    // a typical command line, once the pool is warm
+    dynamicstring_t *line = DynamicString_Create("ls -l /usr/include | grep stdio | wc -l");
+    before = allocations;
+    for (int r = 0; r < rounds; r++)
+    {
+        dynamicstring_t **array = NULL;
+        int count = 0;
+        DynamicString_Split(line, " ", &array, &count);
+        for (int k = 0; k < count; k++)
+        {
+            DynamicString_Free(array[k]);
+        }
+        free(array);
+    }
+    printf("%-22s %9.1f allocations per line\n", "Split of a command", (double)(allocations - before) / rounds);
+    DynamicString_Free(line);
+
+    DynamicString_Free(input);
+    free(text);
+    return tokens == view_tokens ? 0 : 1;
+}
@@ -0,0 +1,32 @@
+#!/bin/sh
+# pipeline throughput across pipe sizes and stage placements
+# pushes a file through cat | cat | cat | wc -c in the shell and reports MB/s
+# for each `pipeline size` and `pipeline affinity` setting
+#
+# usage: ./bench/pipe_bench.sh [size in MB]   (run from systems/my_shell after make)
+
+MB=${1:-512}
+DATA=./bench/pipe_data
+SHELL_BIN=./bin/shell
+
+if [ ! -f "$DATA" ] || [ "$(($(wc -c < "$DATA") / 1048576))" -ne "$MB" ]; then
+    echo "generating ${MB} MB of data..."
+    head -c $((MB * 1048576)) /dev/urandom > "$DATA"
+fi
+# once so the file is in the page cache
+cat "$DATA" > /dev/null
+
+echo "$(nproc) cpus, pipe-max-size $(cat /proc/sys/fs/pipe-max-size)"
+for placement in none spread compact; do
+    for size in 0 256k 1m; do
+        start=$(date +%s%N)
+        out=$(printf 'pipeline size %s\npipeline affinity %s\ncat %s | cat | cat | wc -c\nexit\n' "$size" "$placement" "$DATA" | $SHELL_BIN 2>&1)
+        end=$(date +%s%N)
+        if ! echo "$out" | grep -q "$((MB * 1048576))"; then
+            echo "affinity=$placement size=$size failed: $out"
+            continue
+        fi
+        ms=$(((end - start) / 1000000))
+        printf "affinity=%-8s size=%-5s %6d ms  %6d MB/s\n" "$placement" "$size" "$ms" "$((MB * 1000 / (ms > 0 ? ms : 1)))"
+    done
+done
@@ -0,0 +1,96 @@
+// launch microbenchmark
+// starts `true` over and over, waiting for each, the way the shell used to
+// (fork, reset signals, execvp) and with spawn_command, while the process holds
+// a growing amount of touched memory standing in for a shell that grew
+//
+// usage: make bench   or   ./bin/spawn_bench [launches] [MB of memory ...]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "launch.h"
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+// the old launch_fork child, minus the terminal
+static pid_t fork_command(char **argv)
+{
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        setpgid(0, 0);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTSTP, SIG_DFL);
+        signal(SIGTTIN, SIG_DFL);
+        signal(SIGTTOU, SIG_DFL);
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+    return pid;
+}
+
+static pid_t spawn_true(char **argv)
+{
+    spawn_options_t options = {.in_fd = -1, .out_fd = -1, .pgroup = 0, .foreground = 0};
+    return spawn_command(argv, &options);
+}
+
+// launches per second
+static double run(pid_t (*launch)(char **), int launches)
+{
+    char *argv[] = {"true", NULL};
+    double t = now_ms();
+    for (int i = 0; i < launches; i++)
+    {
+        pid_t pid = launch(argv);
+        if (pid < 0)
+        {
+            perror("launch");
+            exit(1);
+        }
+        int status;
+        waitpid(pid, &status, 0);
+    }
+    return launches / ((now_ms() - t) / 1e3);
+}
+
+int main(int argc, char **argv)
+{
+    int launches = argc > 1 ? atoi(argv[1]) : 2000;
+    static const char *default_sizes[] = {"0", "64", "512"};
+    const char **sizes = argc > 2 ? (const char **)argv + 2 : default_sizes;
+    int nsizes = argc > 2 ? argc - 2 : 3;
+
+    printf("%d launches of true each\n", launches);
+    printf("%8s %14s %14s\n", "memory", "fork+exec/s", "spawn/s");
+
+    char *ballast = NULL;
+    for (int i = 0; i < nsizes; i++)
+    {
+        // grow the memory to the next size and touch every page of it
+        size_t bytes = (size_t)atol(sizes[i]) * 1048576;
+        free(ballast);
+        ballast = bytes > 0 ? malloc(bytes) : NULL;
+        if (bytes > 0 && ballast == NULL)
+        {
+            perror("malloc");
+            return 1;
+        }
+        memset(ballast, 1, bytes);
+
+        double forked = run(fork_command, launches);
+        double spawned = run(spawn_true, launches);
+        printf("%6s MB %14.0f %14.0f\n", sizes[i], forked, spawned);
+    }
+    free(ballast);
+    return 0;
+}
@@ -0,0 +1,382 @@
+#define _GNU_SOURCE
+#include "./copy.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// bytes asked for per call
+#define CHUNK (1 << 20)
+#define BUFFER (128 * 1024)
+
+// what a zero-copy call that fails before moving anything may say about fds
+// it does not support, as opposed to a real error
+#define UNSUPPORTED(e) ((e) == EINVAL || (e) == ENOSYS || (e) == EXDEV || (e) == EBADF || (e) == EOPNOTSUPP)
+
+static volatile sig_atomic_t interrupted = 0;
+static struct sigaction saved_sigint;
+
+static void on_sigint(int sig)
+{
+    interrupted = 1;
+}
+
+// ctrl c interrupts the calls below instead of restarting them
+static void begin(void)
+{
+    struct sigaction sa = {.sa_handler = on_sigint};
+    sigemptyset(&sa.sa_mask);
+    interrupted = 0;
+    sigaction(SIGINT, &sa, &saved_sigint);
+}
+
+static int end(int result)
+{
+    int error = errno;
+    sigaction(SIGINT, &saved_sigint, NULL);
+    errno = error;
+    return result;
+}
+
+// a call that was interrupted goes on unless it was ctrl c
+static int retry(void)
+{
+    return errno == EINTR && !interrupted;
+}
+
+// ctrl c that came between calls, or during one that still moved something
+// and so returned no EINTR. fails like an interrupted call if so
+static int stopped(void)
+{
+    if (interrupted)
+    {
+        errno = EINTR;
+        return 1;
+    }
+    return 0;
+}
+
+static int is_pipe(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISFIFO(st.st_mode);
+}
+
+static int is_file(int fd)
+{
+    struct stat st;
+    return fstat(fd, &st) == 0 && S_ISREG(st.st_mode);
+}
+
+// writes all of buf, 0 on success
+static int write_all(int fd, const char *buf, size_t n)
+{
+    while (n > 0)
+    {
+        ssize_t put = write(fd, buf, n);
+        if (put < 0)
+        {
+            if (retry())
+            {
+                continue;
+            }
+            return -1;
+        }
+        buf += put;
+        n -= put;
+    }
+    return 0;
+}
+
+// with read and write through a buffer, to out and each file
+static int copy_buffered(int in, int out, const int *files, int nfiles)
+{
+    char *buf = malloc(BUFFER);
+    if (buf == NULL)
+    {
+        return -1;
+    }
+    int result = 0;
+    while (!stopped())
+    {
+        ssize_t got = read(in, buf, BUFFER);
+        if (got < 0 && retry())
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            result = got;
+            break;
+        }
+        if (write_all(out, buf, got) != 0)
+        {
+            result = -1;
+            break;
+        }
+        for (int i = 0; i < nfiles; i++)
+        {
+            if (write_all(files[i], buf, got) != 0)
+            {
+                result = -1;
+                break;
+            }
+        }
+        if (result != 0)
+        {
+            break;
+        }
+    }
+    free(buf);
+    return interrupted ? -1 : result;
+}
+
+// with splice or copy_file_range, returns 1 if the fds do not support it
+// and nothing was moved, so the caller can fall back
+static int copy_in_kernel(int in, int out, int use_splice)
+{
+    int moved = 0;
+    while (!stopped())
+    {
+        ssize_t n = use_splice ? splice(in, NULL, out, NULL, CHUNK, SPLICE_F_MOVE | SPLICE_F_MORE)
+                               : copy_file_range(in, NULL, out, NULL, CHUNK, 0);
+        if (n > 0)
+        {
+            moved = 1;
+            continue;
+        }
+        if (n == 0)
+        {
+            return 0;
+        }
+        if (retry())
+        {
+            continue;
+        }
+        if (!moved && UNSUPPORTED(errno))
+        {
+            return 1;
+        }
+        return -1;
+    }
+    return -1;
+}
+
+int copy_fd(int in, int out)
+{
+    begin();
+
+    // splice needs a pipe on one side, copy_file_range works between files
+    int result = 1;
+    if (is_pipe(in) || is_pipe(out))
+    {
+        result = copy_in_kernel(in, out, 1);
+    }
+    else if (is_file(in))
+    {
+        result = copy_in_kernel(in, out, 0);
+    }
+    if (result == 1)
+    {
+        result = copy_buffered(in, out, NULL, 0);
+    }
+    return end(result);
+}
+
+// moves exactly n bytes from the pipe in to out, 0 on success, 1 if the
+// first call failed as unsupported and moved nothing
+static int splice_exactly(int in, int out, size_t n)
+{
+    int first = 1;
+    while (n > 0 && !stopped())
+    {
+        ssize_t moved = splice(in, NULL, out, NULL, n, SPLICE_F_MOVE | SPLICE_F_MORE);
+        if (moved < 0 && retry())
+        {
+            continue;
+        }
+        if (moved < 0 && first && UNSUPPORTED(errno))
+        {
+            return 1;
+        }
+        if (moved <= 0)
+        {
+            return -1;
+        }
+        n -= moved;
+        first = 0;
+    }
+    return n > 0 ? -1 : 0;
+}
+
+// pipe to pipe and files: tee(2) duplicates what is in the input pipe into the
+// output pipe and into a private pipe per file but the last, which then get
+// spliced into their files, and the last file gets the input pipe's own pages.
+// returns 1 if a call failed as unsupported before it moved anything. the
+// first *pending bytes of the input pipe are then in out and in the first
+// *done files already, but not in the others
+static int tee_in_kernel(int in, int out, const int *files, int nfiles, size_t *pending, int *done)
+{
+    int (*spare)[2] = calloc(nfiles, sizeof(int[2]));
+    if (spare == NULL)
+    {
+        return -1;
+    }
+
+    // the private pipes hold a whole input pipe, so one tee fills them in one go
+    int size = fcntl(in, F_GETPIPE_SZ);
+    int made = 0;
+    int result = 0;
+    while (made < nfiles - 1)
+    {
+        if (pipe2(spare[made], O_CLOEXEC) != 0)
+        {
+            result = -1;
+            break;
+        }
+        made++;
+        if (fcntl(spare[made - 1][1], F_SETPIPE_SZ, size) < size)
+        {
+            result = -1;
+            break;
+        }
+    }
+
+    while (result == 0)
+    {
+        if (stopped())
+        {
+            result = -1;
+            break;
+        }
+        ssize_t n = tee(in, out, CHUNK, 0);
+        if (n < 0 && retry())
+        {
+            continue;
+        }
+        if (n < 0 && UNSUPPORTED(errno))
+        {
+            result = 1;
+            break;
+        }
+        if (n <= 0)
+        {
+            result = n;
+            break;
+        }
+        *pending = n;
+
+        // the same n bytes for every file, the first n of the input pipe
+        for (int i = 0; i < nfiles - 1 && result == 0; i++)
+        {
+            ssize_t copied;
+            do
+            {
+                copied = tee(in, spare[i][1], n, 0);
+            } while (copied < 0 && retry());
+            if (copied < 0 && UNSUPPORTED(errno))
+            {
+                result = 1;
+            }
+            else if (copied != n)
+            {
+                result = -1;
+            }
+            else
+            {
+                result = splice_exactly(spare[i][0], files[i], n);
+            }
+            *done = i;
+        }
+
+        // and consume them into the last file
+        if (result == 0)
+        {
+            *done = nfiles - 1;
+            result = splice_exactly(in, files[nfiles - 1], n);
+        }
+        if (result == 0)
+        {
+            *pending = 0;
+            *done = 0;
+        }
+    }
+
+    for (int i = 0; i < made; i++)
+    {
+        close(spare[i][0]);
+        close(spare[i][1]);
+    }
+    free(spare);
+    return result;
+}
+
+// reads the pending bytes a splice could not take out of the pipe in and
+// writes them to the files that still miss them, 0 on success
+static int copy_pending(int in, const int *files, int nfiles, size_t pending)
+{
+    char *buf = malloc(BUFFER);
+    if (buf == NULL)
+    {
+        return -1;
+    }
+    int result = 0;
+    while (pending > 0 && result == 0)
+    {
+        ssize_t got = read(in, buf, pending < BUFFER ? pending : BUFFER);
+        if (got < 0 && retry())
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            result = -1;
+            break;
+        }
+        for (int i = 0; i < nfiles && result == 0; i++)
+        {
+            result = write_all(files[i], buf, got);
+        }
+        pending -= got;
+    }
+    free(buf);
+    return result;
+}
+
+int tee_fds(int in, int out, const int *files, int nfiles)
+{
+    // with no files it is a plain copy
+    if (nfiles == 0)
+    {
+        return copy_fd(in, out);
+    }
+    begin();
+
+    // tee(2) only goes from pipe to pipe, and splice cannot append
+    int in_kernel = is_pipe(in) && is_pipe(out);
+    for (int i = 0; i < nfiles && in_kernel; i++)
+    {
+        in_kernel = is_file(files[i]) && !(fcntl(files[i], F_GETFL) & O_APPEND);
+    }
+
+    // where a file turns out not to take a splice, the files that miss the
+    // last chunk get it from the pipe and the rest goes through a buffer
+    int result = 1;
+    if (in_kernel)
+    {
+        size_t pending = 0;
+        int done = 0;
+        result = tee_in_kernel(in, out, files, nfiles, &pending, &done);
+        if (result == 1 && copy_pending(in, files + done, nfiles - done, pending) != 0)
+        {
+            result = -1;
+        }
+    }
+    if (result == 1)
+    {
+        result = copy_buffered(in, out, files, nfiles);
+    }
+    return end(result);
+}
@@ -0,0 +1,16 @@
+#ifndef COPY_H
+#define COPY_H
+
+// moving data between descriptors for the cat and tee builtins without
+// bringing it through user space where the kernel allows: splice when one
+// side is a pipe, copy_file_range between files, and read/write otherwise.
+// a ctrl c stops a copy in progress (and makes it fail).
+
+// copies everything from in to out, returns 0 on success, -1 with errno set
+int copy_fd(int in, int out);
+
+// copies everything from in to out and to each of the nfiles files,
+// returns 0 on success, -1 with errno set
+int tee_fds(int in, int out, const int *files, int nfiles);
+
+#endif
@@ -1,53 +1,97 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
 #include "dynamicstring.h"
 
-dynamicstring_t *DynamicString_Create(const char *input)
+// the structs are carved out of slabs and recycled through a freelist, so
+// creating and freeing strings does not go to malloc for the struct.
+// the slabs are kept for the life of the process. not thread safe.
+#define DYNAMICSTRING_SLAB 64
+
+typedef union dynamicstring_slot
 {
+    dynamicstring_t str;
+    union dynamicstring_slot *next;
+} dynamicstring_slot_t;
 
-    // malloc space for the newly created struct
-    dynamicstring_t *temp = malloc(sizeof(dynamicstring_t));
+static dynamicstring_slot_t *free_slots = NULL;
 
-    // check if malloc failed
-    if (temp == NULL)
+// take a struct from the pool, with a new slab if it is empty
+static dynamicstring_t *new_header(void)
+{
+    if (free_slots == NULL)
     {
-        return NULL;
-    }
+        dynamicstring_slot_t *slab = malloc(sizeof(dynamicstring_slot_t) * DYNAMICSTRING_SLAB);
 
-    // loop through until the null terminator to get the length
-    size_t length = 0;
-    for (size_t i = 0; input[i] != '\0'; i++)
-    {
-        length++;
+        // check if malloc failed
+        if (slab == NULL)
+        {
+            return NULL;
+        }
+        for (int i = DYNAMICSTRING_SLAB - 1; i >= 0; i--)
+        {
+            slab[i].next = free_slots;
+            free_slots = &slab[i];
+        }
     }
+    dynamicstring_slot_t *slot = free_slots;
+    free_slots = slot->next;
+    return &slot->str;
+}
 
-    // update struct values
-    temp->length = length;
-    temp->capacity = length + 1;
+// give a struct back to the pool
+static void free_header(dynamicstring_t *str)
+{
+    dynamicstring_slot_t *slot = (dynamicstring_slot_t *)str;
+    slot->next = free_slots;
+    free_slots = slot;
+}
 
-    // allocate space for the string
-    temp->buf = (char *)malloc(sizeof(char) * temp->capacity);
+// new string holding a copy of 'length' chars from 'input'
+static dynamicstring_t *new_string(const char *input, size_t length)
+{
+    dynamicstring_t *temp = new_header();
 
-    // check if malloc fails
-    if (temp->buf == NULL)
+    // check if the pool could not grow
+    if (temp == NULL)
     {
-        free(temp);
         return NULL;
     }
 
-    // loop through and copy the values in
-    for (size_t i = 0; i < length; i++)
+    // short strings live inline, others get exactly the space they need
+    if (length < DYNAMICSTRING_INLINE)
+    {
+        temp->buf = temp->small;
+        temp->capacity = DYNAMICSTRING_INLINE;
+    }
+    else
     {
-        temp->buf[i] = input[i];
+        temp->buf = malloc(length + 1);
+
+        // check if malloc fails
+        if (temp->buf == NULL)
+        {
+            free_header(temp);
+            return NULL;
+        }
+        temp->capacity = length + 1;
     }
+    temp->length = length;
 
-    // make sure to terminate once the word is done
+    // copy the values in and terminate once the word is done
+    memcpy(temp->buf, input, length);
     temp->buf[length] = '\0';
 
     return temp;
 }
 
+dynamicstring_t *DynamicString_Create(const char *input)
+{
+    return new_string(input, strlen(input));
+}
+
 // Free's the dynamic string and free's the underlying memory of the dynamicstring_t.
 int DynamicString_Free(dynamicstring_t *str)
 {
@@ -57,53 +101,73 @@ int DynamicString_Free(dynamicstring_t *str)
         return 0;
     }
 
-    // if there is a buf, free it
-    if (str->buf)
+    // if there is a buf on the heap, free it
+    if (str->buf && str->buf != str->small)
     {
         free(str->buf);
     }
-    // finally free the str
-    free(str);
+    // finally give the str back to the pool
+    free_header(str);
 
     return 1;
 }
 
-// Append a single character to our dynamic string
-int DynamicString_AppendChar(dynamicstring_t *str, char c)
+// Grow the buffer so it holds at least 'capacity' bytes
+int DynamicString_Reserve(dynamicstring_t *str, size_t capacity)
 {
-
-    int result;
-
     // NULL check
     if (str == NULL)
     {
-        result = 0;
-        return result;
+        return 0;
     }
 
-    // If no room for new char + '\0', grow the buffer
-    if (str->length + 1 >= str->capacity)
+    // already big enough
+    if (capacity <= str->capacity)
     {
-        size_t newcap;
-        // start with 16 in empty 
-        if (str->capacity == 0)
-        {
-            newcap = 16; 
-        }
-        // otherwise double it 
-        else
-        {
-            newcap = str->capacity * 2; 
-        }
-        char *newbuf = realloc(str->buf, newcap);
+        return 1;
+    }
+
+    // start with 16 in empty, otherwise double it until it fits, or take
+    // exactly what was asked for once doubling would overflow
+    size_t newcap = str->capacity == 0 ? 16 : str->capacity;
+    while (newcap < capacity)
+    {
+        newcap = newcap > SIZE_MAX / 2 ? capacity : newcap * 2;
+    }
 
-        // check allocation 
-        if (newbuf == NULL)
+    // an inline string moves to the heap, which realloc cannot do
+    char *newbuf;
+    if (str->buf == str->small)
+    {
+        newbuf = malloc(newcap);
+        if (newbuf != NULL)
         {
-            return 0; 
+            memcpy(newbuf, str->small, str->length + 1);
         }
-        str->buf = newbuf;
-        str->capacity = newcap;
+    }
+    else
+    {
+        newbuf = realloc(str->buf, newcap);
+    }
+
+    // check allocation
+    if (newbuf == NULL)
+    {
+        return 0;
+    }
+    str->buf = newbuf;
+    str->capacity = newcap;
+
+    return 1;
+}
+
+// Append a single character to our dynamic string
+int DynamicString_AppendChar(dynamicstring_t *str, char c)
+{
+    // If no room for new char + '\0', grow the buffer
+    if (str == NULL || !DynamicString_Reserve(str, str->length + 2))
+    {
+        return 0;
     }
 
     // append char and null-terminate
@@ -111,49 +175,52 @@ int DynamicString_AppendChar(dynamicstring_t *str, char c)
     str->length++;
     str->buf[str->length] = '\0';
 
-
-    // Indicating success
-    result = 1;
-
-    return result;
+    return 1;
 }
 
-
-// Allocates a new 'string'
-dynamicstring_t *DynamicString_NewStringFromSlice(dynamicstring_t *str, int start, int end)
+// Append n chars at once
+int DynamicString_AppendN(dynamicstring_t *str, const char *src, size_t n)
 {
-
-    // NULL check and check bounds for start and end indices
-    if (str == NULL || start < 0 || end < 0 || start >= (int)str->length || end > (int)str->length || end <= start)
+    // NULL check
+    if (str == NULL || (src == NULL && n > 0))
     {
-        return NULL;
+        return 0;
     }
 
-    // get the size of the new string
-    size_t new_length = end - start;
-
-    // malloc space for new string
-    char *new_string = (char *)malloc(sizeof(char) * (new_length + 1));
+    // src may be a part of our own string, which the realloc below can move
+    int own = str->buf != NULL && src >= str->buf && src < str->buf + str->length;
+    size_t from = own ? (size_t)(src - str->buf) : 0;
 
-    // check if malloc failed
-    if (new_string == NULL)
+    // room for the chars + '\0', which must not wrap around
+    if (n > SIZE_MAX - str->length - 1 || !DynamicString_Reserve(str, str->length + n + 1))
     {
-        return NULL;
+        return 0;
     }
-
-    // loop through and copy of the chars
-    for (size_t i = 0; i < new_length; i++)
+    if (own)
     {
-        new_string[i] = str->buf[start + i];
+        src = str->buf + from;
     }
-    new_string[new_length] = '\0';
 
-    // use the create function to make a new string
-    dynamicstring_t *string = DynamicString_Create(new_string);
+    // only the part before 'length' can be read, so it never overlaps
+    memcpy(str->buf + str->length, src, n);
+    str->length += n;
+    str->buf[str->length] = '\0';
+
+    return 1;
+}
 
-    free(new_string);
+// Allocates a new 'string'
+dynamicstring_t *DynamicString_NewStringFromSlice(dynamicstring_t *str, int start, int end)
+{
 
-    return string;
+    // NULL check and check bounds for start and end indices
+    if (str == NULL || start < 0 || end < 0 || start >= (int)str->length || end > (int)str->length || end <= start)
+    {
+        return NULL;
+    }
+
+    // copy the chars straight from the slice
+    return new_string(str->buf + start, end - start);
 }
 
 // Split a dynamic string into multiple dynamic strings that are returned in the output parameter.
@@ -281,3 +348,71 @@ int DynamicString_Split(dynamicstring_t *input, const char *delimeters, dynamics
 
     return result;
 }
+
+// Split into (offset, length) views, in one pass over the input
+int DynamicString_SplitViews(const dynamicstring_t *input, const char *delimeters, dynamicstring_view_t **views, int *size)
+{
+    // NULL check
+    if ((delimeters == NULL) || (input == NULL) || views == NULL || size == NULL)
+    {
+        return 0;
+    }
+
+    // one bit per byte value, so each char is checked with a single lookup
+    // instead of against every delimiter
+    uint64_t table[4] = {0, 0, 0, 0};
+    for (size_t j = 0; delimeters[j] != '\0'; j++)
+    {
+        unsigned char d = (unsigned char)delimeters[j];
+        table[d >> 6] |= (uint64_t)1 << (d & 63);
+    }
+
+    dynamicstring_view_t *array = NULL;
+    int counter = 0;
+    int capacity = 0;
+    size_t start = 0;
+
+    // the last round (i == length) closes the last token
+    for (size_t i = 0; i <= input->length; i++)
+    {
+        if (i < input->length)
+        {
+            unsigned char c = (unsigned char)input->buf[i];
+            if ((table[c >> 6] & ((uint64_t)1 << (c & 63))) == 0)
+            {
+                continue;
+            }
+        }
+
+        // makes sure we dont create empty tokens with consecutive delimiters
+        if (i > start)
+        {
+            // grow the array by doubling
+            if (counter == capacity)
+            {
+                int newcap = capacity == 0 ? 8 : capacity * 2;
+                dynamicstring_view_t *newarray = realloc(array, sizeof(dynamicstring_view_t) * newcap);
+
+                // check allocation
+                if (newarray == NULL)
+                {
+                    free(array);
+                    *views = NULL;
+                    *size = 0;
+                    return 0;
+                }
+                array = newarray;
+                capacity = newcap;
+            }
+            array[counter].offset = start;
+            array[counter].length = i - start;
+            counter++;
+        }
+        // move our start index
+        start = i + 1;
+    }
+
+    *views = array;
+    *size = counter;
+    return 1;
+}
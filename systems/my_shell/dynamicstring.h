@@ -5,15 +5,29 @@
 #include <stddef.h> 
 				
 
+// Strings of up to DYNAMICSTRING_INLINE - 1 chars are kept in the struct itself.
+#define DYNAMICSTRING_INLINE 16
+
 typedef struct dynamicstring{
 	char* buf;  // short for 'buffer'
 				// Holds the individual characters of the string.
+				// Points at 'small' until the string outgrows it, then at the heap.
 	size_t capacity; // How 'big' the buffer is, including the '\0' character
 	size_t length;   // The length of the string, NOT including the '\0' character
+	char small[DYNAMICSTRING_INLINE]; // inline storage for short strings, do not copy the struct by value
 
 }dynamicstring_t;
 
+// A piece of a string that is not copied out of it: 'length' chars starting at 'buf + offset'.
+// A view is only good while the string it points into is not changed.
+typedef struct dynamicstring_view{
+	size_t offset;
+	size_t length;
+}dynamicstring_view_t;
+
 // Input is a legal NULL terminated C style string
+// The struct comes from a pool that recycles freed strings, and a short input is
+// stored inline, so creating a short string usually does not call malloc at all.
 dynamicstring_t* DynamicString_Create(const char* input);
 
 // Free's the dynamic string and free's the underlying memory of the dynamicstring_t.
@@ -30,6 +44,16 @@ int DynamicString_Free(dynamicstring_t* str);
 //   - An example failure would be if malloc or realloc cannot allocate memory
 int DynamicString_AppendChar(dynamicstring_t* str, char c);
 
+// Makes sure the buffer holds at least 'capacity' bytes (including the '\0'), so that
+// appending up to 'capacity - 1' chars in total does not allocate again.
+// returns '1' on success, '0' on a NULL 'str' or if realloc cannot allocate memory.
+int DynamicString_Reserve(dynamicstring_t* str, size_t capacity);
+
+// Append 'n' chars from 'src' (which do not have to be '\0' terminated) with one copy.
+// Like AppendChar, the buffer grows by doubling and stays '\0' terminated.
+// returns '1' on success, '0' on failure.
+int DynamicString_AppendN(dynamicstring_t* str, const char* src, size_t n);
+
 // Allocates a new 'dynamicstring' based from a substring of an existing string.
 // The 'slice' or portion of the string is a new heap allocated dynamicstring.
 dynamicstring_t* DynamicString_NewStringFromSlice(dynamicstring_t* str, int start, int end);
@@ -38,4 +62,10 @@ dynamicstring_t* DynamicString_NewStringFromSlice(dynamicstring_t* str, int star
 // Returns '0' if there is an error, and 1 on success
 int DynamicString_Split(dynamicstring_t* input, const char* delimeters, dynamicstring_t*** array, int* size);
 
+// Split a dynamicstring based on delimeters without copying any of it.
+// 'views' is set to a heap array of the non-empty tokens as (offset, length) into 'input->buf',
+// which the caller frees with a single free(). It is NULL when there are no tokens.
+// Returns '0' if there is an error, and 1 on success
+int DynamicString_SplitViews(const dynamicstring_t* input, const char* delimeters, dynamicstring_view_t** views, int* size);
+
 #endif
@@ -0,0 +1,226 @@
+#define _GNU_SOURCE
+#include "./jobs.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+
+Job *jobs = NULL;
+int job_count = 0;
+static int job_capacity = 0;
+
+// stdin and every job's pidfd, and whether stdin could be added to it
+// (a regular file cannot, and is always readable anyway)
+static int epoll_fd = -1;
+static int stdin_watched = 0;
+
+// the tag of stdin in the epoll set, jobs are tagged with their pid
+#define STDIN_TAG 0
+
+// what was read from stdin but not handed out as a line yet
+static char input[4096];
+static size_t input_start = 0;
+static size_t input_end = 0;
+static int input_eof = 0;
+
+void jobs_init(void)
+{
+    epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0)
+    {
+        perror("epoll_create1");
+        return;
+    }
+    struct epoll_event ev = {.events = EPOLLIN, .data.u64 = STDIN_TAG};
+    stdin_watched = epoll_ctl(epoll_fd, EPOLL_CTL_ADD, STDIN_FILENO, &ev) == 0;
+}
+
+int add_job(pid_t pid, const char *command)
+{
+    // grow the table by doubling
+    if (job_count == job_capacity)
+    {
+        int capacity = job_capacity == 0 ? 16 : job_capacity * 2;
+        Job *grown = realloc(jobs, sizeof(Job) * capacity);
+
+        // check allocation
+        if (grown == NULL)
+        {
+            return 0;
+        }
+        jobs = grown;
+        job_capacity = capacity;
+    }
+
+    Job *job = &jobs[job_count++];
+    job->pid = pid;
+    strncpy(job->command, command, JOB_COMMAND_SIZE - 1);
+    job->command[JOB_COMMAND_SIZE - 1] = '\0';
+    job->running = 1;
+
+    // the pidfd becomes readable when the job exits, without a SIGCHLD
+    job->pidfd = syscall(SYS_pidfd_open, pid, 0);
+    if (job->pidfd >= 0 && epoll_fd >= 0)
+    {
+        struct epoll_event ev = {.events = EPOLLIN, .data.u64 = (uint64_t)pid};
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, job->pidfd, &ev);
+    }
+    return job_count;
+}
+
+void finish_job(int job_num)
+{
+    Job *job = &jobs[job_num - 1];
+    job->running = 0;
+
+    // closing the pidfd also takes it out of the epoll set
+    if (job->pidfd >= 0)
+    {
+        close(job->pidfd);
+        job->pidfd = -1;
+    }
+
+    // drop the finished jobs at the end of the table
+    while (job_count > 0 && !jobs[job_count - 1].running)
+    {
+        job_count--;
+    }
+}
+
+// reaps a job that exited and says so
+static void job_exited(int job_num)
+{
+    int status;
+    if (waitpid(jobs[job_num - 1].pid, &status, WNOHANG) > 0)
+    {
+        printf("job %d finished\n", job_num);
+        finish_job(job_num);
+    }
+}
+
+// makes sure we have no zombie processess!
+// only for jobs without a pidfd, which cannot tell when they are done
+static void no_zombies(void)
+{
+    for (int i = 0; i < job_count; i++)
+    {
+        if (jobs[i].running && jobs[i].pidfd < 0)
+        {
+            job_exited(i + 1);
+        }
+    }
+}
+
+// one look at the epoll set, reaping the jobs that finished
+// returns 1 if stdin is readable (or not watched), 0 if not, -1 on error
+static int handle_events(int timeout)
+{
+    struct epoll_event events[64];
+    int n = epoll_wait(epoll_fd, events, 64, timeout);
+    if (n < 0)
+    {
+        // a signal handler ran, ctrl c redisplays the prompt itself
+        return errno == EINTR ? 0 : -1;
+    }
+
+    int ready = !stdin_watched;
+    for (int i = 0; i < n; i++)
+    {
+        if (events[i].data.u64 == STDIN_TAG)
+        {
+            ready = 1;
+        }
+    }
+
+    // while blocked with nothing typed yet the prompt is showing, so the
+    // reports go on lines of their own under it and the prompt is put back after
+    int at_prompt = timeout != 0 && !ready;
+    int reported = 0;
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; events[i].data.u64 != STDIN_TAG && j < job_count; j++)
+        {
+            if (jobs[j].running && (uint64_t)jobs[j].pid == events[i].data.u64)
+            {
+                if (at_prompt && !reported)
+                {
+                    putchar('\n');
+                }
+                job_exited(j + 1);
+                reported = 1;
+                break;
+            }
+        }
+    }
+    if (at_prompt && reported)
+    {
+        printf("mini-shell> ");
+        fflush(stdout);
+    }
+
+    // a full batch may have left more behind, an error there is still one
+    if (n == 64)
+    {
+        int more = handle_events(0);
+        return more < 0 ? more : more || ready;
+    }
+    return ready;
+}
+
+char *read_line(char *str, int size)
+{
+    // jobs that finished since the last line, even if the next one is buffered
+    no_zombies();
+    if (epoll_fd >= 0)
+    {
+        handle_events(0);
+    }
+
+    while (1)
+    {
+        // hand out a buffered line, or as much of it as fits like fgets
+        size_t available = input_end - input_start;
+        char *newline = memchr(input + input_start, '\n', available);
+        if (newline != NULL || available >= (size_t)size - 1 || (input_eof && available > 0))
+        {
+            size_t n = newline != NULL ? (size_t)(newline - (input + input_start)) + 1 : available;
+            if (n > (size_t)size - 1)
+            {
+                n = size - 1;
+            }
+            memcpy(str, input + input_start, n);
+            str[n] = '\0';
+            input_start += n;
+            return str;
+        }
+        if (input_eof)
+        {
+            return NULL;
+        }
+
+        // move the partial line to the front and read more after it
+        memmove(input, input + input_start, available);
+        input_start = 0;
+        input_end = available;
+
+        // block until stdin is readable, handling the jobs that finish meanwhile
+        // an unwatched stdin is always ready, so it only looks for jobs
+        while (epoll_fd >= 0 && handle_events(stdin_watched ? -1 : 0) == 0)
+        {
+        }
+        ssize_t got = read(STDIN_FILENO, input + input_end, sizeof(input) - input_end);
+        if (got > 0)
+        {
+            input_end += got;
+        }
+        else if (got == 0 || errno != EINTR)
+        {
+            input_eof = 1;
+        }
+    }
+}
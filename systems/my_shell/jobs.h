@@ -0,0 +1,35 @@
+#ifndef JOBS_H
+#define JOBS_H
+#include <sys/types.h>
+
+#define JOB_COMMAND_SIZE 80
+
+// defining job structure
+typedef struct
+{
+    pid_t pid;
+    int pidfd;   // readable once the job exits, -1 if the kernel has no pidfds
+    char command[JOB_COMMAND_SIZE];
+    int running; // 1 if active, 0 if finished
+} Job;
+
+// the job table, job n is jobs[n - 1]
+// it grows as needed, finished jobs leave holes (running == 0) that are
+// dropped once no later job is left, so numbers stay put while jobs are alive
+extern Job *jobs;
+extern int job_count;
+
+// sets up the epoll set that watches stdin and the jobs
+void jobs_init(void);
+
+// records a job and starts watching it, returns its number or 0 without memory
+int add_job(pid_t pid, const char *command);
+
+// a job that was reaped elsewhere (by fg): stops watching it and frees its slot
+void finish_job(int job_num);
+
+// the next line of stdin like fgets, except that while it waits, jobs that
+// finish are reaped and reported right away. returns NULL at end of input
+char *read_line(char *str, int size);
+
+#endif
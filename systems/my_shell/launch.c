@@ -0,0 +1,144 @@
+#define _GNU_SOURCE
+#include "./launch.h"
+#include "./pathcache.h"
+#include <errno.h>
+#include <sched.h>
+#include <signal.h>
+#include <spawn.h>
+#include <unistd.h>
+
+extern char **environ;
+
+// glibc 2.35 can hand the terminal over inside the child, otherwise the
+// caller's tcsetpgrp after the spawn is the only one
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 35))
+#define SPAWN_TCSETPGRP 1
+#endif
+
+pid_t spawn_command(char **argv, const spawn_options_t *options)
+{
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t actions;
+    short flags = POSIX_SPAWN_SETSIGDEF | POSIX_SPAWN_SETSIGMASK;
+
+    posix_spawnattr_init(&attr);
+    posix_spawn_file_actions_init(&actions);
+
+    // restore default signals so that interrupts affect the child and not the shell
+    sigset_t defaults;
+    sigemptyset(&defaults);
+    sigaddset(&defaults, SIGINT);
+    sigaddset(&defaults, SIGTSTP);
+    sigaddset(&defaults, SIGTTIN);
+    sigaddset(&defaults, SIGTTOU);
+    posix_spawnattr_setsigdefault(&attr, &defaults);
+
+    sigset_t mask;
+    sigemptyset(&mask);
+    posix_spawnattr_setsigmask(&attr, &mask);
+
+    // set up the process group
+    if (options->pgroup >= 0)
+    {
+        flags |= POSIX_SPAWN_SETPGROUP;
+        posix_spawnattr_setpgroup(&attr, options->pgroup);
+    }
+    posix_spawnattr_setflags(&attr, flags);
+
+    // connect the pipes
+    if (options->in_fd >= 0)
+    {
+        posix_spawn_file_actions_adddup2(&actions, options->in_fd, STDIN_FILENO);
+    }
+    if (options->out_fd >= 0)
+    {
+        posix_spawn_file_actions_adddup2(&actions, options->out_fd, STDOUT_FILENO);
+    }
+
+#ifdef SPAWN_TCSETPGRP
+    // gives terminal control to the new group before the command can read
+    if (options->foreground && isatty(STDIN_FILENO))
+    {
+        posix_spawn_file_actions_addtcsetpgrp_np(&actions, STDIN_FILENO);
+    }
+#endif
+
+    // find the command through the cache instead of an exec per $PATH directory
+    pid_t pid;
+    int cached;
+    int error = ENOENT;
+    const char *path = pathcache_lookup(argv[0], &cached);
+    if (path != NULL)
+    {
+        error = posix_spawn(&pid, path, &actions, &attr, argv, environ);
+    }
+
+    // the cached file may have moved or gone, so look for it once more
+    if (error != 0 && cached)
+    {
+        pathcache_forget(argv[0]);
+        path = pathcache_lookup(argv[0], &cached);
+        error = path != NULL ? posix_spawn(&pid, path, &actions, &attr, argv, environ) : ENOENT;
+    }
+
+    // like execvp, take a file the kernel cannot run for a script without a
+    // #! line and run it with /bin/sh
+    if (error == ENOEXEC)
+    {
+        int count = 0;
+        while (argv[count] != NULL)
+        {
+            count++;
+        }
+        char *script[count + 2];
+        script[0] = "/bin/sh";
+        script[1] = (char *)path;
+        for (int i = 1; i <= count; i++)
+        {
+            script[i + 1] = argv[i];
+        }
+        error = posix_spawn(&pid, "/bin/sh", &actions, &attr, script, environ);
+    }
+
+    posix_spawn_file_actions_destroy(&actions);
+    posix_spawnattr_destroy(&attr);
+
+    if (error != 0)
+    {
+        errno = error;
+        return -1;
+    }
+    return pid;
+}
+
+int place_stage(pid_t pid, int stage, int stages, placement_t policy)
+{
+    if (policy == PLACE_NONE)
+    {
+        return 1;
+    }
+
+    // the CPUs the shell itself may use, in order
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0)
+    {
+        return 0;
+    }
+    int cpus[CPU_SETSIZE];
+    int ncpus = 0;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+    {
+        if (CPU_ISSET(cpu, &allowed))
+        {
+            cpus[ncpus++] = cpu;
+        }
+    }
+
+    // spread leaves the same gap between stages, compact puts them side by side
+    int index = policy == PLACE_SPREAD ? (int)((long)stage * ncpus / stages) : stage % ncpus;
+
+    cpu_set_t one;
+    CPU_ZERO(&one);
+    CPU_SET(cpus[index], &one);
+    return sched_setaffinity(pid, sizeof(one), &one) == 0;
+}
@@ -0,0 +1,34 @@
+#ifndef LAUNCH_H
+#define LAUNCH_H
+#include <sys/types.h>
+
+// how spawn_command sets up the child before the command runs
+typedef struct spawn_options
+{
+    int in_fd;      // becomes stdin, or -1 to keep the shell's
+    int out_fd;     // becomes stdout, or -1 to keep the shell's
+    pid_t pgroup;   // 0 for a new group of its own, > 0 to join that group, -1 to stay in the shell's
+    int foreground; // hand the terminal to the child's group before it runs
+} spawn_options_t;
+
+// starts argv[0], found through the PATH cache, with posix_spawn instead of fork + exec, so
+// the shell's address space is never copied. the child gets SIGINT, SIGTSTP,
+// SIGTTIN and SIGTTOU back at their defaults and no blocked signals.
+// descriptors the child must not keep should be O_CLOEXEC.
+// returns the child's pid, or -1 with errno set if it could not be started
+// (ENOENT when the command does not exist)
+pid_t spawn_command(char **argv, const spawn_options_t *options);
+
+// where the stages of a pipeline run
+typedef enum
+{
+    PLACE_NONE,    // wherever the scheduler puts them
+    PLACE_SPREAD,  // as far apart as the shell's CPUs allow
+    PLACE_COMPACT, // on neighbouring CPUs, wrapping around
+} placement_t;
+
+// pins stage (0 based) of a pipeline of stages to one of the CPUs the shell
+// may run on, as policy says. returns 0 with errno set if it could not be pinned
+int place_stage(pid_t pid, int stage, int stages, placement_t policy);
+
+#endif
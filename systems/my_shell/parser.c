@@ -1,74 +1,96 @@
 #include "./parser.h"
+#include <stdlib.h>
 #include <string.h>
-#include <stdio.h>
 
-
-static void append(dynamicstring_t *dst, const char *op)
+// length of the operator c starts with, or 0 if it is not one
+static int operator_length(const char *c)
 {
-    DynamicString_AppendChar(dst, ' ');
-
-    for (int i = 0; op[i] != '\0'; i++)
+    // check multi-char ops
+    if ((c[0] == '|' && c[1] == '|') ||
+        (c[0] == '&' && c[1] == '&') ||
+        (c[0] == '>' && c[1] == '>'))
+    {
+        return 2;
+    }
+    // single-char ops
+    if (c[0] == '|' || c[0] == '<' || c[0] == '>' || c[0] == ';')
     {
-        DynamicString_AppendChar(dst, op[i]);
+        return 1;
     }
-    DynamicString_AppendChar(dst, ' ');
+    return 0;
 }
 
-dynamicstring_t *pre_process(dynamicstring_t *input)
+int run_parser(const char *line, cmdline_t *cmd)
 {
-    dynamicstring_t *new = DynamicString_Create("");
+    size_t length = strlen(line);
+
+    // every token is at least one byte of the line, so there are at most
+    // length of them, and the text is at most the line plus a NUL for each
+    size_t slots = length + 1;
+    char **argv = malloc(sizeof(char *) * slots + 2 * length + 1);
 
-    for (int i = 0; i < input->length; i++)
+    // check malloc allocation
+    if (argv == NULL)
     {
-        char c = input->buf[i];
+        cmd->argv = NULL;
+        cmd->count = 0;
+        return 0;
+    }
 
-        // check multi-char ops
-        if ((c == '|' && input->buf[i + 1] == '|') ||
-            (c == '&' && input->buf[i + 1] == '&'))
-        {
-            char op[3] = {c, input->buf[i + 1], '\0'};
-            append(new, op);
-            i++;
-        }
-        // single-char ops
-        else if (c == '|' || c == '<' || c == '>' || c == ';')
+    char *out = (char *)(argv + slots);
+    int count = 0;
+    int in_word = 0;
+    const char *c = line;
+    while (*c != '\0')
+    {
+        int op = operator_length(c);
+
+        // a space or an operator ends the word being written
+        if (*c == ' ' || op > 0)
         {
-            char op[2] = {c, '\0'};
-            append(new, op);
+            if (in_word)
+            {
+                *out++ = '\0';
+                in_word = 0;
+            }
+            // an operator is a token of its own
+            if (op > 0)
+            {
+                argv[count++] = out;
+                memcpy(out, c, op);
+                out += op;
+                *out++ = '\0';
+                c += op;
+            }
+            else
+            {
+                c++;
+            }
+            continue;
         }
-        // normal char
-        else
+
+        // normal char, starting a word if it is the first
+        if (!in_word)
         {
-            DynamicString_AppendChar(new, c);
+            argv[count++] = out;
+            in_word = 1;
         }
+        *out++ = *c++;
     }
-
-    DynamicString_Free(input);
-    return new;
-}
-
-dynamicstring_t **parse(dynamicstring_t ***array, dynamicstring_t *string, int *count)
-{
-
-    int result = DynamicString_Split(string, " ", array, count);
-    if (result == 0)
+    if (in_word)
     {
-        return NULL;
+        *out = '\0';
     }
+    argv[count] = NULL;
 
-    return *array;
+    cmd->argv = argv;
+    cmd->count = count;
+    return 1;
 }
 
-
-dynamicstring_t **run_parser(char **argv, int *count)
+void free_cmdline(cmdline_t *cmd)
 {
-    dynamicstring_t *string = DynamicString_Create(argv[1]);
-    dynamicstring_t *input = pre_process(string);
-
-    dynamicstring_t **array = NULL;
-    parse(&array, input, count);
-
-    DynamicString_Free(input);
-
-    return array;
-}
\ No newline at end of file
+    free(cmd->argv);
+    cmd->argv = NULL;
+    cmd->count = 0;
+}
@@ -1,8 +1,20 @@
 #ifndef PARSER_H
 #define PARSER_H
-#include "./dynamicstring.h"
 
-dynamicstring_t **run_parser(char **argv, int *count);
+// one command line split into words and operators
+// the tokens are written NUL terminated into a single block, right after
+// the argv array that points at them, so one free() releases everything
+typedef struct cmdline
+{
+    char **argv; // NULL terminated, and the start of the block
+    int count;   // tokens in argv
+} cmdline_t;
 
-#endif
+// splits line on spaces and around the operators && || | < > >> ;
+// in one pass. returns 1 on success, 0 if the block cannot be allocated.
+int run_parser(const char *line, cmdline_t *cmd);
+
+// frees the block of a parsed line
+void free_cmdline(cmdline_t *cmd);
 
+#endif
@@ -0,0 +1,234 @@
+#include "./pathcache.h"
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// used when $PATH is not set, like execvp
+#define DEFAULT_PATH "/bin:/usr/bin"
+
+typedef struct entry
+{
+    struct entry *next;
+    uint32_t hash;
+    unsigned hits;
+    char *path;   // points into text, after the name
+    char text[];  // name '\0' path '\0'
+} entry_t;
+
+static entry_t **buckets = NULL;
+static size_t nbuckets = 0;
+static size_t nentries = 0;
+
+// the $PATH the entries were found on
+static char *cached_path = NULL;
+
+// FNV-1a
+static uint32_t hash_name(const char *name)
+{
+    uint32_t h = 2166136261u;
+    for (const unsigned char *c = (const unsigned char *)name; *c != '\0'; c++)
+    {
+        h = (h ^ *c) * 16777619u;
+    }
+    return h;
+}
+
+void pathcache_clear(void)
+{
+    for (size_t i = 0; i < nbuckets; i++)
+    {
+        entry_t *e = buckets[i];
+        while (e != NULL)
+        {
+            entry_t *next = e->next;
+            free(e);
+            e = next;
+        }
+        buckets[i] = NULL;
+    }
+    nentries = 0;
+}
+
+// drops everything if $PATH is not the one the entries were found on
+static const char *check_path(void)
+{
+    const char *path = getenv("PATH");
+    if (path == NULL)
+    {
+        path = DEFAULT_PATH;
+    }
+    if (cached_path == NULL || strcmp(cached_path, path) != 0)
+    {
+        pathcache_clear();
+        free(cached_path);
+        cached_path = strdup(path);
+    }
+    return path;
+}
+
+static entry_t **find(const char *name, uint32_t hash)
+{
+    if (nbuckets == 0)
+    {
+        return NULL;
+    }
+    entry_t **link = &buckets[hash & (nbuckets - 1)];
+    while (*link != NULL && ((*link)->hash != hash || strcmp((*link)->text, name) != 0))
+    {
+        link = &(*link)->next;
+    }
+    return link;
+}
+
+// doubles the buckets when there are more entries than buckets
+static int grow(void)
+{
+    size_t size = nbuckets == 0 ? 64 : nbuckets * 2;
+    entry_t **next = calloc(size, sizeof(entry_t *));
+
+    // check allocation
+    if (next == NULL)
+    {
+        return 0;
+    }
+    for (size_t i = 0; i < nbuckets; i++)
+    {
+        entry_t *e = buckets[i];
+        while (e != NULL)
+        {
+            entry_t *after = e->next;
+            e->next = next[e->hash & (size - 1)];
+            next[e->hash & (size - 1)] = e;
+            e = after;
+        }
+    }
+    free(buckets);
+    buckets = next;
+    nbuckets = size;
+    return 1;
+}
+
+// first executable regular file called name in a directory of path
+// writes it to out, which has room for PATH_MAX bytes. names that would not
+// fit are skipped
+static int search(const char *path, const char *name, char *out, int *absolute)
+{
+    size_t name_length = strlen(name);
+    const char *dir = path;
+    while (1)
+    {
+        const char *end = strchr(dir, ':');
+        size_t length = end != NULL ? (size_t)(end - dir) : strlen(dir);
+
+        if (length + name_length + 2 <= PATH_MAX)
+        {
+            // an empty element is the current directory
+            if (length == 0)
+            {
+                memcpy(out, name, name_length + 1);
+            }
+            else
+            {
+                memcpy(out, dir, length);
+                out[length] = '/';
+                memcpy(out + length + 1, name, name_length + 1);
+            }
+
+            struct stat st;
+            if (stat(out, &st) == 0 && S_ISREG(st.st_mode) && access(out, X_OK) == 0)
+            {
+                *absolute = length > 0 && dir[0] == '/';
+                return 1;
+            }
+        }
+
+        if (end == NULL)
+        {
+            return 0;
+        }
+        dir = end + 1;
+    }
+}
+
+const char *pathcache_lookup(const char *name, int *cached)
+{
+    *cached = 0;
+
+    // a path is not looked up
+    if (strchr(name, '/') != NULL)
+    {
+        return name;
+    }
+
+    const char *path = check_path();
+    uint32_t hash = hash_name(name);
+    entry_t **link = find(name, hash);
+    if (link != NULL && *link != NULL)
+    {
+        *cached = 1;
+        (*link)->hits++;
+        return (*link)->path;
+    }
+
+    // walk $PATH
+    static char found[PATH_MAX];
+    int absolute;
+    if (!search(path, name, found, &absolute))
+    {
+        return NULL;
+    }
+
+    // only a path that means the same from every directory is kept
+    if (!absolute || (nentries >= nbuckets && !grow()))
+    {
+        return found;
+    }
+    size_t name_size = strlen(name) + 1;
+    size_t path_size = strlen(found) + 1;
+    entry_t *e = malloc(sizeof(entry_t) + name_size + path_size);
+
+    // check allocation, the path can still be used once
+    if (e == NULL)
+    {
+        return found;
+    }
+    memcpy(e->text, name, name_size);
+    e->path = e->text + name_size;
+    memcpy(e->path, found, path_size);
+    e->hash = hash;
+    e->hits = 1;
+
+    link = &buckets[hash & (nbuckets - 1)];
+    e->next = *link;
+    *link = e;
+    nentries++;
+    return e->path;
+}
+
+void pathcache_forget(const char *name)
+{
+    entry_t **link = find(name, hash_name(name));
+    if (link != NULL && *link != NULL)
+    {
+        entry_t *e = *link;
+        *link = e->next;
+        free(e);
+        nentries--;
+    }
+}
+
+void pathcache_each(void (*fn)(const char *name, const char *path, unsigned hits))
+{
+    // entries only count for the $PATH they were found on
+    check_path();
+    for (size_t i = 0; i < nbuckets; i++)
+    {
+        for (entry_t *e = buckets[i]; e != NULL; e = e->next)
+        {
+            fn(e->text, e->path, e->hits);
+        }
+    }
+}
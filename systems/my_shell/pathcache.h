@@ -0,0 +1,26 @@
+#ifndef PATHCACHE_H
+#define PATHCACHE_H
+
+// remembers where on $PATH each command was found, like the hash table of
+// bash, so launching a command again does not walk $PATH with a failing
+// exec per directory. the whole cache is dropped when $PATH changes.
+
+// absolute path of the command called name, from the cache or from a walk of
+// $PATH whose result is then cached. a name with a '/' is returned as it is.
+// *cached is set to 1 if the path came from the cache, which does not check it
+// still exists: if running it fails, pathcache_forget the name and look again.
+// a path that is not kept (found through a relative directory on $PATH) is
+// only good until the next lookup.
+// returns NULL if no directory on $PATH has an executable of that name
+const char *pathcache_lookup(const char *name, int *cached);
+
+// drops one name, after its cached path stopped working
+void pathcache_forget(const char *name);
+
+// drops every name
+void pathcache_clear(void);
+
+// calls fn for every cached name with its path and how often it was used
+void pathcache_each(void (*fn)(const char *name, const char *path, unsigned hits));
+
+#endif
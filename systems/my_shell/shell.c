@@ -1,8 +1,13 @@
-
+#define _GNU_SOURCE
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
 #include "parser.h"
+#include "launch.h"
+#include "pathcache.h"
+#include "jobs.h"
+#include "copy.h"
 #include <sys/wait.h>
 #include <signal.h>
 #include <stdlib.h>
@@ -10,7 +15,6 @@
 
 #define BUFFER_SIZE 80
 #define PATH_MAX 1024
-#define MAX_JOBS 5
 #define HISTORY_SIZE 50
 
 // defining necessary global variables
@@ -19,26 +23,66 @@ static char history[HISTORY_SIZE][BUFFER_SIZE];
 static int history_count = 0;
 static volatile sig_atomic_t fg_pid = -1;
 
-// defining job structure
-typedef struct
-{
-  pid_t pid;
-  char command[BUFFER_SIZE];
-  int running; // 1 if active, 0 if finished
-} Job;
-
-Job jobs[MAX_JOBS];
-int job_count = 0;
+// pipeline options, see my_pipeline
+static int pipe_size = 0; // bytes, 0 for the kernel's default
+static placement_t pipe_placement = PLACE_NONE;
 
 // defining structure to hold all of our built-ins
 typedef struct
 {
   const char *name;
   int (*ptr)(char **);
+  // runs as long as its input lasts, so it gets a process of its own like
+  // any command, which & and ctrl z can act on
+  int process;
 } builtin;
 
 extern builtin array[];
 
+// builtins by name, hashed so dispatch is one probe instead of a strcmp per builtin
+#define BUILTIN_SLOTS 32
+static builtin *builtin_slots[BUILTIN_SLOTS];
+static int builtins_hashed = 0;
+
+unsigned builtin_hash(const char *name)
+{
+  unsigned h = 5381;
+  for (; *name != '\0'; name++)
+  {
+    h = h * 33 + (unsigned char)*name;
+  }
+  return h & (BUILTIN_SLOTS - 1);
+}
+
+// finds the builtin called name, or NULL if it is not one
+builtin *find_builtin(const char *name)
+{
+  // fill the table from array[] on first use
+  if (!builtins_hashed)
+  {
+    for (int i = 0; array[i].name != NULL; i++)
+    {
+      unsigned slot = builtin_hash(array[i].name);
+      while (builtin_slots[slot] != NULL)
+      {
+        slot = (slot + 1) & (BUILTIN_SLOTS - 1);
+      }
+      builtin_slots[slot] = &array[i];
+    }
+    builtins_hashed = 1;
+  }
+
+  // probe until the name or an empty slot
+  for (unsigned slot = builtin_hash(name); builtin_slots[slot] != NULL; slot = (slot + 1) & (BUILTIN_SLOTS - 1))
+  {
+    if (strcmp(builtin_slots[slot]->name, name) == 0)
+    {
+      return builtin_slots[slot];
+    }
+  }
+  return NULL;
+}
+
 int my_cd(char **args)
 {
   // first check if the right number of arguments were inputted
@@ -145,6 +189,96 @@ int my_history(char **args)
   return 0;
 }
 
+// prints one command of the PATH cache
+void print_hashed(const char *name, const char *path, unsigned hits)
+{
+  printf("%4u\t%s\n", hits, path);
+}
+
+int my_hash(char **args)
+{
+  // with no arguments list the cached commands
+  if (args[1] == NULL)
+  {
+    printf("hits\tcommand\n");
+    pathcache_each(print_hashed);
+    return 0;
+  }
+
+  // hash -r forgets every command
+  if (strcmp(args[1], "-r") == 0)
+  {
+    pathcache_clear();
+    return 0;
+  }
+
+  // otherwise look the names up now so they are cached before they run
+  int result = 0;
+  for (int i = 1; args[i] != NULL; i++)
+  {
+    int cached;
+    if (pathcache_lookup(args[i], &cached) == NULL)
+    {
+      fprintf(stderr, "hash: %s: not found\n", args[i]);
+      result = -1;
+    }
+  }
+  return result;
+}
+
+int my_pipeline(char **args)
+{
+  static const char *placements[] = {"none", "spread", "compact"};
+
+  // with no arguments show the options
+  if (args[1] == NULL)
+  {
+    printf("size %d\n", pipe_size);
+    printf("affinity %s\n", placements[pipe_placement]);
+    return 0;
+  }
+
+  // pipeline size N[k|m] sets the capacity of every pipe, 0 for the default
+  if (strcmp(args[1], "size") == 0 && args[2] != NULL && args[3] == NULL)
+  {
+    char *end;
+    long size = strtol(args[2], &end, 10);
+    if (*end == 'k' || *end == 'K')
+    {
+      size *= 1024;
+      end++;
+    }
+    else if (*end == 'm' || *end == 'M')
+    {
+      size *= 1024 * 1024;
+      end++;
+    }
+    if (end == args[2] || *end != '\0' || size < 0 || size > 1024 * 1024 * 1024)
+    {
+      fprintf(stderr, "pipeline: invalid size %s\n", args[2]);
+      return -1;
+    }
+    pipe_size = size;
+    return 0;
+  }
+
+  // pipeline affinity none|spread|compact places the stages on CPUs
+  if (strcmp(args[1], "affinity") == 0 && args[2] != NULL && args[3] == NULL)
+  {
+    for (int i = 0; i < 3; i++)
+    {
+      if (strcmp(args[2], placements[i]) == 0)
+      {
+        pipe_placement = i;
+        return 0;
+      }
+    }
+  }
+
+  fprintf(stderr, "usage: pipeline [size N[k|m] | affinity none|spread|compact]\n");
+  return -1;
+}
+
 int my_jobs(char **args)
 {
   // simply calls on the job array and prints it out
@@ -240,8 +374,8 @@ int my_fg(char **args)
   }
 
   // this is when the job is (finally....) finished
-  job->running = 0;
   printf("Job [%d] PID=%d finished\n", job_num, job->pid);
+  finish_job(job_num);
   return 0;
 }
 
@@ -319,52 +453,327 @@ void sigtstp_handler(int sig)
   }
 }
 
-// needed to convert from dynamicstring_t to argv array
-char **change_argv(dynamicstring_t **tokens, int count)
+// reports a command that spawn_command could not start
+void spawn_error(char *name)
 {
-  char **argv = malloc(sizeof(char *) * (count + 1));
+  if (errno == ENOENT)
+  {
+    fprintf(stderr, "Command not found--Did you mean something else?\n");
+  }
+  else
+  {
+    perror(name);
+  }
+}
 
-  // check malloc allocation
-  if (argv == NULL)
+// closes the files open_redirections opened
+void close_redirections(int in_fd, int out_fd)
+{
+  if (in_fd >= 0)
   {
-    return NULL;
+    close(in_fd);
   }
+  if (out_fd >= 0)
+  {
+    close(out_fd);
+  }
+}
 
-  // loop through using strdup
-  for (int j = 0; j < count; j++)
+// takes every < file, > file and >> file out of argv and opens the files
+// close-on-exec into *in_fd and *out_fd, which stay -1 when not redirected.
+// the last redirection of each kind wins, like other shells.
+// returns 0, with the reason printed and nothing left open, if one fails
+int open_redirections(char **argv, int *in_fd, int *out_fd)
+{
+  *in_fd = -1;
+  *out_fd = -1;
+
+  int kept = 0;
+  for (int i = 0; argv[i] != NULL; i++)
   {
-    argv[j] = strdup(tokens[j]->buf);
-    DynamicString_Free(tokens[j]);
+    int input = strcmp(argv[i], "<") == 0;
+    int output = strcmp(argv[i], ">") == 0;
+    int append = strcmp(argv[i], ">>") == 0;
+
+    // normal args move down over the redirections taken out
+    if (!input && !output && !append)
+    {
+      argv[kept++] = argv[i];
+      continue;
+    }
+
+    // the file name must follow
+    char *name = argv[i + 1];
+    int fd = -1;
+    if (name == NULL || strcmp(name, "<") == 0 || strcmp(name, ">") == 0 || strcmp(name, ">>") == 0)
+    {
+      fprintf(stderr, "Invalid redirection\n");
+    }
+    else
+    {
+      if (input)
+      {
+        fd = open(name, O_RDONLY | O_CLOEXEC);
+      }
+      else
+      {
+        fd = open(name, O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0666);
+      }
+      // check for error
+      if (fd < 0)
+      {
+        perror(name);
+      }
+    }
+
+    if (fd < 0)
+    {
+      close_redirections(*in_fd, *out_fd);
+      *in_fd = -1;
+      *out_fd = -1;
+      return 0;
+    }
+
+    int *slot = input ? in_fd : out_fd;
+    if (*slot >= 0)
+    {
+      close(*slot);
+    }
+    *slot = fd;
+    i++;
   }
-  argv[count] = NULL;
-  // free the dynamicstrings
-  free(tokens);
-  return argv;
+  argv[kept] = NULL;
+  return 1;
 }
 
-// makes sure we have no zombie processess!
-void no_zombies(void)
+// runs the system's command of the same name on the builtin's stdin and
+// stdout, for options the builtin does not have
+int run_external(char **args)
 {
-  // loop thorugh jobs
-  for (int i = 0; i < job_count; i++)
+  spawn_options_t options = {.in_fd = -1, .out_fd = -1, .pgroup = -1, .foreground = 0};
+  pid_t pid = spawn_command(args, &options);
+  if (pid < 0)
   {
-    // if there is an active job
-    if (jobs[i].running)
+    spawn_error(args[0]);
+    return -1;
+  }
+  int status;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+// whether args has an option, which is more than a lone "-"
+int has_option(char **args, const char *allowed)
+{
+  for (int i = 1; args[i] != NULL; i++)
+  {
+    if (args[i][0] == '-' && args[i][1] != '\0' && (allowed == NULL || strcmp(args[i], allowed) != 0))
     {
-      int status;
-      // if job is still running returns 0
-      // if job is finished returns pid
-      // if error returns -1
-      pid_t result = waitpid(jobs[i].pid, &status, WNOHANG);
-      // this means process has finished
-      // mark it as no longer running
-      if (result > 0)
+      return 1;
+    }
+  }
+  return 0;
+}
+
+// cat without a process of its own, moving the data in the kernel where it can
+int my_cat(char **args)
+{
+  // options are left to the system's cat
+  if (has_option(args, NULL))
+  {
+    return run_external(args);
+  }
+
+  // no files means stdin
+  char *stdin_only[] = {"cat", "-", NULL};
+  if (args[1] == NULL)
+  {
+    args = stdin_only;
+  }
+
+  int result = 0;
+  for (int i = 1; args[i] != NULL; i++)
+  {
+    int fd = strcmp(args[i], "-") == 0 ? STDIN_FILENO : open(args[i], O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+      fprintf(stderr, "cat: %s: %s\n", args[i], strerror(errno));
+      result = -1;
+      continue;
+    }
+    int copied = copy_fd(fd, STDOUT_FILENO);
+    int error = errno;
+    if (fd != STDIN_FILENO)
+    {
+      close(fd);
+    }
+    if (copied != 0)
+    {
+      // a reader that went away or ctrl c ends it quietly like a signal would
+      if (error != EPIPE && error != EINTR)
+      {
+        fprintf(stderr, "cat: %s: %s\n", args[i], strerror(error));
+      }
+      result = -1;
+      if (error == EPIPE || error == EINTR)
+      {
+        break;
+      }
+    }
+  }
+  return result;
+}
+
+// tee [-a] file... without a process of its own, in the kernel where it can
+int my_tee(char **args)
+{
+  // options other than -a are left to the system's tee
+  if (has_option(args, "-a"))
+  {
+    return run_external(args);
+  }
+
+  int append = 0;
+  int count = 0;
+  for (int i = 1; args[i] != NULL; i++)
+  {
+    count++;
+  }
+  int files[count > 0 ? count : 1];
+  int nfiles = 0;
+  int result = 0;
+  for (int i = 1; args[i] != NULL; i++)
+  {
+    if (strcmp(args[i], "-a") == 0)
+    {
+      append = 1;
+    }
+  }
+  for (int i = 1; args[i] != NULL; i++)
+  {
+    if (strcmp(args[i], "-a") == 0)
+    {
+      continue;
+    }
+    int fd = open(args[i], O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0666);
+    if (fd < 0)
+    {
+      fprintf(stderr, "tee: %s: %s\n", args[i], strerror(errno));
+      result = -1;
+      continue;
+    }
+    files[nfiles++] = fd;
+  }
+
+  if (tee_fds(STDIN_FILENO, STDOUT_FILENO, files, nfiles) != 0)
+  {
+    if (errno != EPIPE && errno != EINTR)
+    {
+      perror("tee");
+    }
+    result = -1;
+  }
+  for (int i = 0; i < nfiles; i++)
+  {
+    close(files[i]);
+  }
+  return result;
+}
+
+// runs a builtin pipeline stage in the shell itself, with stdin and stdout
+// pointed at in_fd and out_fd (-1 keeps the shell's) until it returns
+int run_builtin_here(builtin *b, char **argv, int in_fd, int out_fd)
+{
+  int saved_in = -1;
+  int saved_out = -1;
+
+  // swap in the pipe ends, keeping the shell's own out of the way
+  fflush(stdout);
+  if (in_fd >= 0)
+  {
+    saved_in = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10);
+    dup2(in_fd, STDIN_FILENO);
+  }
+  if (out_fd >= 0)
+  {
+    saved_out = fcntl(STDOUT_FILENO, F_DUPFD_CLOEXEC, 10);
+    dup2(out_fd, STDOUT_FILENO);
+  }
+
+  // a reader that quits early must not kill the shell with SIGPIPE
+  void (*old_pipe)(int) = signal(SIGPIPE, SIG_IGN);
+  int result = b->ptr(argv);
+  fflush(stdout);
+  clearerr(stdout);
+  signal(SIGPIPE, old_pipe);
+
+  // put the shell's stdin and stdout back
+  if (saved_out >= 0)
+  {
+    dup2(saved_out, STDOUT_FILENO);
+    close(saved_out);
+  }
+  if (saved_in >= 0)
+  {
+    dup2(saved_in, STDIN_FILENO);
+    close(saved_in);
+  }
+  return result == 0 ? 0 : 1;
+}
+
+// runs a builtin in a child that never execs, set up as spawn_command sets
+// up an external command. fd holds the pipeline's pipes, none outside one
+pid_t fork_builtin(builtin *b, char **argv, const spawn_options_t *options, int (*fd)[2], int pipe_count)
+{
+  // nothing buffered may be written twice
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    // its process group and the terminal first, while SIGTTOU is still ignored
+    if (options->pgroup >= 0)
+    {
+      setpgid(0, options->pgroup);
+      if (options->foreground && isatty(STDIN_FILENO))
       {
-        jobs[i].running = 0;
-        printf("job %d finished\n", i + 1);
+        tcsetpgrp(STDIN_FILENO, getpid());
       }
     }
+
+    // the child restores default signals
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+
+    // connects the pipes
+    if (options->in_fd >= 0)
+    {
+      dup2(options->in_fd, STDIN_FILENO);
+    }
+    if (options->out_fd >= 0)
+    {
+      dup2(options->out_fd, STDOUT_FILENO);
+    }
+
+    // close-on-exec does not help without an exec, so close the rest
+    for (int j = 0; j < pipe_count; j++)
+    {
+      close(fd[j][0]);
+      close(fd[j][1]);
+    }
+
+    int result = b->ptr(argv);
+    fflush(stdout);
+    _exit(result == 0 ? 0 : 1);
   }
+
+  // the parent sets the group too, so it exists whichever of them runs first
+  if (pid > 0 && options->pgroup >= 0)
+  {
+    setpgid(pid, options->pgroup == 0 ? pid : options->pgroup);
+  }
+  return pid;
 }
 
 // handles pipe commands
@@ -395,78 +804,152 @@ int pipe_func(char **argv, int pipe_count)
   pid_t pids[num_cmds];
 
   // create the pipes based of our number of pipees
+  // close-on-exec, the children only keep the ends dup2'd onto stdin and stdout
   for (int i = 0; i < pipe_count; i++)
   {
     // check for error
-    if (pipe(fd[i]) == -1)
+    if (pipe2(fd[i], O_CLOEXEC) == -1)
     {
       perror("pipe");
       return -1;
     }
+    // bigger pipes mean fewer switches between the stages, the kernel rounds
+    // the size up to pages and refuses more than /proc/sys/fs/pipe-max-size
+    if (pipe_size > 0 && fcntl(fd[i][1], F_SETPIPE_SZ, pipe_size) < 0 && i == 0)
+    {
+      perror("pipeline size");
+    }
   }
 
-  // go through each command and fork
+  // each stage reads from the previous pipe and writes into its own, unless
+  // it redirects from or to a file, which it gets instead of the pipe end
+  int in_files[num_cmds];
+  int out_files[num_cmds];
+  int in_fds[num_cmds];
+  int out_fds[num_cmds];
+  int opened[num_cmds];
   for (int i = 0; i < num_cmds; i++)
   {
-    pid_t pid = fork();
+    opened[i] = open_redirections(sections[i], &in_files[i], &out_files[i]);
+    in_fds[i] = in_files[i] >= 0 ? in_files[i] : i > 0 ? fd[i - 1][0] : -1;
+    out_fds[i] = out_files[i] >= 0 ? out_files[i] : i < pipe_count ? fd[i][1] : -1;
+  }
 
-    // check for error
-    if (pid < 0)
+  // one builtin stage runs in the shell: the last one, or else the first,
+  // unless it needs a process. it runs after the rest of the pipeline
+  // started, so whatever it writes is read
+  int here = -1;
+  for (int end = 0; end < 2 && here < 0; end++)
+  {
+    int i = end == 0 ? num_cmds - 1 : 0;
+    builtin *b = opened[i] && sections[i][0] != NULL ? find_builtin(sections[i][0]) : NULL;
+    if (b != NULL && !b->process)
     {
-      perror("fork");
-      return -1;
+      here = i;
     }
-    // if were are at child
-    else if (pid == 0)
+  }
+
+  // nothing buffered may be written twice by a forked builtin
+  fflush(stdout);
+
+  // start each command with its pipes connected
+  for (int i = 0; i < num_cmds; i++)
+  {
+    spawn_options_t options = {
+        .in_fd = in_fds[i],
+        .out_fd = out_fds[i],
+        .pgroup = -1,
+        .foreground = 0,
+    };
+    pids[i] = -1;
+
+    // a file that could not be opened was reported already
+    if (!opened[i])
     {
-      // the child restores default signals
-      signal(SIGINT, SIG_DFL);
-      signal(SIGTSTP, SIG_DFL);
+      continue;
+    }
+    // check for an empty section
+    if (sections[i][0] == NULL)
+    {
+      fprintf(stderr, "Invalid command\n");
+      continue;
+    }
+    if (i == here)
+    {
+      continue;
+    }
 
-      // connects the pipes
-      // if it isnt the first command
-      if (i > 0)
-      {
-        // read input from previous pipe's command
-        dup2(fd[i - 1][0], STDIN_FILENO);
-      }
-      // if it isnt last command
-      if (i < pipe_count)
+    // other builtins get a child of their own, external commands are spawned
+    builtin *b = find_builtin(sections[i][0]);
+    if (b != NULL)
+    {
+      if ((pids[i] = fork_builtin(b, sections[i], &options, fd, pipe_count)) < 0)
       {
-        // write output into the current pipes write end
-        dup2(fd[i][1], STDOUT_FILENO);
+        perror("fork");
       }
+    }
+    else if ((pids[i] = spawn_command(sections[i], &options)) < 0)
+    {
+      spawn_error(sections[i][0]);
+    }
 
-      // close all of the unused pipes
-      for (int j = 0; j < pipe_count; j++)
+    // then put it on its CPU
+    if (pids[i] > 0 && !place_stage(pids[i], i, num_cmds, pipe_placement))
+    {
+      perror("pipeline affinity");
+    }
+  }
+
+  // the shell keeps only the ends of the builtin it runs, so a stage reading
+  // from another sees the end of its input when that one finishes
+  for (int i = 0; i < pipe_count; i++)
+  {
+    for (int end = 0; end < 2; end++)
+    {
+      if (here < 0 || (fd[i][end] != in_fds[here] && fd[i][end] != out_fds[here]))
       {
-        close(fd[j][0]);
-        close(fd[j][1]);
+        close(fd[i][end]);
+        fd[i][end] = -1;
       }
-      // execute the commands
-      execvp(sections[i][0], sections[i]);
-      perror("execvp failed");
-      exit(EXIT_FAILURE);
     }
-    // store child pid for later waitpid
-    else
+  }
+
+  // now the builtin in the shell
+  int last_status = 127;
+  if (here >= 0)
+  {
+    int status = run_builtin_here(find_builtin(sections[here][0]), sections[here], in_fds[here], out_fds[here]);
+    if (here == num_cmds - 1)
     {
-      pids[i] = pid;
+      last_status = status;
     }
   }
 
-  // close all pipes in parents
-  // parent does not participate in pipeline..close everything!!
+  // close what is left of the pipes in the parent
   for (int i = 0; i < pipe_count; i++)
   {
-    close(fd[i][0]);
-    close(fd[i][1]);
+    for (int end = 0; end < 2; end++)
+    {
+      if (fd[i][end] >= 0)
+      {
+        close(fd[i][end]);
+      }
+    }
+  }
+  // and the redirected files
+  for (int i = 0; i < num_cmds; i++)
+  {
+    close_redirections(in_files[i], out_files[i]);
   }
 
   // wait for all children
-  int last_status = 0;
   for (int i = 0; i < num_cmds; i++)
   {
+    // stages that never started or ran in the shell have nothing to wait for
+    if (pids[i] < 0)
+    {
+      continue;
+    }
     // store last commands exit status
     int status;
     waitpid(pids[i], &status, 0);
@@ -516,53 +999,41 @@ int run_segment(char **segment_argv)
     return pipe_func(segment_argv, pipe_count);
   }
 
-  // next we check for built-ins
-  for (int i = 0; array[i].name != NULL; i++)
+  // open the files it redirects from and to
+  int in_file, out_file;
+  if (!open_redirections(segment_argv, &in_file, &out_file))
   {
-    // loop thru with strcmp on input and builtin array
-    if (strcmp(segment_argv[0], array[i].name) == 0)
-    {
-      int result = array[i].ptr(segment_argv);
-
-      if (result == 0)
-      {
-        // success
-        return 0;
-      }
-      else
-      {
-        // error
-        return 1;
-      }
-    }
+    return 1;
   }
-
-  // finally execute the external command since we now know it is not a builtin
-  pid_t pid = fork();
-  if (pid == 0)
+  // nothing left to run, like "> file" which only creates the file
+  if (segment_argv[0] == NULL)
   {
-    // create a new process group
-    setpgid(0, 0);
+    close_redirections(in_file, out_file);
+    return 0;
+  }
 
-    // gives terminal control to this new child
-    if (isatty(STDIN_FILENO))
-    {
-      tcsetpgrp(STDIN_FILENO, getpid());
-    }
+  // next we check for built-ins, which run with the files as stdin and stdout
+  // in the shell, unless they need a process
+  builtin *b = find_builtin(segment_argv[0]);
+  if (b != NULL && !b->process)
+  {
+    int result = run_builtin_here(b, segment_argv, in_file, out_file);
+    close_redirections(in_file, out_file);
+    return result;
+  }
 
-    // restore defasult signs so that interuppts effect the child and not the shell
-    signal(SIGINT, SIG_DFL);
-    signal(SIGTSTP, SIG_DFL);
-    signal(SIGTTIN, SIG_DFL);
-    signal(SIGTTOU, SIG_DFL);
-    // execute the command and handle error input
-    execvp(segment_argv[0], segment_argv);
-    fprintf(stderr, "Command not found--Did you mean something else?\n");
-    _exit(127);
+  // finally execute the command (or the builtin's child)
+  // in a new process group that gets the terminal
+  spawn_options_t options = {.in_fd = in_file, .out_fd = out_file, .pgroup = 0, .foreground = 1};
+  pid_t pid = b != NULL ? fork_builtin(b, segment_argv, &options, NULL, 0) : spawn_command(segment_argv, &options);
+  close_redirections(in_file, out_file);
+  if (pid < 0)
+  {
+    spawn_error(segment_argv[0]);
+    return 127;
   }
 
   // the parent gives terminal to child and waits
-  setpgid(pid, pid);
   if (isatty(STDIN_FILENO))
   {
     tcsetpgrp(STDIN_FILENO, pid);
@@ -584,17 +1055,8 @@ int run_segment(char **segment_argv)
   // if job is stopped
   if (WIFSTOPPED(status))
   {
-    // and we have not reached max jobs yet
-    if (job_count < MAX_JOBS)
-    {
-      // add to jobs list
-      jobs[job_count].pid = pid;
-      strncpy(jobs[job_count].command, segment_argv[0], BUFFER_SIZE - 1);
-      jobs[job_count].command[BUFFER_SIZE - 1] = '\0';
-      jobs[job_count].running = 1;
-      // printf("\n[Job %d] stopped  pid = %d  %s\n", job_count + 1, pid, jobs[job_count].command);
-      job_count++;
-    }
+    // add to jobs list
+    add_job(pid, segment_argv[0]);
     // arb value code to return
     return 999;
   }
@@ -673,55 +1135,34 @@ int operators(char **argv)
   return last_status;
 }
 
-// launches processes
-int launch_fork(char **argv, int background)
+// launches processes, external commands or builtins that need one
+int launch_command(char **argv, int background, int in_fd, int out_fd)
 {
-  pid_t pid = fork();
-  // we're in child process
-  if (pid == 0)
-  {
-    // set up process group
-    setpgid(0, 0);
-
-    // if running in foreground give terminal control to new process
-    if (!background && isatty(STDIN_FILENO))
-    {
-      tcsetpgrp(STDIN_FILENO, getpid());
-    }
-
-    // restores default signal behavior
-    signal(SIGINT, SIG_DFL);
-    signal(SIGTSTP, SIG_DFL);
-    signal(SIGTTIN, SIG_DFL);
-    signal(SIGTTOU, SIG_DFL);
+  // in a new process group, which gets the terminal unless in background
+  spawn_options_t options = {.in_fd = in_fd, .out_fd = out_fd, .pgroup = 0, .foreground = !background};
+  builtin *b = find_builtin(argv[0]);
+  pid_t pid = b != NULL ? fork_builtin(b, argv, &options, NULL, 0) : spawn_command(argv, &options);
 
-    // execute the command and handle error if unable
-    execvp(argv[0], argv);
-    fprintf(stderr, "Command not found--Did you mean something else?\n");
-    exit(1);
+  // handle error if unable to start the command
+  if (pid < 0)
+  {
+    spawn_error(argv[0]);
   }
   // we're in parent process
-  else if (pid > 0)
+  else
   {
-
-    setpgid(pid, pid);
-
     // if there is background job
     if (background)
     {
-      // and we havent reached max jobs
-      if (job_count < MAX_JOBS)
+      // add to job array
+      int job_num = add_job(pid, argv[0]);
+      if (job_num > 0)
       {
-        // add to job array
-        jobs[job_count].pid = pid;
-        strcpy(jobs[job_count].command, argv[0]);
-        jobs[job_count].running = 1;
-        job_count++;
-        printf("[job %d] running in background\n", job_count);
+        printf("[job %d] running in background\n", job_num);
       }
       else
       {
-        fprintf(stderr, "Too many background jobs!\n");
+        perror("jobs");
       }
     }
     else
@@ -746,15 +1187,11 @@ int launch_fork(char **argv, int background)
       // check if it is stopped
       if (WIFSTOPPED(status))
       {
-        if (job_count < MAX_JOBS)
+        // record in job list for fg/bg later
+        int job_num = add_job(pid, argv[0]);
+        if (job_num > 0)
         {
-          // record in job list for fg/bg later
-          jobs[job_count].pid = pid;
-          strncpy(jobs[job_count].command, argv[0], BUFFER_SIZE - 1);
-          jobs[job_count].command[BUFFER_SIZE - 1] = '\0';
-          jobs[job_count].running = 1;
-          printf("\n[Job %d] stopped %s\n", job_count + 1, jobs[job_count].command);
-          job_count++;
+          printf("\n[Job %d] stopped %s\n", job_num, jobs[job_num - 1].command);
         }
       }
       fg_pid = -1;
@@ -772,9 +1209,17 @@ builtin array[] = {
     {.name = "bg", .ptr = my_bg},
     {.name = "help", .ptr = my_help},
     {.name = "history", .ptr = my_history},
+    {.name = "hash", .ptr = my_hash},
+    {.name = "pipeline", .ptr = my_pipeline},
+    {.name = "cat", .ptr = my_cat, .process = 1},
+    {.name = "tee", .ptr = my_tee, .process = 1},
     {.name = NULL},
 };
 
+// a probe ends at an empty slot, so the hashed table may never fill up, and
+// probes stay short while it is at most half full
+_Static_assert(sizeof(array) / sizeof(array[0]) - 1 <= BUILTIN_SLOTS / 2, "too many builtins, raise BUILTIN_SLOTS");
+
 int main(int argc, char **argv)
 {
   // alarm against fork bombs
@@ -798,6 +1243,9 @@ int main(int argc, char **argv)
   signal(SIGTTIN, SIG_IGN);
   signal(SIGTTOU, SIG_IGN);
 
+  // watch stdin and the background jobs together
+  jobs_init();
+
   char str[BUFFER_SIZE];
 
   // our infitnte loop that is the essence of our shell
@@ -806,26 +1254,12 @@ int main(int argc, char **argv)
     printf("mini-shell> ");
     fflush(stdout);
 
-    // reads in input using fgets
-    errno = 0;
-    if (fgets(str, BUFFER_SIZE, stdin) == NULL)
+    // reads in input, reporting background jobs as they finish meanwhile
+    if (read_line(str, BUFFER_SIZE) == NULL)
     {
       // handles case of EOF
-      if (feof(stdin))
-      {
-        putchar('\n');
-        break;
-      }
-      // hand;es interuppted
-      if (errno == EINTR)
-      {
-        putchar('\n');
-        clearerr(stdin);
-        continue;
-      }
-      // other read errors
-      clearerr(stdin);
-      continue;
+      putchar('\n');
+      break;
     }
 
     // removes the trailing newlines
@@ -838,32 +1272,28 @@ int main(int argc, char **argv)
       history[history_count - 1][BUFFER_SIZE - 1] = '\0';
     }
 
-    // parse the input using our parser
-    int count;
-    dynamicstring_t **tokens = run_parser((char *[]){"parser", str}, &count);
-
-    // continue if we have no input
-    if (count == 0)
+    // parse the input using our parser, into one block for the whole line
+    cmdline_t cmd;
+    if (!run_parser(str, &cmd))
     {
+      perror("malloc");
       continue;
     }
-    // conveert to char**
-    char **my_argv = change_argv(tokens, count);
 
-    // NULL check
-    if (my_argv == NULL || my_argv[0] == NULL)
+    // continue if we have no input
+    if (cmd.count == 0)
     {
-      if (my_argv != NULL)
-        free(my_argv);
+      free_cmdline(&cmd);
       continue;
     }
+    char **my_argv = cmd.argv;
+    int count = cmd.count;
 
     // checks if there is a background &
     int background = 0;
     if (count > 0 && strcmp(my_argv[count - 1], "&") == 0)
     {
       background = 1;
-      free(my_argv[count - 1]);
       my_argv[count - 1] = NULL;
       count--;
     }
@@ -872,7 +1302,7 @@ int main(int argc, char **argv)
     if (my_argv[0] == NULL)
     {
       fprintf(stderr, "Invalid command\n");
-      free(my_argv);
+      free_cmdline(&cmd);
       continue;
     }
 
@@ -914,38 +1344,30 @@ int main(int argc, char **argv)
       }
       else
       {
-        // check for built-ins
-        int found = 0;
-        for (int i = 0; array[i].name != NULL; i++)
+        // open the files it redirects from and to
+        int in_file, out_file;
+        if (open_redirections(my_argv, &in_file, &out_file) && my_argv[0] != NULL)
         {
-          if (strcmp(my_argv[0], array[i].name) == 0)
+          // check for built-ins, which run with the files as stdin and stdout
+          // in the shell, unless they are sent to the background or need a process
+          builtin *b = find_builtin(my_argv[0]);
+          if (b != NULL && !background && !b->process)
           {
-            array[i].ptr(my_argv);
-            found = 1;
-            break;
+            run_builtin_here(b, my_argv, in_file, out_file);
+          }
+          // otherwise launch it as a process
+          else
+          {
+            launch_command(my_argv, background, in_file, out_file);
           }
         }
-
-        // if its not a builtin launch the external command
-        if (!found)
-        {
-          launch_fork(my_argv, background);
-        }
+        close_redirections(in_file, out_file);
       }
     }
 
-    // memory clean up
-    for (int j = 0; j < count; j++)
-    {
-      if (my_argv[j] != NULL)
-      {
-        free(my_argv[j]);
-      }
-    }
-    free(my_argv);
+    // memory clean up, the tokens all live in the block
+    free_cmdline(&cmd);
 
-    // take care of zombies
-    no_zombies();
   }
 
   return 0;